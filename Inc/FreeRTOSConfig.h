@@ -145,6 +145,11 @@ standard names. */
 #undef configMALLOC_FILL
 #define configMALLOC_FILL 1
 
+//tickless idle; we provide our own vPortSuppressTicksAndSleep() (in
+//low_power.c) which overrides the weak one in the port.  It does nothing
+//unless enabled in the persistent settings.
+#define configUSE_TICKLESS_IDLE 1
+
 /* USER CODE END Defines */ 
 
 #endif /* FREERTOS_CONFIG_H */
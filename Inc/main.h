@@ -60,6 +60,10 @@ void Error_Handler(void);
 /* Private defines -----------------------------------------------------------*/
 #define LED2_Pin GPIO_PIN_13
 #define LED2_GPIO_Port GPIOC
+#define MON_TX_Pin GPIO_PIN_2
+#define MON_TX_GPIO_Port GPIOA
+#define MON_RX_Pin GPIO_PIN_3
+#define MON_RX_GPIO_Port GPIOA
 #define BOOT1_Pin GPIO_PIN_2
 #define BOOT1_GPIO_Port GPIOB
 #define GPX_TX_Pin GPIO_PIN_9
@@ -106,6 +106,9 @@ extern USBD_CDC_ItfTypeDef USBD_Interface_fops_FS;
 uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len);
 
 /* USER CODE BEGIN EXPORTED_FUNCTIONS */
+//re-arm reception after it was held off for lack of room; call with the USB
+//interrupt locked out
+void CDC_RxResume_FS ( void );
 
 /* USER CODE END EXPORTED_FUNCTIONS */
 
@@ -16,6 +16,10 @@
 #include "task_wspr.h"
 
 #include "backup_registers.h"
+#include "low_power.h"
+#include "tx_calendar.h"
+#include "serial_devices.h"
+#include "task_monitor.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -37,12 +41,16 @@ static CmdProcRetval cmdhdlPerist ( const IOStreamIF* pio, const char* pszszToke
 static CmdProcRetval cmdhdlDeperist ( const IOStreamIF* pio, const char* pszszTokens );
 static CmdProcRetval cmdhdlReboot ( const IOStreamIF* pio, const char* pszszTokens );
 static CmdProcRetval cmdhdlDump ( const IOStreamIF* pio, const char* pszszTokens );
+static CmdProcRetval cmdhdlUpload ( const IOStreamIF* pio, const char* pszszTokens );
 
 #ifdef DEBUG
 static CmdProcRetval cmdhdlDiag ( const IOStreamIF* pio, const char* pszszTokens );
 #endif
 
 static CmdProcRetval cmdhdlGps ( const IOStreamIF* pio, const char* pszszTokens );
+static CmdProcRetval cmdhdlLowPower ( const IOStreamIF* pio, const char* pszszTokens );
+static CmdProcRetval cmdhdlIOStat ( const IOStreamIF* pio, const char* pszszTokens );
+static CmdProcRetval cmdhdlCal ( const IOStreamIF* pio, const char* pszszTokens );
 static CmdProcRetval cmdhdlWSPR001 ( const IOStreamIF* pio, const char* pszszTokens );
 static CmdProcRetval cmdhdlRef ( const IOStreamIF* pio, const char* pszszTokens );
 
@@ -55,12 +63,16 @@ const CmdProcEntry g_aceCommands[] =
 	{ "depersist", cmdhdlDeperist, "depersist settings from flash" },
 	{ "reboot", cmdhdlReboot, "restart the board" },
 	{ "dump", cmdhdlDump, "dump memory; [addr] [count]" },
+	{ "upload", cmdhdlUpload, "take a test upload and checksum it; [count] {delay ms}" },
 #ifdef DEBUG
 	{ "diag", cmdhdlDiag, "show diagnostic info (DEBUG build only)" },
 #endif
-	{ "gps", cmdhdlGps, "show GPS info (if any)" },
-	{ "wspr", cmdhdlWSPR001, "emit WSPR signal; [on|off]" },
+	{ "gps", cmdhdlGps, "show GPS info (if any); [reset] lock stats" },
+	{ "lowpower", cmdhdlLowPower, "show low-power idle statistics; [reset]" },
+	{ "iostat", cmdhdlIOStat, "show serial I/O statistics; [reset]" },
+	{ "wspr", cmdhdlWSPR001, "emit WSPR signal; [on|off|stats {reset}]" },
 	{ "ref", cmdhdlRef, "emit reference signal; [on|off] {freq}" },
+	{ "cal", cmdhdlCal, "show/set transmit calendar; [allow|block hh:mm hh:mm] [days sun,mon,...|all] [clear]" },
 
 	{ "help", cmdhdlHelp, "get help on a command; help [cmd]" },
 };
@@ -99,11 +111,15 @@ static void _cmdPutInt ( const IOStreamIF* pio, long val, int padding )
 }
 
 
-static void _cmdPutFloat ( const IOStreamIF* pio, float val )
+//a value in millionths (e.g. micro-degrees) as a decimal; no float needed
+static void _cmdPutMicro ( const IOStreamIF* pio, long val )
 {
-	char ach[20];
-	my_ftoa ( ach, val );
-	_cmdPutString ( pio, ach );
+	unsigned long uval = ( val < 0 ) ? -(unsigned long)val : (unsigned long)val;
+	if ( val < 0 )
+		_cmdPutChar ( pio, '-' );
+	_cmdPutInt ( pio, uval / 1000000, 0 );
+	_cmdPutChar ( pio, '.' );
+	_cmdPutInt ( pio, uval % 1000000, 6 );
 }
 
 
@@ -308,6 +324,31 @@ static CmdProcRetval cmdhdlHelp ( const IOStreamIF* pio, const char* pszszTokens
 }
 
 
+//the display name of a low-power mode setting
+static const char* _lowPowerModeName ( uint32_t nMode )
+{
+	switch ( nMode )
+	{
+		case LOWPOWER_OFF: return "off";
+		case LOWPOWER_SLEEP: return "sleep";
+		case LOWPOWER_STOP: return "stop";
+		default: return "?";
+	}
+}
+
+
+static const char* _monitorPortsName ( uint32_t nPorts )
+{
+	switch ( nPorts )
+	{
+		case MONITOR_PORT_CDC: return "cdc";
+		case MONITOR_PORT_UART2: return "uart2";
+		case MONITOR_PORT_ALL: return "both";
+		default: return "?";
+	}
+}
+
+
 static CmdProcRetval cmdhdlSet ( const IOStreamIF* pio, const char* pszszTokens )
 {
 	PersistentSettings* psettings = Settings_getStruct();
@@ -369,11 +410,42 @@ static CmdProcRetval cmdhdlSet ( const IOStreamIF* pio, const char* pszszTokens
 		_cmdPutString ( pio, "gpsrate:  " );
 		_cmdPutInt ( pio, psettings->_nGPSbitRate, 0 );
 		_cmdPutCRLF(pio);
+		_cmdPutString ( pio, "track:  " );
+		_cmdPutInt ( pio, psettings->_bTrackGrid, 0 );
+		_cmdPutCRLF(pio);
+		_cmdPutString ( pio, "gpsubx:  " );
+		_cmdPutInt ( pio, psettings->_bGPSConfigUBX, 0 );
+		_cmdPutCRLF(pio);
+		_cmdPutString ( pio, "lockgood:  " );
+		_cmdPutInt ( pio, psettings->_nLockAcquire, 0 );
+		_cmdPutCRLF(pio);
+		_cmdPutString ( pio, "lockbad:  " );
+		_cmdPutInt ( pio, psettings->_nLockLose, 0 );
+		_cmdPutCRLF(pio);
+		_cmdPutString ( pio, "locksats:  " );
+		_cmdPutInt ( pio, psettings->_nLockMinSats, 0 );
+		_cmdPutCRLF(pio);
+		_cmdPutString ( pio, "lockhdop:  " );
+		_cmdPutInt ( pio, psettings->_nLockMaxHDOP, 0 );
+		_cmdPutString ( pio, " (x100; 0 is any)" );
+		_cmdPutCRLF(pio);
 
 		_cmdPutString ( pio, "synthcorr:  " );
 		_cmdPutInt ( pio, psettings->_nSynthCorrPPM, 0 );
 		_cmdPutCRLF(pio);
 
+		_cmdPutString ( pio, "sched:  " );
+		_cmdPutString ( pio, WSPR_SCHED_DIRECT == psettings->_nWSPRSchedMode ? "direct" : "every" );
+		_cmdPutCRLF(pio);
+
+		_cmdPutString ( pio, "lowpower:  " );
+		_cmdPutString ( pio, _lowPowerModeName ( psettings->_nLowPowerMode ) );
+		_cmdPutCRLF(pio);
+
+		_cmdPutString ( pio, "monitor:  " );
+		_cmdPutString ( pio, _monitorPortsName ( psettings->_nMonitorPorts ) );
+		_cmdPutCRLF(pio);
+
 		_cmdPutString ( pio, "wspr:  " );
 		_cmdPutString ( pio, WSPR_isWSPRing() ? "on" : "off" );
 		_cmdPutString ( pio, WSPR_isTransmitting() ? ", " : ", not " );
@@ -567,6 +639,8 @@ static CmdProcRetval cmdhdlSet ( const IOStreamIF* pio, const char* pszszTokens
 		else
 		{
 			psettings->_nDutyPct = duty;
+			//(in direct scheduling, the next slot was chosen with the old duty)
+			WSPR_Reschedule();
 		}
 	}
 	else if ( 0 == strcmp ( "callsign", pszSetting ) )
@@ -625,10 +699,77 @@ static CmdProcRetval cmdhdlSet ( const IOStreamIF* pio, const char* pszszTokens
 		{
 			//clear the locked state so that the next message will stimulate a
 			//notification of lock.
-			g_bLock = 0;
+			GPS_forgetLock();
 		}
 //XXX activate/deactivate GPS
 	}
+	else if ( 0 == strcmp ( "track", pszSetting ) )
+	{
+		long int track = my_atol ( pszValue, NULL );
+		psettings->_bTrackGrid = track ? 1 : 0;
+	}
+	else if ( 0 == strcmp ( "gpsubx", pszSetting ) )
+	{
+		long int ubx = my_atol ( pszValue, NULL );
+		psettings->_bGPSConfigUBX = ubx ? 1 : 0;
+		//(takes effect at next boot)
+	}
+	else if ( 0 == strcmp ( "lockgood", pszSetting ) )
+	{
+		long int fixes = my_atol ( pszValue, NULL );
+		if ( fixes < 1 || fixes > 60 )
+		{
+			_cmdPutString ( pio, "fixes must be 1 - 60\r\n" );
+			CWCMD_SendPrompt ( pio );
+			return CMDPROC_ERROR;
+		}
+		else
+		{
+			psettings->_nLockAcquire = fixes;
+		}
+	}
+	else if ( 0 == strcmp ( "lockbad", pszSetting ) )
+	{
+		long int fixes = my_atol ( pszValue, NULL );
+		if ( fixes < 1 || fixes > 60 )
+		{
+			_cmdPutString ( pio, "fixes must be 1 - 60\r\n" );
+			CWCMD_SendPrompt ( pio );
+			return CMDPROC_ERROR;
+		}
+		else
+		{
+			psettings->_nLockLose = fixes;
+		}
+	}
+	else if ( 0 == strcmp ( "locksats", pszSetting ) )
+	{
+		long int sats = my_atol ( pszValue, NULL );
+		if ( sats < 0 || sats > 32 )
+		{
+			_cmdPutString ( pio, "sats must be 0 - 32\r\n" );
+			CWCMD_SendPrompt ( pio );
+			return CMDPROC_ERROR;
+		}
+		else
+		{
+			psettings->_nLockMinSats = sats;
+		}
+	}
+	else if ( 0 == strcmp ( "lockhdop", pszSetting ) )
+	{
+		long int hdop = my_atol ( pszValue, NULL );
+		if ( hdop < 0 || hdop > 9999 )
+		{
+			_cmdPutString ( pio, "hdop (x100) must be 0 - 9999\r\n" );
+			CWCMD_SendPrompt ( pio );
+			return CMDPROC_ERROR;
+		}
+		else
+		{
+			psettings->_nLockMaxHDOP = hdop;
+		}
+	}
 	else if ( 0 == strcmp ( "gpsrate", pszSetting ) )
 	{
 		long int rate = my_atol ( pszValue, NULL );
@@ -638,10 +779,37 @@ static CmdProcRetval cmdhdlSet ( const IOStreamIF* pio, const char* pszszTokens
 			CWCMD_SendPrompt ( pio );
 			return CMDPROC_ERROR;
 		}
+		else if ( ! psettings->_bUseGPS )
+		{
+			psettings->_nGPSbitRate = rate;	//(we'll go there when we use it)
+		}
 		else
 		{
-			psettings->_nGPSbitRate = rate;
-//XXX reconfigure USART1
+			switch ( GPS_changeBitRate ( rate, 10000 ) )
+			{
+			case GPS_BITRATE_OK:
+				psettings->_nGPSbitRate = rate;
+			break;
+
+			case GPS_BITRATE_UNHEARD:
+				//we've stayed at the new rate (the receiver most likely did
+				//switch), so that's what we must remember
+				psettings->_nGPSbitRate = rate;
+				_cmdPutString ( pio, "can't hear the receiver at either rate; staying at the new one\r\n" );
+			break;
+
+			case GPS_BITRATE_FAILED:
+				//(the receiver didn't follow, so we've gone back)
+				_cmdPutString ( pio, "receiver did not follow; rate unchanged\r\n" );
+				CWCMD_SendPrompt ( pio );
+				return CMDPROC_ERROR;
+
+			case GPS_BITRATE_PENDING:
+			default:
+				_cmdPutString ( pio, "GPS task still busy changing rate; rate not saved\r\n" );
+				CWCMD_SendPrompt ( pio );
+				return CMDPROC_ERROR;
+			}
 		}
 	}
 	else if ( 0 == strcmp ( "synthcorr", pszSetting ) )
@@ -649,6 +817,69 @@ static CmdProcRetval cmdhdlSet ( const IOStreamIF* pio, const char* pszszTokens
 		long int corr = my_atol ( pszValue, NULL );
 		psettings->_nSynthCorrPPM = corr;
 	}
+	else if ( 0 == strcmp ( "sched", pszSetting ) )
+	{
+		if ( 0 == strcmp ( "every", pszValue ) )
+		{
+			psettings->_nWSPRSchedMode = WSPR_SCHED_EVERY;
+		}
+		else if ( 0 == strcmp ( "direct", pszValue ) )
+		{
+			psettings->_nWSPRSchedMode = WSPR_SCHED_DIRECT;
+		}
+		else
+		{
+			_cmdPutString ( pio, "sched must be every or direct\r\n" );
+			CWCMD_SendPrompt ( pio );
+			return CMDPROC_ERROR;
+		}
+		WSPR_Reschedule();
+	}
+	else if ( 0 == strcmp ( "lowpower", pszSetting ) )
+	{
+		if ( 0 == strcmp ( "off", pszValue ) )
+		{
+			psettings->_nLowPowerMode = LOWPOWER_OFF;
+		}
+		else if ( 0 == strcmp ( "sleep", pszValue ) )
+		{
+			psettings->_nLowPowerMode = LOWPOWER_SLEEP;
+		}
+		else if ( 0 == strcmp ( "stop", pszValue ) )
+		{
+			psettings->_nLowPowerMode = LOWPOWER_STOP;
+		}
+		else
+		{
+			_cmdPutString ( pio, "lowpower must be off, sleep, or stop\r\n" );
+			CWCMD_SendPrompt ( pio );
+			return CMDPROC_ERROR;
+		}
+	}
+	else if ( 0 == strcmp ( "monitor", pszSetting ) )
+	{
+		if ( 0 == strcmp ( "cdc", pszValue ) )
+		{
+			psettings->_nMonitorPorts = MONITOR_PORT_CDC;
+		}
+		else if ( 0 == strcmp ( "uart2", pszValue ) )
+		{
+			psettings->_nMonitorPorts = MONITOR_PORT_UART2;
+		}
+		else if ( 0 == strcmp ( "both", pszValue ) )
+		{
+			psettings->_nMonitorPorts = MONITOR_PORT_ALL;
+		}
+		else
+		{
+			_cmdPutString ( pio, "monitor must be cdc, uart2, or both\r\n" );
+			CWCMD_SendPrompt ( pio );
+			return CMDPROC_ERROR;
+		}
+		//(this takes effect now; if it's not this port any more, then this
+		//is the last it will hear from us)
+		Monitor_setPorts ( psettings->_nMonitorPorts );
+	}
 	else
 	{
 		_cmdPutString ( pio, "error:  the setting " );
@@ -714,13 +945,6 @@ static CmdProcRetval cmdhdlReboot ( const IOStreamIF* pio, const char* pszszToke
 //diagnostic variables in main.c
 extern volatile size_t g_nHeapFree;
 extern volatile size_t g_nMinEverHeapFree;
-extern volatile int g_nMaxGPSRxQueue;
-extern volatile int g_nMaxCDCTxQueue;
-extern volatile int g_nMaxCDCRxQueue;
-extern volatile int g_nMinStackFreeDefault;
-extern volatile int g_nMinStackFreeMonitor;
-extern volatile int g_nMinStackFreeGPS;
-extern volatile int g_nMinStackFreeWSPR;
 
 #define USE_FREERTOS_HEAP_IMPL 1
 #if USE_FREERTOS_HEAP_IMPL
@@ -751,31 +975,7 @@ static CmdProcRetval cmdhdlDiag ( const IOStreamIF* pio, const char* pszszTokens
 	_cmdPutInt ( pio, g_nMinEverHeapFree, 0 );
 	_cmdPutCRLF(pio);
 
-	_cmdPutString ( pio, "GPS max RX queue: " );
-	_cmdPutInt ( pio, g_nMaxGPSRxQueue, 0 );
-	_cmdPutCRLF(pio);
-
-	_cmdPutString ( pio, "Monitor max RX queue: " );
-	_cmdPutInt ( pio, g_nMaxCDCRxQueue, 0 );
-	_cmdPutString ( pio, ", max TX queue: " );
-	_cmdPutInt ( pio, g_nMaxCDCTxQueue, 0 );
-	_cmdPutCRLF(pio);
-
-	_cmdPutString ( pio, "Task: Default: min stack free: " );
-	_cmdPutInt ( pio, g_nMinStackFreeDefault*sizeof(uint32_t), 0 );
-	_cmdPutCRLF(pio);
-
-	_cmdPutString ( pio, "Task: Monitor: min stack free: " );
-	_cmdPutInt ( pio, g_nMinStackFreeMonitor*sizeof(uint32_t), 0 );
-	_cmdPutCRLF(pio);
-
-	_cmdPutString ( pio, "Task: GPS: min stack free: " );
-	_cmdPutInt ( pio, g_nMinStackFreeGPS*sizeof(uint32_t), 0 );
-	_cmdPutCRLF(pio);
-
-	_cmdPutString ( pio, "Task: WSPR: min stack free: " );
-	_cmdPutInt ( pio, g_nMinStackFreeWSPR*sizeof(uint32_t), 0 );
-	_cmdPutCRLF(pio);
+	//(the stack watermarks are in 'iostat', since they're in all builds)
 
 #if USE_FREERTOS_HEAP_IMPL
 //heapwalk suspends all tasks, so not good here
@@ -795,32 +995,45 @@ static CmdProcRetval cmdhdlDiag ( const IOStreamIF* pio, const char* pszszTokens
 
 static CmdProcRetval cmdhdlGps ( const IOStreamIF* pio, const char* pszszTokens )
 {
-	if ( g_bLock )//0 != g_nGPSYear )
+	const char* pszArg1 = pszszTokens;
+	if ( NULL != pszArg1 && 0 == strcmp ( pszArg1, "reset" ) )
+	{
+		GPS_resetLockStats();
+		_cmdPutString ( pio, "done\r\n" );
+		CWCMD_SendPrompt ( pio );
+		return CMDPROC_SUCCESS;
+	}
+
+	//(take a snapshot so that it's all from the same moment)
+	GPSFix fix;
+	GPS_getFix ( &fix );
+
+	if ( fix._bLock )
 	{
 		//emit gps timestamp
 		_cmdPutString ( pio, "GPS TS:  " );
-		_cmdPutInt ( pio, g_nGPSYear, 4 );
+		_cmdPutInt ( pio, fix._nYear, 4 );
 		_cmdPutChar ( pio, '-' );
-		_cmdPutInt ( pio, g_nGPSMonth, 2 );
+		_cmdPutInt ( pio, fix._nMonth, 2 );
 		_cmdPutChar ( pio, '-' );
-		_cmdPutInt ( pio, g_nGPSDay, 2 );
+		_cmdPutInt ( pio, fix._nDay, 2 );
 		_cmdPutChar ( pio, ' ' );
-		_cmdPutInt ( pio, g_nGPSHour, 2 );
+		_cmdPutInt ( pio, fix._nHour, 2 );
 		_cmdPutChar ( pio, ':' );
-		_cmdPutInt ( pio, g_nGPSMinute, 2 );
+		_cmdPutInt ( pio, fix._nMinute, 2 );
 		_cmdPutChar ( pio, ':' );
-		_cmdPutInt ( pio, g_nGPSSecond, 2 );
+		_cmdPutInt ( pio, fix._nSecond, 2 );
 		_cmdPutCRLF(pio);
 
 		//emit location
 		_cmdPutString ( pio, "GPS Pos:  lat " );
-		_cmdPutFloat ( pio, g_fLat );
+		_cmdPutMicro ( pio, fix._nLatMicro );
 		_cmdPutString ( pio, ", lon " );
-		_cmdPutFloat ( pio, g_fLon );
+		_cmdPutMicro ( pio, fix._nLonMicro );
 		char ach[8];
-		if ( ! toMaidenhead ( g_fLat, g_fLon, ach, 6 ) )
+		if ( ! toMaidenheadMicro ( fix._nLatMicro, fix._nLonMicro, ach, 6 ) )
 		{
-			_cmdPutString ( pio, "toMaidenhead() failed\r\n" );
+			_cmdPutString ( pio, "toMaidenheadMicro() failed\r\n" );
 		}
 		else
 		{
@@ -834,6 +1047,398 @@ static CmdProcRetval cmdhdlGps ( const IOStreamIF* pio, const char* pszszTokens
 		_cmdPutString ( pio, "(no lock yet)\r\n" );
 	}
 
+	//fix quality (if the receiver sends GGA)
+	if ( fix._nFixQuality >= 0 )
+	{
+		_cmdPutString ( pio, "GPS Fix:  quality " );
+		_cmdPutInt ( pio, fix._nFixQuality, 0 );
+		_cmdPutString ( pio, ", type " );
+		_cmdPutInt ( pio, fix._nFixType, 0 );
+		_cmdPutString ( pio, "D, sats " );
+		_cmdPutInt ( pio, fix._nSats, 0 );
+		_cmdPutString ( pio, ", HDOP " );
+		_cmdPutInt ( pio, fix._nHDOP / 100, 0 );
+		_cmdPutChar ( pio, '.' );
+		_cmdPutInt ( pio, fix._nHDOP % 100, 2 );
+		_cmdPutString ( pio, ", PDOP " );
+		_cmdPutInt ( pio, fix._nPDOP / 100, 0 );
+		_cmdPutChar ( pio, '.' );
+		_cmdPutInt ( pio, fix._nPDOP % 100, 2 );
+		_cmdPutString ( pio, ", alt " );
+		_cmdPutInt ( pio, fix._nAltitude, 0 );
+		_cmdPutString ( pio, " m\r\n" );
+	}
+
+	//lock state machine; lots suppressed suggests a marginal antenna
+	GPSLockStats gls;
+	GPS_getLockStats ( &gls );
+	_cmdPutString ( pio, "Lock:  acquired " );
+	_cmdPutInt ( pio, gls._nAcquired, 0 );
+	_cmdPutString ( pio, ", lost " );
+	_cmdPutInt ( pio, gls._nLost, 0 );
+	_cmdPutString ( pio, ", suppressed " );
+	_cmdPutInt ( pio, gls._nSuppressed, 0 );
+	_cmdPutCRLF(pio);
+
+	//receive load; configuring the receiver should make this drop a lot
+	uint32_t nRateBefore, nRateNow;
+	GPS_getRxInterruptRates ( &nRateBefore, &nRateNow );
+	_cmdPutString ( pio, "RX irq/sec:  " );
+	if ( 0 != nRateBefore )
+	{
+		_cmdPutString ( pio, "before UBX config " );
+		_cmdPutInt ( pio, nRateBefore, 0 );
+		_cmdPutString ( pio, ", now " );
+	}
+	_cmdPutInt ( pio, nRateNow, 0 );
+	_cmdPutCRLF(pio);
+
+	//sentence statistics; lots of bad ones suggests noise on the line
+	size_t nIdx;
+	const char* pszName;
+	NMEASentenceStats nss;
+	for ( nIdx = 0; GPS_getSentenceStats ( nIdx, &pszName, &nss ); ++nIdx )
+	{
+		_cmdPutString ( pio, pszName );
+		_cmdPutString ( pio, ":  good " );
+		_cmdPutInt ( pio, nss._nGood, 0 );
+		_cmdPutString ( pio, ", bad " );
+		_cmdPutInt ( pio, nss._nBad, 0 );
+		_cmdPutCRLF(pio);
+	}
+
+	CWCMD_SendPrompt ( pio );
+	return CMDPROC_SUCCESS;
+}
+
+
+static CmdProcRetval cmdhdlLowPower ( const IOStreamIF* pio, const char* pszszTokens )
+{
+	const char* pszArg1 = pszszTokens;
+	if ( NULL != pszArg1 && 0 == strcmp ( pszArg1, "reset" ) )
+	{
+		LowPower_resetStats();
+		_cmdPutString ( pio, "done\r\n" );
+		CWCMD_SendPrompt ( pio );
+		return CMDPROC_SUCCESS;
+	}
+
+	PersistentSettings* psettings = Settings_getStruct();
+	LowPowerStats lps;
+	LowPower_getStats ( &lps );
+
+	_cmdPutString ( pio, "mode:  " );
+	_cmdPutString ( pio, _lowPowerModeName ( psettings->_nLowPowerMode ) );
+	_cmdPutCRLF(pio);
+
+	_cmdPutString ( pio, "elapsed ms: " );
+	_cmdPutInt ( pio, lps._msTotal, 0 );
+	_cmdPutString ( pio, ", in sleep: " );
+	_cmdPutInt ( pio, lps._msSleep, 0 );
+	_cmdPutString ( pio, ", in stop: " );
+	_cmdPutInt ( pio, lps._msStop, 0 );
+	_cmdPutCRLF(pio);
+
+	_cmdPutString ( pio, "entries: sleep: " );
+	_cmdPutInt ( pio, lps._nSleeps, 0 );
+	_cmdPutString ( pio, ", stop: " );
+	_cmdPutInt ( pio, lps._nStops, 0 );
+	_cmdPutString ( pio, ", aborted: " );
+	_cmdPutInt ( pio, lps._nAborts, 0 );
+	_cmdPutCRLF(pio);
+
+	_cmdPutString ( pio, "stop wakeups: RTC: " );
+	_cmdPutInt ( pio, lps._nWakeRTC, 0 );
+	_cmdPutString ( pio, ", GPS UART: " );
+	_cmdPutInt ( pio, lps._nWakeUART, 0 );
+	_cmdPutString ( pio, ", monitor UART: " );
+	_cmdPutInt ( pio, lps._nWakeUART2, 0 );
+	_cmdPutCRLF(pio);
+
+	_cmdPutString ( pio, "est. avg MCU current uA: " );
+	_cmdPutInt ( pio, lps._nEstAvgUA, 0 );
+	_cmdPutCRLF(pio);
+
+	CWCMD_SendPrompt ( pio );
+	return CMDPROC_SUCCESS;
+}
+
+
+
+//the streams we report on
+typedef struct IOStatStream IOStatStream;
+struct IOStatStream
+{
+	const char* _pszName;
+	const IOStreamIF* _pio;
+};
+static const IOStatStream _aIOStatStreams[] =
+{
+	{ "GPS (UART1)", &g_pifUART1 },
+	{ "Monitor (CDC)", &g_pifCDC },
+	{ "Monitor (UART2)", &g_pifUART2 },
+};
+
+
+//the stack watermarks, in main.c; the default task takes them periodically.
+//(They are in words.)
+extern volatile int g_nMinStackFreeDefault;
+extern volatile int g_nMinStackFreeMonitor;
+extern volatile int g_nMinStackFreeGPS;
+extern volatile int g_nMinStackFreeWSPR;
+
+
+static CmdProcRetval cmdhdlIOStat ( const IOStreamIF* pio, const char* pszszTokens )
+{
+	size_t nIdx;
+	const char* pszArg1 = pszszTokens;
+	if ( NULL != pszArg1 && 0 == strcmp ( pszArg1, "reset" ) )
+	{
+		for ( nIdx = 0; nIdx < COUNTOF(_aIOStatStreams); ++nIdx )
+			Serial_resetStats ( _aIOStatStreams[nIdx]._pio );
+		_cmdPutString ( pio, "done\r\n" );
+		CWCMD_SendPrompt ( pio );
+		return CMDPROC_SUCCESS;
+	}
+
+	for ( nIdx = 0; nIdx < COUNTOF(_aIOStatStreams); ++nIdx )
+	{
+		//(take a snapshot so that it's all from about the same moment)
+		IOStreamStats ios;
+		if ( ! Serial_getStats ( _aIOStatStreams[nIdx]._pio, &ios ) )
+			continue;
+
+		_cmdPutString ( pio, _aIOStatStreams[nIdx]._pszName );
+		_cmdPutString ( pio, ":  bytes in: " );
+		_cmdPutInt ( pio, ios._nBytesIn, 0 );
+		_cmdPutString ( pio, ", out: " );
+		_cmdPutInt ( pio, ios._nBytesOut, 0 );
+		_cmdPutCRLF(pio);
+
+		_cmdPutString ( pio, "  overruns: " );
+		_cmdPutInt ( pio, ios._nOverruns, 0 );
+		_cmdPutString ( pio, ", errors: " );
+		_cmdPutInt ( pio, ios._nErrors, 0 );
+		_cmdPutCRLF(pio);
+
+		_cmdPutString ( pio, "  RX queue max: " );
+		_cmdPutInt ( pio, ios._nRxHighWater, 0 );
+		_cmdPutChar ( pio, '/' );
+		_cmdPutInt ( pio, ios._nRxCapacity, 0 );
+		_cmdPutString ( pio, ", TX queue max: " );
+		_cmdPutInt ( pio, ios._nTxHighWater, 0 );
+		_cmdPutChar ( pio, '/' );
+		_cmdPutInt ( pio, ios._nTxCapacity, 0 );
+		_cmdPutCRLF(pio);
+
+		if ( 0 != ios._nRxInPlace || 0 != ios._nRxBounced || 0 != ios._nRxHeldOff )
+		{
+			_cmdPutString ( pio, "  RX packets in place: " );
+			_cmdPutInt ( pio, ios._nRxInPlace, 0 );
+			_cmdPutString ( pio, ", bounced: " );
+			_cmdPutInt ( pio, ios._nRxBounced, 0 );
+			_cmdPutString ( pio, ", held off: " );
+			_cmdPutInt ( pio, ios._nRxHeldOff, 0 );
+			_cmdPutCRLF(pio);
+		}
+
+		_cmdPutString ( pio, "  longest lock cycles: " );
+		_cmdPutInt ( pio, ios._nCritMaxCycles, 0 );
+		_cmdPutString ( pio, " (us: " );
+		_cmdPutInt ( pio, ios._nCritMaxCycles / ( SystemCoreClock / 1000000 ), 0 );
+		_cmdPutChar ( pio, ')' );
+		_cmdPutCRLF(pio);
+
+		//(woken is the waits that ended because of this stream, rather than
+		//by timing out, or for some other event of the task's)
+		_cmdPutString ( pio, "  blocking waits: " );
+		_cmdPutInt ( pio, ios._nWaits, 0 );
+		_cmdPutString ( pio, ", woken: " );
+		_cmdPutInt ( pio, ios._nWakeups, 0 );
+		_cmdPutString ( pio, ", longest ms: " );
+		_cmdPutInt ( pio, ios._nWaitMaxMs, 0 );
+		_cmdPutCRLF(pio);
+
+		_cmdPutString ( pio, "  longest wakeup latency cycles: " );
+		_cmdPutInt ( pio, ios._nWakeMaxCycles, 0 );
+		_cmdPutString ( pio, " (us: " );
+		_cmdPutInt ( pio, ios._nWakeMaxCycles / ( SystemCoreClock / 1000000 ), 0 );
+		_cmdPutChar ( pio, ')' );
+		_cmdPutCRLF(pio);
+	}
+
+	_cmdPutString ( pio, "RAM in serial buffers: " );
+	_cmdPutInt ( pio, Serial_getIORamBytes(), 0 );
+	_cmdPutCRLF(pio);
+
+	//(so that a buffer can't be grown at the expense of a stack unawares)
+	_cmdPutString ( pio, "Tasks' min stack free: Default: " );
+	_cmdPutInt ( pio, g_nMinStackFreeDefault*sizeof(uint32_t), 0 );
+	_cmdPutString ( pio, ", Monitor: " );
+	_cmdPutInt ( pio, g_nMinStackFreeMonitor*sizeof(uint32_t), 0 );
+	_cmdPutString ( pio, ", GPS: " );
+	_cmdPutInt ( pio, g_nMinStackFreeGPS*sizeof(uint32_t), 0 );
+	_cmdPutString ( pio, ", WSPR: " );
+	_cmdPutInt ( pio, g_nMinStackFreeWSPR*sizeof(uint32_t), 0 );
+	_cmdPutCRLF(pio);
+
+	CWCMD_SendPrompt ( pio );
+	return CMDPROC_SUCCESS;
+}
+
+
+//parse a calendar time 'hh:mm' into a slot index (24:00 is allowed, as the
+//end of the day); returns -1 if it's bogus
+static int _parseCalSlot ( const char* pszTime )
+{
+	if ( NULL == pszTime || strlen ( pszTime ) > 5 )
+		return -1;
+	char achTime[6];
+	if ( 4 != _cramDigits ( achTime, pszTime ) )
+		return -1;
+	int nMin = my_atoul ( &achTime[2], NULL );
+	achTime[2] = '\0';
+	int nHour = my_atoul ( &achTime[0], NULL );
+	if ( nMin > 59 || nHour > 24 || ( 24 == nHour && 0 != nMin ) )
+		return -1;
+	return TXCAL_SLOT ( nHour, nMin );
+}
+
+
+static const char* const _achDayNames[7] =
+	{ "sun", "mon", "tue", "wed", "thu", "fri", "sat" };
+
+
+//parse a comma-separated list of day names (or 'all') into a day mask;
+//returns -1 if it's bogus
+static int _parseCalDays ( const char* pszDays )
+{
+	if ( 0 == strcmp ( "all", pszDays ) )
+		return TXCAL_DAYS_ALL;
+	int nMask = 0;
+	while ( '\0' != *pszDays )
+	{
+		int nIdx;
+		for ( nIdx = 0; nIdx < 7; ++nIdx )
+		{
+			if ( 0 == strncmp ( _achDayNames[nIdx], pszDays, 3 ) )
+				break;
+		}
+		if ( nIdx >= 7 )
+			return -1;
+		nMask |= 1 << nIdx;
+		pszDays += 3;
+		if ( ',' == *pszDays )
+			++pszDays;
+		else if ( '\0' != *pszDays )
+			return -1;
+	}
+	return nMask;
+}
+
+
+static void _cmdPutSlotTime ( const IOStreamIF* pio, int nSlot )
+{
+	_cmdPutInt ( pio, TXCAL_SLOT_HOUR(nSlot), 2 );
+	_cmdPutChar ( pio, ':' );
+	_cmdPutInt ( pio, TXCAL_SLOT_MIN(nSlot), 2 );
+}
+
+
+static CmdProcRetval cmdhdlCal ( const IOStreamIF* pio, const char* pszszTokens )
+{
+	PersistentSettings* psettings = Settings_getStruct();
+
+	const char* pszArg1 = pszszTokens;
+	if ( NULL == pszArg1 )
+	{
+		//show the permitted days
+		_cmdPutString ( pio, "days:  " );
+		int nIdx;
+		for ( nIdx = 0; nIdx < 7; ++nIdx )
+		{
+			if ( ! ( psettings->_nTxCalDaysBlocked & ( 1UL << nIdx ) ) )
+			{
+				_cmdPutString ( pio, _achDayNames[nIdx] );
+				_cmdPutChar ( pio, ' ' );
+			}
+		}
+		_cmdPutCRLF(pio);
+
+		//show the permitted times as a list of ranges
+		_cmdPutString ( pio, "times:  " );
+		int nSlot = 0;
+		int bAny = 0;
+		while ( nSlot < TXCAL_SLOTS )
+		{
+			if ( ! TxCal_isTimePermitted ( psettings, nSlot ) )
+			{
+				++nSlot;
+				continue;
+			}
+			int nSlotStart = nSlot;
+			while ( nSlot < TXCAL_SLOTS && TxCal_isTimePermitted ( psettings, nSlot ) )
+				++nSlot;
+			_cmdPutSlotTime ( pio, nSlotStart );
+			_cmdPutChar ( pio, '-' );
+			if ( TXCAL_SLOTS == nSlot )
+				_cmdPutString ( pio, "24:00" );
+			else
+				_cmdPutSlotTime ( pio, nSlot );
+			_cmdPutChar ( pio, ' ' );
+			bAny = 1;
+		}
+		if ( ! bAny )
+			_cmdPutString ( pio, "(none)" );
+		_cmdPutCRLF(pio);
+
+		CWCMD_SendPrompt ( pio );
+		return CMDPROC_SUCCESS;
+	}
+
+	if ( 0 == strcmp ( pszArg1, "clear" ) )
+	{
+		//no restrictions
+		memset ( psettings->_anTxCalBlocked, 0, sizeof(psettings->_anTxCalBlocked) );
+		psettings->_nTxCalDaysBlocked = 0;
+	}
+	else if ( 0 == strcmp ( pszArg1, "allow" ) || 0 == strcmp ( pszArg1, "block" ) )
+	{
+		const char* pszStart = CMDPROC_nextToken ( pszArg1 );
+		const char* pszEnd = ( NULL == pszStart ) ? NULL : CMDPROC_nextToken ( pszStart );
+		int nSlotStart = _parseCalSlot ( pszStart );
+		int nSlotEnd = _parseCalSlot ( pszEnd );
+		if ( nSlotStart < 0 || nSlotEnd < 0 || TXCAL_SLOTS == nSlotStart )
+		{
+			_cmdPutString ( pio, "cal allow|block requires a start and end time hh:mm hh:mm\r\n" );
+			CWCMD_SendPrompt ( pio );
+			return CMDPROC_ERROR;
+		}
+		TxCal_setRange ( psettings, nSlotStart, nSlotEnd, 'a' == pszArg1[0] );
+	}
+	else if ( 0 == strcmp ( pszArg1, "days" ) )
+	{
+		const char* pszDays = CMDPROC_nextToken ( pszArg1 );
+		int nMask = ( NULL == pszDays ) ? -1 : _parseCalDays ( pszDays );
+		if ( nMask < 0 )
+		{
+			_cmdPutString ( pio, "cal days requires a list like mon,wed,fri or 'all'\r\n" );
+			CWCMD_SendPrompt ( pio );
+			return CMDPROC_ERROR;
+		}
+		psettings->_nTxCalDaysBlocked = TXCAL_DAYS_ALL & ~nMask;
+	}
+	else
+	{
+		_cmdPutString ( pio, "unknown cal option\r\n" );
+		CWCMD_SendPrompt ( pio );
+		return CMDPROC_ERROR;
+	}
+
+	//the next check-in may now be at a different time
+	WSPR_Reschedule();
+
+	_cmdPutString ( pio, "done\r\n" );
 	CWCMD_SendPrompt ( pio );
 	return CMDPROC_SUCCESS;
 }
@@ -997,6 +1602,100 @@ static CmdProcRetval cmdhdlDump ( const IOStreamIF* pio, const char* pszszTokens
 
 
 
+//========================================================================
+//'upload' command handler
+
+
+//This takes a test upload of a known size, and says how long it took and its
+//Adler-32, so that the host can tell that none of it was lost (see
+//test/cdc_upload.py).  It also says how the USB received the packets, so you
+//can see that the bounce buffer and the NAKing were exercised.  An optional
+//delay (ms) between reads makes us a slow reader, so the queue fills up.
+//The data is read 32 bytes at a time, as the stack is small here.
+static CmdProcRetval cmdhdlUpload ( const IOStreamIF* pio, const char* pszszTokens )
+{
+	const char* pszCount = pszszTokens;
+	if ( NULL == pszCount )
+	{
+		_cmdPutString ( pio, "upload requires a byte count\r\n" );
+		CWCMD_SendPrompt ( pio );
+		return CMDPROC_ERROR;
+	}
+	uint32_t nCount = _parseInt ( pszCount );
+	const char* pszDelay = CMDPROC_nextToken ( pszCount );
+	uint32_t nDelay = ( NULL == pszDelay ) ? 0 : _parseInt ( pszDelay );
+
+	IOStreamStats ios;
+	memset ( &ios, 0, sizeof(ios) );
+	Serial_getStats ( pio, &ios );	//(only the CDC has the RX path counts)
+	uint32_t nInPlace = ios._nRxInPlace;
+	uint32_t nBounced = ios._nRxBounced;
+	uint32_t nHeldOff = ios._nRxHeldOff;
+
+	//(the host doesn't start until it sees this)
+	_cmdPutString ( pio, "ready\r\n" );
+
+	uint8_t aby[32];
+	uint32_t nA = 1;
+	uint32_t nB = 0;
+	uint32_t nGot = 0;
+	uint32_t nStart = 0;
+	while ( nGot < nCount )
+	{
+		size_t nWant = nCount - nGot;
+		if ( nWant > sizeof(aby) )
+			nWant = sizeof(aby);
+		size_t nThis = nWant - pio->_receiveCompletely ( pio, aby, nWant, 2000 );
+		if ( 0 == nGot )	//(time from the first data)
+			nStart = HAL_GetTick();
+		size_t nIdx;
+		for ( nIdx = 0; nIdx < nThis; ++nIdx )
+		{
+			nA += aby[nIdx];
+			nB += nA;
+		}
+		//(32 bytes can't overflow these, so once per read is enough)
+		nA %= 65521;
+		nB %= 65521;
+		nGot += nThis;
+		if ( nThis != nWant )	//timed out
+			break;
+		if ( 0 != nDelay )
+			osDelay ( nDelay );
+	}
+	uint32_t nElapsed = HAL_GetTick() - nStart;
+	uint32_t nAdler = ( nB << 16 ) | nA;
+
+	memset ( &ios, 0, sizeof(ios) );
+	Serial_getStats ( pio, &ios );
+	_cmdPutString ( pio, "upload: " );
+	_cmdPutInt ( pio, nGot, 0 );
+	_cmdPutString ( pio, " of " );
+	_cmdPutInt ( pio, nCount, 0 );
+	_cmdPutString ( pio, " bytes in " );
+	_cmdPutInt ( pio, nElapsed, 0 );
+	_cmdPutString ( pio, " ms; adler32 " );
+	int nIter;
+	for ( nIter = 0; nIter < 8; ++nIter )
+	{
+		_cmdPutChar ( pio, _nybbleToChar ( (uint8_t) ( nAdler >> 28 ) ) );
+		nAdler <<= 4;
+	}
+	_cmdPutCRLF(pio);
+	_cmdPutString ( pio, "  RX packets in place: " );
+	_cmdPutInt ( pio, ios._nRxInPlace - nInPlace, 0 );
+	_cmdPutString ( pio, ", bounced: " );
+	_cmdPutInt ( pio, ios._nRxBounced - nBounced, 0 );
+	_cmdPutString ( pio, ", held off: " );
+	_cmdPutInt ( pio, ios._nRxHeldOff - nHeldOff, 0 );
+	_cmdPutCRLF(pio);
+
+	CWCMD_SendPrompt ( pio );
+	return ( nGot == nCount ) ? CMDPROC_SUCCESS : CMDPROC_ERROR;
+}
+
+
+
 //========================================================================
 //'wspr' command handler
 
@@ -1024,6 +1723,27 @@ static CmdProcRetval cmdhdlWSPR001 ( const IOStreamIF* pio, const char* pszszTok
 			_cmdPutString ( pio, "Failed to compute WSPR message!\r\n" );
 		}
 	}
+	else if ( 0 == strcmp ( pszArg1, "stats" ) )
+	{
+		const char* pszArg2 = CMDPROC_nextToken ( pszArg1 );
+		if ( NULL != pszArg2 && 0 == strcmp ( pszArg2, "reset" ) )
+		{
+			WSPR_resetSchedStats();
+			_cmdPutString ( pio, "done\r\n" );
+		}
+		else
+		{
+			WSPRSchedStats wss;
+			WSPR_getSchedStats ( &wss );
+			_cmdPutString ( pio, "wakeups: " );
+			_cmdPutInt ( pio, wss._nWakeups, 0 );
+			_cmdPutString ( pio, ", avoided: " );
+			_cmdPutInt ( pio, wss._nWakeupsAvoided, 0 );
+			_cmdPutString ( pio, ", transmissions: " );
+			_cmdPutInt ( pio, wss._nTransmissions, 0 );
+			_cmdPutCRLF(pio);
+		}
+	}
 	else
 	{
 		//stop any WSPR'ing
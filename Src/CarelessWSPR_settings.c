@@ -203,6 +203,17 @@ const PersistentSettings g_defaultSettings =
 	._bUseGPS = 1,
 	._nGPSbitRate = 9600,		//default for the ublox NEO-6M
 	._nSynthCorrPPM = 0,		//initially uncorrected
+	._nLowPowerMode = 0,		//LOWPOWER_OFF; opt-in
+	._anTxCalBlocked = { 0 },	//any time of day
+	._nTxCalDaysBlocked = 0,	//any day of the week
+	._nWSPRSchedMode = 1,		//WSPR_SCHED_DIRECT
+	._bTrackGrid = 0,			//fixed stations are the usual case
+	._bGPSConfigUBX = 1,		//the NEO-6M is a u-blox
+	._nLockAcquire = 3,			//3 sec at 1 Hz
+	._nLockLose = 10,			//ride out brief dropouts
+	._nLockMinSats = 4,			//enough for a 3D fix
+	._nLockMaxHDOP = 0,			//(any)
+	._nMonitorPorts = 1,		//MONITOR_PORT_CDC; UART2 is opt-in
 };
 
 
@@ -14,11 +14,17 @@ extern "C" {
 
 #include <stdint.h>
 
+
+//the transmit calendar is a bitmap of the 720 even-minute WSPR slots in a
+//day; slot n begins at minute 2n after midnight.
+#define TXCAL_SLOTS	720
+#define TXCAL_WORDS	((TXCAL_SLOTS+31)/32)
+
 //This serves as a signature of the version structure; you should change it
 //when the structure changes so that the firmware can gracefully recognize
 //old-formatted data.  Just don't use 0xffffffff, since that's how we test
 //for an erased area.
-#define PERSET_VERSION	1
+#define PERSET_VERSION	8
 
 
 //The persistent settings are stored in the last flash page.  It is simply a
@@ -63,6 +69,34 @@ typedef struct
 
 	//synthesizer correction factor
 	int32_t		_nSynthCorrPPM;		//parts per million; plus or minus
+
+	//how hard we try to save power while idle (see low_power.h)
+	uint32_t	_nLowPowerMode;		//LOWPOWER_xxx
+
+	//transmit calendar (see tx_calendar.h).  These are 'blocked' maps, so the
+	//out-of-box all-zeros state means 'no restrictions'.
+	uint32_t	_anTxCalBlocked[TXCAL_WORDS];	//bit n set == slot n blocked
+	uint32_t	_nTxCalDaysBlocked;	//bit n set == RTC_WEEKDAY n blocked (0 == Sun)
+	//how the WSPR scheduler decides when to wake (see task_wspr.h)
+	uint32_t	_nWSPRSchedMode;	//WSPR_SCHED_xxx
+
+	//track the grid locator continuously (for moving platforms), rather than
+	//only setting it when we acquire GPS lock
+	uint32_t	_bTrackGrid;		//boolean
+
+	//configure a u-blox receiver at startup (via UBX) to send only the NMEA
+	//sentences we use
+	uint32_t	_bGPSConfigUBX;		//boolean
+
+	//GPS lock hysteresis:  consecutive good (bad) fixes to gain (lose) lock,
+	//and what makes a fix 'good' if the receiver tells us (via GGA)
+	uint32_t	_nLockAcquire;		//fixes; 1 == no hysteresis
+	uint32_t	_nLockLose;			//fixes; 1 == no hysteresis
+	uint32_t	_nLockMinSats;		//0 == don't care
+	uint32_t	_nLockMaxHDOP;		//x 100; 0 == don't care
+
+	//which ports the monitor is attached to (see task_monitor.h)
+	uint32_t	_nMonitorPorts;		//MONITOR_PORT_xxx bits
 } PersistentSettings;
 
 
@@ -12,8 +12,8 @@
 #endif
 
 
-//command line buffer
-char g_achCmdLine[128];
+//command line buffer for the blocking version
+static char _achCmdLine[CMDPROC_LINE_LEN];
 
 
 
@@ -49,7 +49,7 @@ static void _getCommandLine2 ( const IOStreamIF* pio )
 
 	//pull characters into cmdline buffer until full or line terminated
 	nIdxCmd = 0;
-	while ( bCont && nIdxCmd < COUNTOF(g_achCmdLine) )
+	while ( bCont && nIdxCmd < CMDPROC_LINE_LEN )
 	{
 		char chNow = _cmdGetChar ( pio );
 		switch ( chNow )
@@ -57,7 +57,7 @@ static void _getCommandLine2 ( const IOStreamIF* pio )
 		case '\r':	//CR is a line terminator
 			_cmdPutChar ( pio, '\r' );
 			_cmdPutChar ( pio, '\n' );
-			memset ( &g_achCmdLine[nIdxCmd], '\0', COUNTOF(g_achCmdLine) - nIdxCmd );	//clear rest of buffer
+			memset ( &_achCmdLine[nIdxCmd], '\0', CMDPROC_LINE_LEN - nIdxCmd );	//clear rest of buffer
 			++nIdxCmd;
 			bCont = 0;
 		break;
@@ -65,7 +65,7 @@ static void _getCommandLine2 ( const IOStreamIF* pio )
 		case '\n':	//LF is a line terminator
 			_cmdPutChar ( pio, '\r' );
 			_cmdPutChar ( pio, '\n' );
-			memset ( &g_achCmdLine[nIdxCmd], '\0', COUNTOF(g_achCmdLine) - nIdxCmd );	//clear rest of buffer
+			memset ( &_achCmdLine[nIdxCmd], '\0', CMDPROC_LINE_LEN - nIdxCmd );	//clear rest of buffer
 			++nIdxCmd;
 			bCont = 0;
 		break;
@@ -82,7 +82,7 @@ static void _getCommandLine2 ( const IOStreamIF* pio )
 		default:
 			//everything else simply accumulates the character
 			_cmdPutChar ( pio, chNow );	//echo it back
-			g_achCmdLine[nIdxCmd] = chNow;
+			_achCmdLine[nIdxCmd] = chNow;
 			++nIdxCmd;
 		break;
 		}
@@ -96,19 +96,21 @@ static void _getCommandLine2 ( const IOStreamIF* pio )
 //This is a non-blocking version; it returns true if the line is complete and
 //can be processed, and false if the line is incomplete and this should be
 //invoked again later.
-static int _getCommandLine3 ( const IOStreamIF* pio )
+static int _getCommandLine3 ( const IOStreamIF* pio, CmdProcLine* pline )
 {
-	static int nIdxCmd = 0;
+	int nIdxCmd = pline->_nIdxCmd;	//(we pick up where we left off)
+	char* achCmdLine = pline->_achCmdLine;
 
 	int bCont = 1;
 
 	//pull characters into cmdline buffer until full or line terminated
-	while ( bCont && nIdxCmd < COUNTOF(g_achCmdLine) )
+	while ( bCont && nIdxCmd < CMDPROC_LINE_LEN )
 	{
 		char chNow;
 		size_t nGot = pio->_receive ( pio, &chNow, 1 );
 		if ( 0 == nGot )	//wanted more, but no more
 		{
+			pline->_nIdxCmd = nIdxCmd;
 			return 0;	//try again later
 		}
 
@@ -117,7 +119,7 @@ static int _getCommandLine3 ( const IOStreamIF* pio )
 		case '\r':	//CR is a line terminator
 			_cmdPutChar ( pio, '\r' );
 			_cmdPutChar ( pio, '\n' );
-			memset ( &g_achCmdLine[nIdxCmd], '\0', COUNTOF(g_achCmdLine) - nIdxCmd );	//clear rest of buffer
+			memset ( &achCmdLine[nIdxCmd], '\0', CMDPROC_LINE_LEN - nIdxCmd );	//clear rest of buffer
 			nIdxCmd = 0;	//next time start new line
 			bCont = 0;
 		break;
@@ -125,7 +127,7 @@ static int _getCommandLine3 ( const IOStreamIF* pio )
 		case '\n':	//LF is a line terminator
 			_cmdPutChar ( pio, '\r' );
 			_cmdPutChar ( pio, '\n' );
-			memset ( &g_achCmdLine[nIdxCmd], '\0', COUNTOF(g_achCmdLine) - nIdxCmd );	//clear rest of buffer
+			memset ( &achCmdLine[nIdxCmd], '\0', CMDPROC_LINE_LEN - nIdxCmd );	//clear rest of buffer
 			nIdxCmd = 0;	//next time start new line
 			bCont = 0;
 		break;
@@ -142,11 +144,14 @@ static int _getCommandLine3 ( const IOStreamIF* pio )
 		default:
 			//everything else simply accumulates the character
 			_cmdPutChar ( pio, chNow );	//echo it back
-			g_achCmdLine[nIdxCmd] = chNow;
+			achCmdLine[nIdxCmd] = chNow;
 			++nIdxCmd;
 		break;
 		}
 	}
+	if ( bCont )	//(full; take it as it is, and start over)
+		nIdxCmd = 0;
+	pline->_nIdxCmd = nIdxCmd;
 	return 1;
 }
 
@@ -154,7 +159,7 @@ static int _getCommandLine3 ( const IOStreamIF* pio )
 
 //this processes the command line into tokens.  this supports escaping and
 //quoting.
-void _parseCommandLine ( void )
+static void _parseCommandLine ( char* achCmdLine )
 {
 	int nIdxSrc;
 	int nIdxDst;
@@ -167,10 +172,10 @@ void _parseCommandLine ( void )
 	//parse characters
 	nIdxSrc = 0;
 	nIdxDst = 0;
-	while ( bCont && nIdxSrc < COUNTOF(g_achCmdLine) )
+	while ( bCont && nIdxSrc < CMDPROC_LINE_LEN )
 	{
 		//transfer from src to dst
-		char chNow = g_achCmdLine[nIdxSrc];
+		char chNow = achCmdLine[nIdxSrc];
 		++nIdxSrc;
 		switch ( chNow )
 		{
@@ -179,13 +184,13 @@ void _parseCommandLine ( void )
 			if ( bQuoting )
 			{
 				//if quoting; accumulate this whitespace
-				g_achCmdLine[nIdxDst] = chNow;
+				achCmdLine[nIdxDst] = chNow;
 				++nIdxDst;
 			}
 			else if ( bEscaping )
 			{
 				//if escaping; accumulate this whitespace and reset escaping state
-				g_achCmdLine[nIdxDst] = chNow;
+				achCmdLine[nIdxDst] = chNow;
 				++nIdxDst;
 				bEscaping = 0;
 			}
@@ -196,7 +201,7 @@ void _parseCommandLine ( void )
 			else
 			{
 				//otherwise whitespace is a token delimiter
-				g_achCmdLine[nIdxDst] = '\0';
+				achCmdLine[nIdxDst] = '\0';
 				++nIdxDst;
 				bSkipping = 1;
 			}
@@ -206,13 +211,13 @@ void _parseCommandLine ( void )
 			if ( bQuoting )
 			{
 				//if quoting; accumulate this char
-				g_achCmdLine[nIdxDst] = chNow;
+				achCmdLine[nIdxDst] = chNow;
 				++nIdxDst;
 			}
 			else if ( bEscaping )
 			{
 				//if escaping; accumulate this char and reset escaping state
-				g_achCmdLine[nIdxDst] = chNow;
+				achCmdLine[nIdxDst] = chNow;
 				++nIdxDst;
 				bEscaping = 0;
 			}
@@ -228,7 +233,7 @@ void _parseCommandLine ( void )
 			if ( bEscaping )
 			{
 				//if escaping; accumulate this char and reset escaping state
-				g_achCmdLine[nIdxDst] = chNow;
+				achCmdLine[nIdxDst] = chNow;
 				++nIdxDst;
 				bEscaping = 0;
 			}
@@ -241,14 +246,14 @@ void _parseCommandLine ( void )
 
 		case '\0':	//nul is line terminator
 			//XXX support escaping of this?
-			memset ( &g_achCmdLine[nIdxDst], '\0', COUNTOF(g_achCmdLine) - nIdxDst );	//clear rest of buffer
+			memset ( &achCmdLine[nIdxDst], '\0', CMDPROC_LINE_LEN - nIdxDst );	//clear rest of buffer
 			++nIdxDst;
 			bCont = 0;
 		break;
 
 		default:
 			//everything else simply accumulates the character
-			g_achCmdLine[nIdxDst] = chNow;
+			achCmdLine[nIdxDst] = chNow;
 			++nIdxDst;
 			bEscaping = 0;
 			bSkipping = 0;
@@ -257,8 +262,8 @@ void _parseCommandLine ( void )
 	}
 
 	//ensure cmdline is properly (double) terminated
-	g_achCmdLine[COUNTOF(g_achCmdLine)-1] = '\0';
-	g_achCmdLine[COUNTOF(g_achCmdLine)-2] = '\0';
+	achCmdLine[CMDPROC_LINE_LEN-1] = '\0';
+	achCmdLine[CMDPROC_LINE_LEN-2] = '\0';
 }
 
 
@@ -267,25 +272,25 @@ void _parseCommandLine ( void )
 
 
 
-static CmdProcRetval _parseAndDispatch ( const IOStreamIF* pio, const CmdProcEntry* acpe, size_t nAcpe )
+static CmdProcRetval _parseAndDispatch ( const IOStreamIF* pio, char* achCmdLine, const CmdProcEntry* acpe, size_t nAcpe )
 {
 	CmdProcRetval retval;
 	int nCmdEntry;
 
-	_parseCommandLine();	//tokenize the command line
+	_parseCommandLine ( achCmdLine );	//tokenize the command line
 
 	//dispatch command
-	nCmdEntry = CMDPROC_findProcEntry ( g_achCmdLine, acpe, nAcpe );
+	nCmdEntry = CMDPROC_findProcEntry ( achCmdLine, acpe, nAcpe );
 	if ( -1 != nCmdEntry )
 	{
-		const char* pszRest = CMDPROC_nextToken ( g_achCmdLine );
+		const char* pszRest = CMDPROC_nextToken ( achCmdLine );
 		retval = acpe[nCmdEntry]._pfxnHandler ( pio, pszRest );
 	}
 	else
 	{
 		//no valid command found
 		_cmdPutString ( pio, "The command '" );
-		_cmdPutString ( pio, g_achCmdLine );
+		_cmdPutString ( pio, achCmdLine );
 		_cmdPutString ( pio, "' is not recognized.\r\n" );
 		retval = CMDPROC_ERROR;
 	}
@@ -301,23 +306,23 @@ CmdProcRetval CMDPROC_process ( const IOStreamIF* pio, const CmdProcEntry* acpe,
 	do
 	{
 		_getCommandLine2 ( pio );	//get the command line from the IO stream
-	} while ( '\0' == g_achCmdLine[0] );
+	} while ( '\0' == _achCmdLine[0] );
 
-	return _parseAndDispatch ( pio, acpe, nAcpe );
+	return _parseAndDispatch ( pio, _achCmdLine, acpe, nAcpe );
 }
 
 
 
-CmdProcRetval CMDPROC_process_nb ( const IOStreamIF* pio, const CmdProcEntry* acpe, size_t nAcpe )
+CmdProcRetval CMDPROC_process_nb ( const IOStreamIF* pio, CmdProcLine* pline, const CmdProcEntry* acpe, size_t nAcpe )
 {
 	//get a tokenized series of strings
 	do
 	{
-		if ( ! _getCommandLine3 ( pio ) )
+		if ( ! _getCommandLine3 ( pio, pline ) )
 			return CMDPROC_INCOMPLETE;
-	} while ( '\0' == g_achCmdLine[0] );	//skip empty lines
+	} while ( '\0' == pline->_achCmdLine[0] );	//skip empty lines
 
-	return _parseAndDispatch ( pio, acpe, nAcpe );
+	return _parseAndDispatch ( pio, pline->_achCmdLine, acpe, nAcpe );
 }
 
 
@@ -34,10 +34,21 @@ struct CmdProcEntry
 };
 
 
+//the command line being accumulated.  The non-blocking version is handed
+//one of these per stream, so that several streams can be served at once.
+#define CMDPROC_LINE_LEN	128
+typedef struct CmdProcLine CmdProcLine;
+struct CmdProcLine
+{
+	int _nIdxCmd;	//where the next character goes
+	char _achCmdLine[CMDPROC_LINE_LEN];
+};
+
+
 //process data from input stream, dispatching commands
 CmdProcRetval CMDPROC_process ( const IOStreamIF* pio, const CmdProcEntry* acpe, size_t nAcpe );
 //non-blocking version will returns even if the line is incomplete
-CmdProcRetval CMDPROC_process_nb ( const IOStreamIF* pio, const CmdProcEntry* acpe, size_t nAcpe );
+CmdProcRetval CMDPROC_process_nb ( const IOStreamIF* pio, CmdProcLine* pline, const CmdProcEntry* acpe, size_t nAcpe );
 
 
 //helpers for command handlers
@@ -0,0 +1,521 @@
+//==============================================================
+//This implements the low-power idle support.
+//This module is part of the CarelessWSPR project.
+//
+//FreeRTOS calls vPortSuppressTicksAndSleep() from the idle task when it
+//expects nothing to happen for a while (configUSE_TICKLESS_IDLE).  The port
+//provides a weak default that does SLEEP via WFI; we supply our own so that we
+//can:
+//  *  cooperate with the HAL's tick (TIM2) which otherwise wakes us every ms
+//  *  optionally use STOP mode when no peripheral needs the clocks
+//  *  keep the accounting of where the time went
+//
+//SLEEP is a straight adaptation of the port's algorithm:  SysTick is
+//reprogrammed to interrupt when the expected idle period expires, and on wake
+//we figure out how many ticks actually elapsed.
+//
+//STOP is more involved.  SysTick (and everything else clocked from HCLK)
+//stops, so we use the RTC as the time reference and as the wakeup source,
+//and we use an EXTI falling edge on the GPS UART's RX pin so that incoming
+//data wakes us.  The first character is lost (the UART is not clocked when
+//the start bit arrives), but the NMEA parser simply resyncs at the next '$'.
+//The monitor UART (UART2) RX pin wakes us the same way; there, the first
+//keystroke is lost.
+//The RTC only has one alarm, which is normally used by the WSPR scheduler,
+//so we 'borrow' it:  we set it to the earlier of the WSPR alarm and our
+//wakeup time, and afterwards we restore it.  Since the alarm registers are
+//write-only on the F1, the WSPR scheduler tells us what it set via
+//LowPower_noteAlarm().
+//When we come out of STOP, the system clock is the HSI, so we need to
+//restore the HSE/PLL configuration before doing anything else.
+
+#include "low_power.h"
+#include "main.h"
+#include "stm32f1xx_hal.h"
+#include "cmsis_os.h"
+#include "usbd_def.h"
+
+#include "CarelessWSPR_settings.h"
+
+#include <string.h>
+
+
+extern RTC_HandleTypeDef hrtc;	//in main.c
+extern TIM_HandleTypeDef htim4;	//in main.c
+extern UART_HandleTypeDef huart1;	//in main.c
+extern UART_HandleTypeDef huart2;	//in main.c
+extern I2C_HandleTypeDef hi2c1;	//in main.c
+extern USBD_HandleTypeDef hUsbDeviceFS;	//in usb_device.c
+extern __IO uint32_t uwTick;	//in stm32f1xx_hal.c
+
+
+//the minimum expected idle period for which we bother with STOP; coming out
+//of STOP costs the HSE and PLL startup time, which is a couple ms.
+#define LOWPOWER_MIN_STOP_TICKS	50
+
+//we cap the idle period for STOP just to keep the arithmetic in range; an
+//hour is far longer than anything we actually wait for
+#define LOWPOWER_MAX_STOP_TICKS	(3600UL*configTICK_RATE_HZ)
+
+//RTC prescaler input frequency; i.e. 'RTC fractional second units'
+#define RTC_FRAC_HZ	LSE_VALUE
+
+//the alarm register's reset value (and effectively 'never')
+#define RTC_ALARM_NEVER	0xffffffffUL
+
+//the port uses this as a fudge factor for the SysTick counts that are lost
+//while we are stopping and restarting it; we use the same value.
+#define MISSED_COUNTS_FACTOR	45UL
+
+
+
+//SysTick counts per RTOS tick; 0 until initialized
+static uint32_t _ulCountsPerTick = 0;
+//the most ticks we can suppress in one SLEEP given the 24-bit counter
+static uint32_t _xMaxSuppressedTicks = 0;
+
+//the WSPR alarm's RTC counter value (if _bAlarmArmed)
+static volatile uint32_t _nAlarmCounter = RTC_ALARM_NEVER;
+static volatile int _bAlarmArmed = 0;
+
+//accounting; updated only in the idle task with interrupts disabled
+static LowPowerStats _stats;
+static TickType_t _tickStatsReset = 0;
+
+
+
+//==============================================================
+//RTC low-level access
+//The HAL's accessors use HAL_GetTick() for timeouts, and that is frozen
+//while we have interrupts disabled, so we do our own simple register access.
+
+
+//read the RTC counter (seconds); the two halves must be consistent
+static uint32_t _rtcReadCounter ( void )
+{
+	uint16_t nHigh1 = RTC->CNTH & RTC_CNTH_RTC_CNT;
+	uint16_t nLow = RTC->CNTL & RTC_CNTL_RTC_CNT;
+	uint16_t nHigh2 = RTC->CNTH & RTC_CNTH_RTC_CNT;
+	if ( nHigh1 != nHigh2 )	//rolled over; re-read low
+	{
+		nLow = RTC->CNTL & RTC_CNTL_RTC_CNT;
+	}
+	return ( ( (uint32_t) nHigh2 << 16 ) | nLow );
+}
+
+
+//read the RTC time in seconds, and the fraction in units of 1/RTC_FRAC_HZ
+static void _rtcReadTime ( uint32_t* pnSec, uint32_t* pnFrac )
+{
+	uint32_t nSec;
+	uint32_t nDiv;
+	do
+	{
+		nSec = _rtcReadCounter();
+		nDiv = ( ( RTC->DIVH & RTC_DIVH_RTC_DIV ) << 16 ) | ( RTC->DIVL & RTC_DIVL_RTC_DIV );
+	} while ( nSec != _rtcReadCounter() );
+	*pnSec = nSec;
+	//the divider counts down from the reload value, which is (RTC_FRAC_HZ-1)
+	*pnFrac = ( RTC_FRAC_HZ - 1 ) - nDiv;
+}
+
+
+//write the alarm counter
+static void _rtcWriteAlarm ( uint32_t nAlarm )
+{
+	while ( ! ( RTC->CRL & RTC_CRL_RTOFF ) ) {}	//last write complete
+	SET_BIT ( RTC->CRL, RTC_CRL_CNF );	//enter config mode
+	WRITE_REG ( RTC->ALRH, ( nAlarm >> 16 ) );
+	WRITE_REG ( RTC->ALRL, ( nAlarm & RTC_ALRL_RTC_ALR ) );
+	CLEAR_BIT ( RTC->CRL, RTC_CRL_CNF );	//exit config mode
+	while ( ! ( RTC->CRL & RTC_CRL_RTOFF ) ) {}	//write complete
+}
+
+
+//after STOP the APB1 interface must resync before reading the registers
+static void _rtcWaitSync ( void )
+{
+	CLEAR_BIT ( RTC->CRL, RTC_CRL_RSF );
+	while ( ! ( RTC->CRL & RTC_CRL_RSF ) ) {}
+}
+
+
+
+//==============================================================
+//the WSPR scheduler tells us about the alarm it set, since we cannot read
+//it back.  The HAL's alarm is a time-of-day; it is placed in the next 24 hrs.
+
+void LowPower_noteAlarm ( const RTC_TimeTypeDef* ptime )
+{
+	if ( NULL == ptime )
+	{
+		_bAlarmArmed = 0;
+		_nAlarmCounter = RTC_ALARM_NEVER;
+		return;
+	}
+
+	//the HAL keeps the counter reduced to the time-of-day (mostly; it is
+	//only reduced when the date is read), so work relative to 'now'.
+	uint32_t nNow = _rtcReadCounter();
+	uint32_t nTodNow = nNow % 86400;
+	uint32_t nTodAlarm = ptime->Hours * 3600UL + ptime->Minutes * 60UL + ptime->Seconds;
+	uint32_t nDelta = ( nTodAlarm + 86400 - nTodNow ) % 86400;
+	_nAlarmCounter = nNow + nDelta;
+	_bAlarmArmed = 1;
+}
+
+
+
+//==============================================================
+//clock restoration after STOP; this mirrors SystemClock_Config() in main.c
+//(HSE 8 MHz, PLL x9, flash latency is retained).
+
+static void _restoreClocks ( void )
+{
+	__HAL_RCC_HSE_CONFIG ( RCC_HSE_ON );
+	while ( ! __HAL_RCC_GET_FLAG ( RCC_FLAG_HSERDY ) ) {}
+	__HAL_RCC_PLL_ENABLE();
+	while ( ! __HAL_RCC_GET_FLAG ( RCC_FLAG_PLLRDY ) ) {}
+	__HAL_RCC_SYSCLK_CONFIG ( RCC_SYSCLKSOURCE_PLLCLK );
+	while ( RCC_SYSCLKSOURCE_STATUS_PLLCLK != __HAL_RCC_GET_SYSCLK_SOURCE() ) {}
+}
+
+
+//keep the HAL's tick (used for some timeouts and HAL_GetTick()) in step with
+//the RTOS tick, since its timer interrupt was suppressed while we slept.
+inline static void _advanceHALTick ( uint32_t nTicks )
+{
+	uwTick += nTicks * ( 1000UL / configTICK_RATE_HZ );
+}
+
+
+//restart SysTick with a normal tick period, starting now
+inline static void _restartSysTick ( void )
+{
+	SysTick->LOAD = _ulCountsPerTick - 1UL;
+	SysTick->VAL = 0UL;
+	SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_ENABLE_Msk;
+}
+
+
+
+//==============================================================
+//SLEEP; CPU stops, clocks keep running.  This is the port's algorithm.
+
+static void _sleepSysTick ( TickType_t xExpectedIdleTime )
+{
+	uint32_t ulReloadValue;
+	uint32_t ulCompleteTickPeriods;
+	uint32_t ulCompletedSysTickDecrements;
+
+	if ( xExpectedIdleTime > _xMaxSuppressedTicks )
+	{
+		xExpectedIdleTime = _xMaxSuppressedTicks;
+	}
+
+	//stop SysTick momentarily and compute the reload for the sleep period
+	SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+	ulReloadValue = SysTick->VAL + ( _ulCountsPerTick * ( xExpectedIdleTime - 1UL ) );
+	if ( ulReloadValue > MISSED_COUNTS_FACTOR )
+	{
+		ulReloadValue -= MISSED_COUNTS_FACTOR;
+	}
+
+	__disable_irq();
+	__DSB();
+	__ISB();
+
+	//something may have made a task ready while we were working this out
+	if ( eAbortSleep == eTaskConfirmSleepModeStatus() )
+	{
+		//carry on with the remainder of the current tick
+		SysTick->LOAD = SysTick->VAL;
+		SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+		SysTick->LOAD = _ulCountsPerTick - 1UL;
+		++_stats._nAborts;
+		__enable_irq();
+		return;
+	}
+
+	SysTick->LOAD = ulReloadValue;
+	SysTick->VAL = 0UL;
+	SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+	HAL_SuspendTick();
+
+	__DSB();
+	__WFI();
+	__ISB();
+
+	HAL_ResumeTick();
+
+	//let the interrupt that woke us run, then stop things again to tidy up
+	__enable_irq();
+	__DSB();
+	__ISB();
+	__disable_irq();
+	__DSB();
+	__ISB();
+
+	SysTick->CTRL = SysTick_CTRL_CLKSOURCE_Msk | SysTick_CTRL_TICKINT_Msk;
+
+	if ( SysTick->CTRL & SysTick_CTRL_COUNTFLAG_Msk )
+	{
+		//woken by the SysTick; the whole period elapsed.  The tick
+		//interrupt has already run, so one fewer.
+		uint32_t ulCalculatedLoadValue;
+		ulCalculatedLoadValue = ( _ulCountsPerTick - 1UL ) - ( ulReloadValue - SysTick->VAL );
+		if ( ( ulCalculatedLoadValue < MISSED_COUNTS_FACTOR ) || ( ulCalculatedLoadValue > _ulCountsPerTick ) )
+		{
+			ulCalculatedLoadValue = ( _ulCountsPerTick - 1UL );
+		}
+		SysTick->LOAD = ulCalculatedLoadValue;
+		ulCompleteTickPeriods = xExpectedIdleTime - 1UL;
+	}
+	else
+	{
+		//woken by something else; figure out how far we got
+		ulCompletedSysTickDecrements = ( xExpectedIdleTime * _ulCountsPerTick ) - SysTick->VAL;
+		ulCompleteTickPeriods = ulCompletedSysTickDecrements / _ulCountsPerTick;
+		SysTick->LOAD = ( ( ulCompleteTickPeriods + 1UL ) * _ulCountsPerTick ) - ulCompletedSysTickDecrements;
+	}
+
+	//restart SysTick so that it finishes off the current tick, then reload
+	//the normal period
+	SysTick->VAL = 0UL;
+	SysTick->CTRL |= SysTick_CTRL_ENABLE_Msk;
+	vTaskStepTick ( ulCompleteTickPeriods );
+	SysTick->LOAD = _ulCountsPerTick - 1UL;
+	_advanceHALTick ( ulCompleteTickPeriods );
+
+	++_stats._nSleeps;
+	_stats._msSleep += ulCompleteTickPeriods * portTICK_PERIOD_MS;
+
+	__enable_irq();
+}
+
+
+
+//==============================================================
+//STOP; all the 1.8V domain clocks stop.
+
+//whether it is currently OK to stop the clocks at all
+static int _canStop ( PersistentSettings* psettings, TickType_t xExpectedIdleTime )
+{
+	if ( LOWPOWER_STOP != psettings->_nLowPowerMode )
+		return 0;
+	if ( xExpectedIdleTime < LOWPOWER_MIN_STOP_TICKS )
+		return 0;	//not worth the restart time
+	if ( USBD_STATE_CONFIGURED == hUsbDeviceFS.dev_state )
+		return 0;	//host would see us vanish
+	if ( htim4.Instance->CR1 & TIM_CR1_CEN )
+		return 0;	//WSPR bit clock is running
+	if ( HAL_UART_STATE_READY != huart1.gState )
+		return 0;	//still sending to the GPS
+	if ( HAL_UART_STATE_READY != huart2.gState )
+		return 0;	//still sending to the monitor
+	if ( HAL_I2C_STATE_READY != hi2c1.State )
+		return 0;	//talking to the synthesizer
+	return 1;
+}
+
+
+static void _sleepStop ( TickType_t xExpectedIdleTime )
+{
+	if ( xExpectedIdleTime > LOWPOWER_MAX_STOP_TICKS )
+	{
+		xExpectedIdleTime = LOWPOWER_MAX_STOP_TICKS;
+	}
+
+	__disable_irq();
+	__DSB();
+	__ISB();
+
+	if ( eAbortSleep == eTaskConfirmSleepModeStatus() )
+	{
+		++_stats._nAborts;
+		__enable_irq();
+		return;
+	}
+
+	//when would we like to wake?  The alarm works in whole seconds, so we
+	//wake on the last second boundary before the expected idle time expires.
+	uint32_t nSec0, nFrac0;
+	_rtcReadTime ( &nSec0, &nFrac0 );
+	uint32_t nIdleFrac = (uint32_t) ( ( (uint64_t) xExpectedIdleTime * RTC_FRAC_HZ ) / configTICK_RATE_HZ );
+	uint32_t nWake = nSec0 + ( nFrac0 + nIdleFrac ) / RTC_FRAC_HZ;
+	if ( nWake == nSec0 )
+	{
+		//no second boundary in the period; just do a regular sleep
+		__enable_irq();
+		_sleepSysTick ( xExpectedIdleTime );
+		return;
+	}
+
+	//stop the tick sources; we will restart them fresh
+	SysTick->CTRL &= ~SysTick_CTRL_ENABLE_Msk;
+	HAL_SuspendTick();
+
+	//borrow the RTC alarm if our wakeup is sooner than the WSPR one
+	uint32_t nEXTI_IMR = EXTI->IMR;
+	uint32_t nEXTI_RTSR = EXTI->RTSR;
+	uint32_t nEXTI_FTSR = EXTI->FTSR;
+	int bWSPRAlarm = _bAlarmArmed && ( RTC->CRH & RTC_CRH_ALRIE );
+	int bBorrowed = ! bWSPRAlarm || ( nWake < _nAlarmCounter );
+	if ( bBorrowed )
+	{
+		_rtcWriteAlarm ( nWake );
+		__HAL_RTC_ALARM_EXTI_ENABLE_IT();
+		__HAL_RTC_ALARM_EXTI_ENABLE_RISING_EDGE();
+		__HAL_RTC_ALARM_ENABLE_IT ( &hrtc, RTC_IT_ALRA );
+	}
+
+	//GPS and monitor UART activity also wakes us
+	EXTI->PR = GPS_RX_Pin | MON_RX_Pin;
+	SET_BIT ( EXTI->FTSR, GPS_RX_Pin | MON_RX_Pin );
+	SET_BIT ( EXTI->IMR, GPS_RX_Pin | MON_RX_Pin );
+
+	HAL_PWR_EnterSTOPMode ( PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI );
+
+	_restoreClocks();
+	_rtcWaitSync();
+
+	//how long were we out?
+	uint32_t nSec1, nFrac1;
+	_rtcReadTime ( &nSec1, &nFrac1 );
+	int32_t nElapsedFrac = (int32_t) ( nSec1 - nSec0 ) * RTC_FRAC_HZ + (int32_t) ( nFrac1 - nFrac0 );
+	uint32_t ulCompleteTickPeriods = ( nElapsedFrac <= 0 ) ? 0 :
+			(uint32_t) ( ( (uint64_t) nElapsedFrac * configTICK_RATE_HZ ) / RTC_FRAC_HZ );
+	if ( ulCompleteTickPeriods > xExpectedIdleTime - 1UL )
+	{
+		ulCompleteTickPeriods = xExpectedIdleTime - 1UL;
+	}
+
+	//who woke us?
+	int bWakeUART = ( EXTI->PR & GPS_RX_Pin ) ? 1 : 0;
+	int bWakeUART2 = ( EXTI->PR & MON_RX_Pin ) ? 1 : 0;
+	int bWakeRTC = __HAL_RTC_ALARM_GET_FLAG ( &hrtc, RTC_FLAG_ALRAF ) ? 1 : 0;
+
+	//put back the UART wakeup
+	EXTI->IMR = nEXTI_IMR;
+	EXTI->FTSR = nEXTI_FTSR;
+	EXTI->PR = GPS_RX_Pin | MON_RX_Pin;
+	HAL_NVIC_ClearPendingIRQ ( EXTI15_10_IRQn );
+	HAL_NVIC_ClearPendingIRQ ( EXTI3_IRQn );
+
+	//put back the alarm
+	if ( bBorrowed )
+	{
+		if ( bWakeRTC && ( ! bWSPRAlarm || nSec1 < _nAlarmCounter ) )
+		{
+			//it was our alarm, not the WSPR one; swallow it
+			__HAL_RTC_ALARM_CLEAR_FLAG ( &hrtc, RTC_FLAG_ALRAF );
+			__HAL_RTC_ALARM_EXTI_CLEAR_FLAG();
+			HAL_NVIC_ClearPendingIRQ ( RTC_Alarm_IRQn );
+		}
+		if ( bWSPRAlarm )
+		{
+			_rtcWriteAlarm ( _nAlarmCounter );
+		}
+		else
+		{
+			__HAL_RTC_ALARM_DISABLE_IT ( &hrtc, RTC_IT_ALRA );
+			_rtcWriteAlarm ( RTC_ALARM_NEVER );
+		}
+		EXTI->IMR = nEXTI_IMR;
+		EXTI->RTSR = nEXTI_RTSR;
+	}
+
+	//restart the tick sources and account for the time
+	_restartSysTick();
+	vTaskStepTick ( ulCompleteTickPeriods );
+	_advanceHALTick ( ulCompleteTickPeriods );
+	HAL_ResumeTick();
+
+	++_stats._nStops;
+	_stats._msStop += ulCompleteTickPeriods * portTICK_PERIOD_MS;
+	if ( bWakeRTC )
+		++_stats._nWakeRTC;
+	if ( bWakeUART )
+		++_stats._nWakeUART;
+	if ( bWakeUART2 )
+		++_stats._nWakeUART2;
+
+	//any pending interrupts (e.g. the WSPR alarm) will now be serviced
+	__enable_irq();
+}
+
+
+
+//==============================================================
+//the FreeRTOS hook (overrides the weak one in port.c)
+
+void vPortSuppressTicksAndSleep ( TickType_t xExpectedIdleTime )
+{
+	if ( 0 == _ulCountsPerTick )	//not yet initialized
+		return;
+
+	PersistentSettings* psettings = Settings_getStruct();
+	if ( LOWPOWER_OFF == psettings->_nLowPowerMode )
+		return;
+
+	if ( _canStop ( psettings, xExpectedIdleTime ) )
+	{
+		_sleepStop ( xExpectedIdleTime );
+	}
+	else
+	{
+		_sleepSysTick ( xExpectedIdleTime );
+	}
+}
+
+
+
+//==============================================================
+//public API
+
+void LowPower_Init ( void )
+{
+	LowPower_resetStats();
+
+	//route EXTI line 10 to port A (the GPS UART RX pin), but leave it
+	//masked; it is only unmasked while we are in STOP.
+	__HAL_RCC_AFIO_CLK_ENABLE();
+	CLEAR_BIT ( AFIO->EXTICR[2], AFIO_EXTICR3_EXTI10 );
+	HAL_NVIC_SetPriority ( EXTI15_10_IRQn, 5, 0 );
+	HAL_NVIC_EnableIRQ ( EXTI15_10_IRQn );
+	//and likewise EXTI line 3 for the monitor UART RX pin
+	CLEAR_BIT ( AFIO->EXTICR[0], AFIO_EXTICR1_EXTI3 );
+	HAL_NVIC_SetPriority ( EXTI3_IRQn, 5, 0 );
+	HAL_NVIC_EnableIRQ ( EXTI3_IRQn );
+
+	//this is last, since it enables the hook
+	_xMaxSuppressedTicks = SysTick_LOAD_RELOAD_Msk / ( SystemCoreClock / configTICK_RATE_HZ );
+	_ulCountsPerTick = SystemCoreClock / configTICK_RATE_HZ;
+}
+
+
+void LowPower_getStats ( LowPowerStats* pstats )
+{
+	taskENTER_CRITICAL();
+	*pstats = _stats;
+	TickType_t tickNow = xTaskGetTickCount();
+	taskEXIT_CRITICAL();
+
+	pstats->_msTotal = ( tickNow - _tickStatsReset ) * portTICK_PERIOD_MS;
+	uint32_t msIdle = pstats->_msSleep + pstats->_msStop;
+	uint32_t msRun = ( pstats->_msTotal > msIdle ) ? pstats->_msTotal - msIdle : 0;
+	uint64_t nCharge = (uint64_t) msRun * LOWPOWER_RUN_UA +
+			(uint64_t) pstats->_msSleep * LOWPOWER_SLEEP_UA +
+			(uint64_t) pstats->_msStop * LOWPOWER_STOP_UA;
+	uint32_t msTotal = msRun + msIdle;
+	pstats->_nEstAvgUA = ( 0 == msTotal ) ? LOWPOWER_RUN_UA : (uint32_t) ( nCharge / msTotal );
+}
+
+
+void LowPower_resetStats ( void )
+{
+	taskENTER_CRITICAL();
+	memset ( &_stats, 0, sizeof(_stats) );
+	_tickStatsReset = xTaskGetTickCount();
+	taskEXIT_CRITICAL();
+}
@@ -0,0 +1,79 @@
+//==============================================================
+//This provides the low-power idle support (tickless idle, with CPU sleep or
+//STOP mode between events).
+//This module is part of the CarelessWSPR project.
+
+#ifndef __LOW_POWER_H
+#define __LOW_POWER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "stm32f1xx_hal.h"
+
+
+//the modes selectable via the persistent settings
+typedef enum LowPowerMode LowPowerMode;
+enum LowPowerMode
+{
+	LOWPOWER_OFF = 0,	//idle task simply spins (historical behaviour)
+	LOWPOWER_SLEEP = 1,	//tickless idle; CPU sleeps (WFI), clocks keep running
+	LOWPOWER_STOP = 2,	//as SLEEP, but use STOP mode when nothing needs clocks
+};
+
+
+//These are rough MCU-only supply current figures (typical, from the
+//STM32F103x8 datasheet), used to provide an estimated average current.  The
+//GPS module and synthesizer are not included; they will dominate the board's
+//consumption, so treat the estimate as being 'just the Blue Pill CPU'.
+#define LOWPOWER_RUN_UA		36000	//run at 72 MHz, peripherals enabled
+#define LOWPOWER_SLEEP_UA	14000	//sleep at 72 MHz, peripherals enabled
+#define LOWPOWER_STOP_UA	24		//STOP, regulator in low-power mode
+
+
+//the accounting of where the time went
+typedef struct LowPowerStats LowPowerStats;
+struct LowPowerStats
+{
+	uint32_t	_msTotal;		//ms elapsed since stats were last reset
+	uint32_t	_msSleep;		//ms spent in SLEEP
+	uint32_t	_msStop;		//ms spent in STOP
+	uint32_t	_nSleeps;		//number of times we entered SLEEP
+	uint32_t	_nStops;		//number of times we entered STOP
+	uint32_t	_nAborts;		//number of times entry was abandoned
+	uint32_t	_nWakeRTC;		//STOP wakeups caused by the RTC alarm
+	uint32_t	_nWakeUART;		//STOP wakeups caused by GPS UART activity
+	uint32_t	_nWakeUART2;	//STOP wakeups caused by monitor UART activity
+	uint32_t	_nEstAvgUA;		//estimated average MCU current; uA
+};
+
+
+//called once at startup (after the scheduler has started) to set up the
+//wakeup resources.
+void LowPower_Init ( void );
+
+//get a snapshot of the accounting; returns the computed totals
+void LowPower_getStats ( LowPowerStats* pstats );
+
+//clear the accounting
+void LowPower_resetStats ( void );
+
+//the WSPR scheduler tells us the time-of-day it set the RTC alarm for (or
+//NULL if it cancelled it), since we borrow the alarm while in STOP mode and
+//the alarm registers cannot be read back.
+void LowPower_noteAlarm ( const RTC_TimeTypeDef* ptime );
+
+
+//this is our implementation of the FreeRTOS tickless idle hook; see
+//FreeRTOSConfig.h
+//void vPortSuppressTicksAndSleep ( TickType_t xExpectedIdleTime );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -3,6 +3,8 @@
 
 #include "maidenhead.h"
 #include <math.h>
+#include <ctype.h>
+#include <string.h>
 
 
 //north latitude is positive, south is negative
@@ -73,3 +75,166 @@ int toMaidenhead ( float lat, float lon,
 }
 
 
+
+
+
+//====================================================
+//integer implementation
+
+//the latitude size of each successive pair of characters (field, square,
+//subsquare, extended square), in units of 1/240 micro-degree, which makes
+//them all integral.  Longitude sizes are exactly double these.
+static const int64_t _anLatCell240[4] =
+{
+	10LL * 1000000 * 240,	//10 deg
+	1LL * 1000000 * 240,	//1 deg
+	1LL * 1000000 * 10,		//1/24 deg (2.5')
+	1LL * 1000000,			//1/240 deg (15")
+};
+
+//the number of divisions of each of those
+static const int _anCellDivs[4] = { 18, 10, 24, 10 };
+
+
+int toMaidenheadMicro ( int32_t latMicro, int32_t lonMicro, 
+		char* achMaidenhead, unsigned int nDesiredLen )
+{
+	if ( nDesiredLen < 2 || nDesiredLen > 8 || nDesiredLen & 0x01 )
+	{
+		return 0;
+	}
+
+	//bounds check lon[-180, +180]
+	//bounds check lat[-90, +90]
+	if ( lonMicro < -180000000 || lonMicro > 180000000 )
+	{
+		return 0;
+	}
+	if ( latMicro < -90000000 || latMicro > 90000000 )
+	{
+		return 0;
+	}
+
+	//offset to be non-negative.  The extreme edges belong to the last cell.
+	uint32_t lonu = (uint32_t)( lonMicro + 180000000 );
+	uint32_t latu = (uint32_t)( latMicro + 90000000 );
+	if ( lonu >= 360000000 )
+		lonu = 360000000 - 1;
+	if ( latu >= 180000000 )
+		latu = 180000000 - 1;
+
+	//field; 18 zones of long of 20 deg; 18 zones of lat of 10 deg
+	achMaidenhead[0] = 'A' + lonu / 20000000;
+	achMaidenhead[1] = 'A' + latu / 10000000;
+	lonu %= 20000000;
+	latu %= 10000000;
+
+	//square; 10 x 10 of 2 deg long, 1 deg lat.  Each axis is divided by its
+	//own cell size (2000000 and 1000000 micro-degrees), and the remainders
+	//carry on to the subsquare.
+	if ( nDesiredLen >= 4 )
+	{
+		achMaidenhead[2] = '0' + lonu / 2000000;
+		achMaidenhead[3] = '0' + latu / 1000000;
+		lonu %= 2000000;
+		latu %= 1000000;
+	}
+
+	//subsquare; 24 x 24.  Scale the remainders up by 24 rather than divide
+	//the cell size down, so that everything stays integral.
+	if ( nDesiredLen >= 6 )
+	{
+		lonu *= 24;
+		latu *= 24;
+		achMaidenhead[4] = 'a' + lonu / 2000000;
+		achMaidenhead[5] = 'a' + latu / 1000000;
+		lonu %= 2000000;
+		latu %= 1000000;
+	}
+
+	//extended square; 10 x 10
+	if ( nDesiredLen >= 8 )
+	{
+		lonu *= 10;
+		latu *= 10;
+		achMaidenhead[6] = '0' + lonu / 2000000;
+		achMaidenhead[7] = '0' + latu / 1000000;
+	}
+
+	achMaidenhead[nDesiredLen] = '\0';
+
+	return 1;
+}
+
+
+int fromMaidenhead ( const char* pszMaidenhead, int32_t* platMicro, int32_t* plonMicro )
+{
+	size_t nLen = strlen ( pszMaidenhead );
+	if ( nLen < 2 || nLen > 8 || nLen & 0x01 )
+	{
+		return 0;
+	}
+
+	//accumulate the southwest corner, in 1/240 micro-degrees
+	int64_t lat240 = 0;
+	int64_t lon240 = 0;
+	unsigned int nPair;
+	for ( nPair = 0; nPair < nLen / 2; ++nPair )
+	{
+		int chLon = pszMaidenhead[nPair*2];
+		int chLat = pszMaidenhead[nPair*2+1];
+		int nLon, nLat;
+		if ( nPair & 0x01 )	//digits
+		{
+			if ( ! isdigit ( chLon ) || ! isdigit ( chLat ) )
+				return 0;
+			nLon = chLon - '0';
+			nLat = chLat - '0';
+		}
+		else	//letters
+		{
+			if ( ! isalpha ( chLon ) || ! isalpha ( chLat ) )
+				return 0;
+			nLon = toupper ( chLon ) - 'A';
+			nLat = toupper ( chLat ) - 'A';
+		}
+		if ( nLon >= _anCellDivs[nPair] || nLat >= _anCellDivs[nPair] )
+			return 0;
+		lat240 += nLat * _anLatCell240[nPair];
+		lon240 += nLon * _anLatCell240[nPair] * 2;
+	}
+
+	//move to the center of the last cell
+	lat240 += _anLatCell240[nPair-1] / 2;
+	lon240 += _anLatCell240[nPair-1];
+
+	//back to micro-degrees (rounded), and un-offset
+	*platMicro = (int32_t)( ( lat240 + 120 ) / 240 ) - 90000000;
+	*plonMicro = (int32_t)( ( lon240 + 120 ) / 240 ) - 180000000;
+
+	return 1;
+}
+
+
+int inMaidenhead ( const char* pszMaidenhead, int32_t latMicro, int32_t lonMicro, int32_t nMarginMicro )
+{
+	int32_t latCenter, lonCenter;
+	if ( ! fromMaidenhead ( pszMaidenhead, &latCenter, &lonCenter ) )
+	{
+		return 0;
+	}
+
+	//half the cell size, in micro-degrees (rounded up, so that the cell's
+	//own edges are always 'inside')
+	size_t nPair = strlen ( pszMaidenhead ) / 2;
+	int32_t nHalfLat = (int32_t)( ( _anLatCell240[nPair-1] / 2 + 239 ) / 240 );
+
+	int32_t dLat = latMicro - latCenter;
+	int32_t dLon = lonMicro - lonCenter;
+	if ( dLat < 0 )
+		dLat = -dLat;
+	if ( dLon < 0 )
+		dLon = -dLon;
+	return dLat <= nHalfLat + nMarginMicro &&
+			dLon <= 2 * ( nHalfLat + nMarginMicro );
+}
@@ -8,6 +8,8 @@
 extern "C" {
 #endif
 
+#include <stdint.h>
+
 
 //north latitude is positive, south is negative
 //east longitude is positive, west is negative
@@ -17,6 +19,24 @@ extern "C" {
 int toMaidenhead ( float lat, float lon, char* achMaidenhead, unsigned int nDesiredLen );
 
 
+//as above, but in integer micro-degrees (i.e. degrees * 1000000), which avoids
+//the soft-float library.  Locators are computed exactly.  The length must be
+//2, 4, 6, or 8.  The north pole and antimeridian are put into the last field
+//(rather than one past it).
+int toMaidenheadMicro ( int32_t latMicro, int32_t lonMicro, char* achMaidenhead, unsigned int nDesiredLen );
+
+//convert a 2, 4, 6, or 8 character locator to the coordinates of its center
+//in micro-degrees; case-insensitive.
+//returns 0 on failure (e.g. malformed locator)
+int fromMaidenhead ( const char* pszMaidenhead, int32_t* platMicro, int32_t* plonMicro );
+
+//is the position within the locator's cell, expanded on all sides by a margin
+//(given in latitude micro-degrees; the longitude margin is double that, to
+//match the cell's aspect).  This is useful for hysteresis when tracking.
+//returns 0 if outside, or if the locator is malformed
+int inMaidenhead ( const char* pszMaidenhead, int32_t latMicro, int32_t lonMicro, int32_t nMarginMicro );
+
+
 #ifdef __cplusplus
 }
 #endif
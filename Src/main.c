@@ -45,6 +45,7 @@
 #include "wspr.h"
 
 #include "backup_registers.h"
+#include "low_power.h"
 
 
 #ifndef COUNTOF
@@ -59,14 +60,12 @@ volatile int dummy;	//XXX for debugging; delete
 #ifdef DEBUG
 volatile size_t g_nHeapFree;
 volatile size_t g_nMinEverHeapFree;
-volatile int g_nMaxGPSRxQueue;
-volatile int g_nMaxCDCTxQueue;
-volatile int g_nMaxCDCRxQueue;
+#endif
+//(the stack watermarks are kept in all builds; 'iostat' shows them)
 volatile int g_nMinStackFreeDefault;
 volatile int g_nMinStackFreeMonitor;
 volatile int g_nMinStackFreeGPS;
 volatile int g_nMinStackFreeWSPR;
-#endif
 
 #if USE_FREERTOS_HEAP_IMPL
 
@@ -125,6 +124,11 @@ RTC_HandleTypeDef hrtc;
 TIM_HandleTypeDef htim4;
 
 UART_HandleTypeDef huart1;
+UART_HandleTypeDef huart2;
+DMA_HandleTypeDef hdma_usart1_rx;
+DMA_HandleTypeDef hdma_usart1_tx;
+DMA_HandleTypeDef hdma_usart2_rx;
+DMA_HandleTypeDef hdma_usart2_tx;
 
 osThreadId defaultTaskHandle;
 uint32_t defaultTaskBuffer[ 128 ];
@@ -136,9 +140,11 @@ osStaticThreadDef_t defaultTaskControlBlock;
 /* Private function prototypes -----------------------------------------------*/
 void SystemClock_Config(void);
 static void MX_GPIO_Init(void);
+static void MX_DMA_Init(void);
 static void MX_RTC_Init(void);
 static void MX_I2C1_Init(void);
 static void MX_USART1_UART_Init(void);
+static void MX_USART2_UART_Init(void);
 static void MX_TIM4_Init(void);
 void StartDefaultTask(void const * argument);
 
@@ -205,10 +211,12 @@ int main(void)
 
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
+  MX_DMA_Init();
   MX_RTC_Init();
   MX_I2C1_Init();
   MX_USART1_UART_Init();
   MX_TIM4_Init();
+  MX_USART2_UART_Init();
   /* USER CODE BEGIN 2 */
 
   /* USER CODE END 2 */
@@ -488,6 +496,64 @@ static void MX_USART1_UART_Init(void)
 
 }
 
+/**
+  * @brief USART2 Initialization Function
+  * @param None
+  * @retval None
+  */
+static void MX_USART2_UART_Init(void)
+{
+
+  /* USER CODE BEGIN USART2_Init 0 */
+
+  /* USER CODE END USART2_Init 0 */
+
+  /* USER CODE BEGIN USART2_Init 1 */
+
+  /* USER CODE END USART2_Init 1 */
+  huart2.Instance = USART2;
+  huart2.Init.BaudRate = 115200;
+  huart2.Init.WordLength = UART_WORDLENGTH_8B;
+  huart2.Init.StopBits = UART_STOPBITS_1;
+  huart2.Init.Parity = UART_PARITY_NONE;
+  huart2.Init.Mode = UART_MODE_TX_RX;
+  huart2.Init.HwFlowCtl = UART_HWCONTROL_NONE;
+  huart2.Init.OverSampling = UART_OVERSAMPLING_16;
+  if (HAL_UART_Init(&huart2) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  /* USER CODE BEGIN USART2_Init 2 */
+
+  /* USER CODE END USART2_Init 2 */
+
+}
+
+/** 
+  * Enable DMA controller clock
+  */
+static void MX_DMA_Init(void) 
+{
+
+  /* DMA controller clock enable */
+  __HAL_RCC_DMA1_CLK_ENABLE();
+
+  /* DMA interrupt init */
+  /* DMA1_Channel4_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Channel4_IRQn, 5, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel4_IRQn);
+  /* DMA1_Channel5_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Channel5_IRQn, 5, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel5_IRQn);
+  /* DMA1_Channel6_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Channel6_IRQn, 5, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel6_IRQn);
+  /* DMA1_Channel7_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Channel7_IRQn, 5, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel7_IRQn);
+
+}
+
 /**
   * @brief GPIO Initialization Function
   * @param None
@@ -513,12 +579,10 @@ static void MX_GPIO_Init(void)
   GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
   HAL_GPIO_Init(LED2_GPIO_Port, &GPIO_InitStruct);
 
-  /*Configure GPIO pins : PA0 PA1 PA2 PA3 
-                           PA4 PA5 PA6 PA7 
-                           PA8 PA15 */
-  GPIO_InitStruct.Pin = GPIO_PIN_0|GPIO_PIN_1|GPIO_PIN_2|GPIO_PIN_3 
-                          |GPIO_PIN_4|GPIO_PIN_5|GPIO_PIN_6|GPIO_PIN_7 
-                          |GPIO_PIN_8|GPIO_PIN_15;
+  /*Configure GPIO pins : PA0 PA1 PA4 PA5 
+                           PA6 PA7 PA8 PA15 */
+  GPIO_InitStruct.Pin = GPIO_PIN_0|GPIO_PIN_1|GPIO_PIN_4|GPIO_PIN_5 
+                          |GPIO_PIN_6|GPIO_PIN_7|GPIO_PIN_8|GPIO_PIN_15;
   GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
   HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
 
@@ -655,15 +719,19 @@ void StartDefaultTask(void const * argument)
 	//initialize the WSPR engine
 	WSPR_Initialize();
 
+	//set up the low-power idle support (it does nothing unless enabled)
+	LowPower_Init();
+
 	//crank up serial ports
 	//XXX (I wonder if this is best way up in main at least for USB; I ask
 	//because the MX_USB_DEVICE_Init() above could conceivably stimulate
 	//action on these buffers before they have been initialized
 	UART1_Init();	//UART1 == GPS
 	USBCDC_Init();	//CDC == monitor
+	UART2_Init();	//UART2 == monitor, too, for headless units
 
 	//bind the interfaces to the relevant devices
-	g_pMonitorIOIf = &g_pifCDC;		//monitor is on USB CDC
+	Monitor_setPorts ( Settings_getStruct()->_nMonitorPorts );	//monitor is on USB CDC and/or UART2
 	g_pGPSIOIf = &g_pifUART1;		//GPS is on UART1
 	//light some lamps on a countdown
 	LightLamp ( 1000, &g_lltGn, _ledOnGn );
@@ -710,16 +778,13 @@ void StartDefaultTask(void const * argument)
 #else
 		g_nMinEverHeapFree = (char*)platform_get_last_free_ram( 0 ) - (char*)platform_get_first_free_ram( 0 );
 #endif
-		g_nMaxGPSRxQueue = UART1_rxbuff_max();
-		g_nMaxCDCTxQueue = CDC_txbuff_max();
-		g_nMaxCDCRxQueue = CDC_rxbuff_max();
+#endif
 		//free stack space measurements
 		g_nMinStackFreeDefault = uxTaskGetStackHighWaterMark ( defaultTaskHandle );
 		g_nMinStackFreeMonitor = uxTaskGetStackHighWaterMark ( g_thMonitor );
 		g_nMinStackFreeGPS = uxTaskGetStackHighWaterMark ( g_thGPS );
 		g_nMinStackFreeWSPR = uxTaskGetStackHighWaterMark ( g_thWSPR );
 		//XXX others
-#endif
 		
 		//turn out the lights, the party's over
 		uint32_t now = HAL_GetTick();
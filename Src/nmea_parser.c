@@ -0,0 +1,239 @@
+//==============================================================
+//This provides a streaming NMEA 0183 sentence parser.
+//This module is part of the CarelessWSPR project.
+//impl
+
+#include "nmea_parser.h"
+
+#include <string.h>
+
+
+
+typedef enum NMEAState NMEAState;
+enum NMEAState
+{
+	NMEA_HUNT = 0,	//looking for the '$' that starts a sentence
+	NMEA_ADDR,		//accumulating the address field
+	NMEA_FIELDS,	//accumulating the data fields
+	NMEA_CKSUM1,	//expecting the first checksum hex digit
+	NMEA_CKSUM2,	//expecting the second checksum hex digit
+};
+
+
+
+//find a sentence definition whose sentence id starts with what we have so far
+//(the table is small, so this is a simple scan)
+static const NMEASentenceDef* _findDef ( const NMEAParser* pthis )
+{
+	size_t nIdx;
+	for ( nIdx = 0; nIdx < pthis->_nDefs; ++nIdx )
+	{
+		if ( 0 == strncmp ( pthis->_asDefs[nIdx]._pszSentence, 
+				&pthis->_achField[NMEA_TALKER_LEN], 
+				pthis->_nFieldLen - NMEA_TALKER_LEN ) )
+		{
+			return &pthis->_asDefs[nIdx];
+		}
+	}
+	return NULL;
+}
+
+
+//deliver the current field to the handler, and prepare for the next one
+static void _endField ( NMEAParser* pthis )
+{
+	pthis->_achField[pthis->_nFieldLen] = '\0';
+	pthis->_pDef->_pfnField ( pthis, pthis->_nField, pthis->_achField, pthis->_nFieldLen );
+	++pthis->_nField;
+	pthis->_nFieldLen = 0;
+}
+
+
+
+//value of a hex digit, or -1 if it isn't one
+static int _hexValue ( char ch )
+{
+	if ( ch >= '0' && ch <= '9' )
+		return ch - '0';
+	if ( ch >= 'A' && ch <= 'F' )
+		return ch - 'A' + 10;
+	if ( ch >= 'a' && ch <= 'f' )
+		return ch - 'a' + 10;
+	return -1;
+}
+
+
+//give up on the current sentence; if it was one we were interested in then
+//it counts as bad
+static void _abandon ( NMEAParser* pthis )
+{
+	if ( NMEA_ADDR != pthis->_eState && NMEA_HUNT != pthis->_eState )
+	{
+		++pthis->_pDef->_pstats->_nBad;
+	}
+	pthis->_eState = NMEA_HUNT;
+}
+
+
+void NMEA_init ( NMEAParser* pthis, const NMEASentenceDef* asDefs, size_t nDefs, void* pvUser )
+{
+	memset ( pthis, 0, sizeof(*pthis) );
+	pthis->_asDefs = asDefs;
+	pthis->_nDefs = nDefs;
+	pthis->_pvUser = pvUser;
+	pthis->_eState = NMEA_HUNT;
+}
+
+
+void NMEA_feed ( NMEAParser* pthis, const uint8_t* pby, size_t nLen )
+{
+	while ( nLen-- )
+	{
+		char ch = (char) *pby++;
+
+		//a '$' always starts a new sentence, whatever we were doing; this is
+		//how we resync after line noise
+		if ( '$' == ch )
+		{
+			_abandon ( pthis );	//(if we were in the middle of one)
+			pthis->_eState = NMEA_ADDR;
+			pthis->_pDef = NULL;
+			pthis->_nSentenceLen = 1;
+			pthis->_nField = 0;
+			pthis->_nFieldLen = 0;
+			pthis->_byChecksum = 0;
+			continue;
+		}
+
+		if ( NMEA_HUNT == pthis->_eState )
+		{
+			continue;	//skipping; the most common case
+		}
+
+		//runaway sentence (e.g. we lost the line end)?
+		if ( ++pthis->_nSentenceLen > NMEA_MAX_SENTENCE )
+		{
+			_abandon ( pthis );
+			continue;
+		}
+
+		//everything between the '$' and the '*' is checksummed
+		if ( NMEA_ADDR == pthis->_eState || NMEA_FIELDS == pthis->_eState )
+		{
+			pthis->_byChecksum ^= (uint8_t) ch;
+		}
+
+		switch ( pthis->_eState )
+		{
+		case NMEA_ADDR:
+			if ( ',' == ch )
+			{
+				//the address is complete; it must be an exact match
+				if ( NULL != pthis->_pDef && pthis->_nFieldLen > NMEA_TALKER_LEN &&
+						'\0' == pthis->_pDef->_pszSentence[pthis->_nFieldLen - NMEA_TALKER_LEN] )
+				{
+					_endField ( pthis );
+					pthis->_eState = NMEA_FIELDS;
+				}
+				else
+				{
+					pthis->_eState = NMEA_HUNT;
+				}
+			}
+			else if ( pthis->_nFieldLen >= NMEA_MAX_FIELD )
+			{
+				_abandon ( pthis );
+			}
+			else if ( pthis->_nFieldLen < NMEA_TALKER_LEN )
+			{
+				//the talker (GP, GN, GL, GA, BD, ...) can be anything, but
+				//it's always letters.  (This also skips the proprietary
+				//'$Pxxx' sentences, since we never match their ids.)
+				if ( ch < 'A' || ch > 'Z' )
+				{
+					pthis->_eState = NMEA_HUNT;
+				}
+				pthis->_achField[pthis->_nFieldLen++] = ch;
+			}
+			else
+			{
+				//narrow down the candidates as each sentence id char arrives;
+				//once there are none, we can skip the rest of the sentence.
+				//Usually that's on the first one (i.e. the third address byte).
+				pthis->_achField[pthis->_nFieldLen++] = ch;
+				if ( NULL == pthis->_pDef ||
+						pthis->_pDef->_pszSentence[pthis->_nFieldLen - NMEA_TALKER_LEN - 1] != ch )
+				{
+					pthis->_pDef = _findDef ( pthis );
+					if ( NULL == pthis->_pDef )
+					{
+						pthis->_eState = NMEA_HUNT;
+					}
+				}
+			}
+		break;
+
+		case NMEA_FIELDS:
+			if ( ',' == ch )
+			{
+				_endField ( pthis );
+			}
+			else if ( '*' == ch )
+			{
+				//end of data; the checksum follows.  (The '*' itself is
+				//not part of the checksum, so undo that.)
+				pthis->_byChecksum ^= (uint8_t) ch;
+				_endField ( pthis );
+				pthis->_eState = NMEA_CKSUM1;
+			}
+			else if ( '\r' == ch || '\n' == ch )
+			{
+				_abandon ( pthis );	//no checksum; we require one
+			}
+			else if ( pthis->_nFieldLen >= NMEA_MAX_FIELD )
+			{
+				_abandon ( pthis );	//too long; can't be right
+			}
+			else
+			{
+				pthis->_achField[pthis->_nFieldLen++] = ch;
+			}
+		break;
+
+		case NMEA_CKSUM1:
+		{
+			int nVal = _hexValue ( ch );
+			if ( nVal < 0 )
+			{
+				_abandon ( pthis );
+			}
+			else
+			{
+				pthis->_byChecksumRx = (uint8_t) ( nVal << 4 );
+				pthis->_eState = NMEA_CKSUM2;
+			}
+		}
+		break;
+
+		case NMEA_CKSUM2:
+		{
+			int nVal = _hexValue ( ch );
+			if ( nVal < 0 || ( pthis->_byChecksumRx | nVal ) != pthis->_byChecksum )
+			{
+				_abandon ( pthis );
+			}
+			else
+			{
+				++pthis->_pDef->_pstats->_nGood;
+				pthis->_eState = NMEA_HUNT;
+				pthis->_pDef->_pfnCommit ( pthis );
+			}
+		}
+		break;
+
+		default:
+			pthis->_eState = NMEA_HUNT;
+		break;
+		}
+	}
+}
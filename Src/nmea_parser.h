@@ -0,0 +1,102 @@
+//==============================================================
+//This provides a streaming NMEA 0183 sentence parser.
+//This module is part of the CarelessWSPR project.
+//
+//Bytes are fed in as they arrive (in whatever size chunks are convenient),
+//and the parser calls back per-field as each field completes.  The sentence
+//type is recognized from the address field as it arrives, and sentences that
+//nobody is interested in are skipped without being buffered at all.  Only the
+//current field is buffered (and it is small).
+//
+//The client provides a table of the sentences of interest, keyed by sentence
+//id (e.g. "RMC"); the talker (e.g. "GP", "GN") can be anything, so multi-
+//constellation receivers work too.  For each, the field handler is called
+//with the field index and text (field 0 being the whole address, e.g.
+//"GNRMC"), and the commit handler is called when the sentence has completed.
+//The client is expected to stage the field values as they arrive, and only
+//make them 'live' upon commit.  If the sentence is
+//abandoned (e.g. it was malformed) then the commit handler is not called, and
+//the next field 0 tells the client to discard what was staged.
+//
+//The '*hh' checksum is accumulated as the bytes stream in, and a sentence is
+//only committed if it is present and correct.  Good and bad sentences of each
+//type of interest are counted.
+
+#ifndef __NMEA_PARSER_H
+#define __NMEA_PARSER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+//the longest field we will buffer; longer fields abandon the sentence.
+//(the longest we care about is a lat/lon like "12311.123456")
+#define NMEA_MAX_FIELD	15
+//the abs max sentence length, including the '$', but not the CR LF
+#define NMEA_MAX_SENTENCE	82
+//the address field is a two char talker id followed by the sentence id
+#define NMEA_TALKER_LEN	2
+
+
+typedef struct NMEAParser NMEAParser;
+
+
+//the statistics for a sentence type
+typedef struct NMEASentenceStats NMEASentenceStats;
+struct NMEASentenceStats
+{
+	uint32_t _nGood;	//committed
+	uint32_t _nBad;		//bad checksum, missing checksum, or malformed
+};
+
+
+//the definition of a sentence of interest
+typedef struct NMEASentenceDef NMEASentenceDef;
+struct NMEASentenceDef
+{
+	const char* _pszSentence;	//the sentence id (without talker); e.g. "RMC"
+	//called as each field completes; field 0 is the address
+	void (* _pfnField) ( NMEAParser* pthis, int nField, const char* pszField, int nLen );
+	//called when the sentence has completed successfully
+	void (* _pfnCommit) ( NMEAParser* pthis );
+	//where to count the good and bad ones (in RAM, of course)
+	NMEASentenceStats* _pstats;
+};
+
+
+//parser state
+struct NMEAParser
+{
+	//configuration
+	const NMEASentenceDef* _asDefs;	//the table of sentences of interest
+	size_t _nDefs;
+	void* _pvUser;	//for the client's use
+
+	//state
+	int _eState;		//(internal) NMEAState
+	const NMEASentenceDef* _pDef;	//the sentence being parsed
+	int _nSentenceLen;	//characters so far, to detect runaway sentences
+	int _nField;		//current field index
+	int _nFieldLen;		//characters in current field
+	uint8_t _byChecksum;	//running xor of the chars between '$' and '*'
+	uint8_t _byChecksumRx;	//the checksum received after the '*'
+	char _achField[NMEA_MAX_FIELD+1];	//current field text
+};
+
+
+//initialize a parser to use a table of sentences
+void NMEA_init ( NMEAParser* pthis, const NMEASentenceDef* asDefs, size_t nDefs, void* pvUser );
+
+//feed bytes to the parser; callbacks will happen on this thread
+void NMEA_feed ( NMEAParser* pthis, const uint8_t* pby, size_t nLen );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,97 @@
+//==============================================================
+//This configures the sizes of the serial devices' buffers.
+//This module is part of the CarelessWSPR project.
+//
+//Pick a profile by defining SERIAL_PROFILE in the build (e.g.
+//-DSERIAL_PROFILE=SERIAL_PROFILE_LEAN); the default is the standard one.  Any
+//single size can also be overridden by defining it in the build.
+//
+//All the sizes MUST be powers of 2 (the queues mask their indices), and at
+//least 4 (so the queue structs have no padding); this is checked at compile
+//time in serial_devices.c.  The RAM committed to serial I/O is reported by
+//the 'iostat' command.
+
+#ifndef __SERIAL_CONFIG_H
+#define __SERIAL_CONFIG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+
+//the profiles
+#define SERIAL_PROFILE_STANDARD		0	//what we normally ship
+#define SERIAL_PROFILE_LEAN			1	//smallest that still works well
+#define SERIAL_PROFILE_GPS_BURST	2	//for chatty receivers at high bit rates
+
+#ifndef SERIAL_PROFILE
+#define SERIAL_PROFILE	SERIAL_PROFILE_STANDARD
+#endif
+
+
+//The UART1 (GPS) transmit queue only carries the occasional UBX
+//configuration message, and the sender blocks until it's all gone, so it can
+//be small.  The receive DMA buffer needs to hold a couple of bursts' worth,
+//since we are only told at half-full, full, and line idle.  The USB CDC
+//receive queue needs to be at least a packet (64 bytes); more than two lets
+//us keep receiving into it in place while the reader works.  The UART2
+//(monitor) transmit queue carries the command responses, and the receive
+//DMA buffer only has to hold what is typed (or pasted) between reads.
+#if SERIAL_PROFILE == SERIAL_PROFILE_STANDARD
+#define SERIAL_PROFILE_UART1_TX		32
+#define SERIAL_PROFILE_UART1_RX		256
+#define SERIAL_PROFILE_CDC_TX		128
+#define SERIAL_PROFILE_CDC_RX		128
+#define SERIAL_PROFILE_UART2_TX		128
+#define SERIAL_PROFILE_UART2_RX		64
+#elif SERIAL_PROFILE == SERIAL_PROFILE_LEAN
+#define SERIAL_PROFILE_UART1_TX		16
+#define SERIAL_PROFILE_UART1_RX		128
+#define SERIAL_PROFILE_CDC_TX		64
+#define SERIAL_PROFILE_CDC_RX		128
+#define SERIAL_PROFILE_UART2_TX		64
+#define SERIAL_PROFILE_UART2_RX		32
+#elif SERIAL_PROFILE == SERIAL_PROFILE_GPS_BURST
+#define SERIAL_PROFILE_UART1_TX		32
+#define SERIAL_PROFILE_UART1_RX		512
+#define SERIAL_PROFILE_CDC_TX		128
+#define SERIAL_PROFILE_CDC_RX		128
+#define SERIAL_PROFILE_UART2_TX		128
+#define SERIAL_PROFILE_UART2_RX		64
+#else
+#error unknown SERIAL_PROFILE
+#endif
+
+
+//the sizes actually used (overrides win)
+#ifndef SERIAL_UART1_TX_SIZE
+#define SERIAL_UART1_TX_SIZE	SERIAL_PROFILE_UART1_TX
+#endif
+#ifndef SERIAL_UART1_RX_SIZE
+#define SERIAL_UART1_RX_SIZE	SERIAL_PROFILE_UART1_RX
+#endif
+#ifndef SERIAL_CDC_TX_SIZE
+#define SERIAL_CDC_TX_SIZE		SERIAL_PROFILE_CDC_TX
+#endif
+#ifndef SERIAL_CDC_RX_SIZE
+#define SERIAL_CDC_RX_SIZE		SERIAL_PROFILE_CDC_RX
+#endif
+#ifndef SERIAL_UART2_TX_SIZE
+#define SERIAL_UART2_TX_SIZE	SERIAL_PROFILE_UART2_TX
+#endif
+#ifndef SERIAL_UART2_RX_SIZE
+#define SERIAL_UART2_RX_SIZE	SERIAL_PROFILE_UART2_RX
+#endif
+
+
+//is it a power of 2 (and not zero)
+#define SERIAL_IS_POW2(n)	( 0 != (n) && 0 == ( (n) & ( (n) - 1 ) ) )
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -15,8 +15,29 @@
 #include "usbd_cdc_if.h"
 
 #include "lamps.h"
+#include "task_notification_bits.h"
 
-#include "util_circbuff2.h"
+#include "serial_config.h"
+#include "util_spscbuff.h"
+
+#include <string.h>
+
+
+
+//the sizes are configured in serial_config.h; check them here, where they
+//are used
+_Static_assert ( SERIAL_IS_POW2(SERIAL_UART1_TX_SIZE) && SERIAL_UART1_TX_SIZE >= 4,
+		"SERIAL_UART1_TX_SIZE must be a power of 2, at least 4" );
+_Static_assert ( SERIAL_IS_POW2(SERIAL_UART1_RX_SIZE) && SERIAL_UART1_RX_SIZE >= 4,
+		"SERIAL_UART1_RX_SIZE must be a power of 2, at least 4" );
+_Static_assert ( SERIAL_IS_POW2(SERIAL_CDC_TX_SIZE) && SERIAL_CDC_TX_SIZE >= 4,
+		"SERIAL_CDC_TX_SIZE must be a power of 2, at least 4" );
+_Static_assert ( SERIAL_IS_POW2(SERIAL_CDC_RX_SIZE) && SERIAL_CDC_RX_SIZE >= CDC_DATA_FS_MAX_PACKET_SIZE,
+		"SERIAL_CDC_RX_SIZE must be a power of 2, at least a USB packet" );
+_Static_assert ( SERIAL_IS_POW2(SERIAL_UART2_TX_SIZE) && SERIAL_UART2_TX_SIZE >= 4,
+		"SERIAL_UART2_TX_SIZE must be a power of 2, at least 4" );
+_Static_assert ( SERIAL_IS_POW2(SERIAL_UART2_RX_SIZE) && SERIAL_UART2_RX_SIZE >= 4,
+		"SERIAL_UART2_RX_SIZE must be a power of 2, at least 4" );
 
 
 
@@ -25,48 +46,88 @@
 //will be in an eternal struggle of light against darkness. So we go to the
 //dark side and leave them there.
 extern UART_HandleTypeDef huart1;
+extern DMA_HandleTypeDef hdma_usart1_rx;
+extern DMA_HandleTypeDef hdma_usart1_tx;
+extern UART_HandleTypeDef huart2;
+extern DMA_HandleTypeDef hdma_usart2_rx;
+extern DMA_HandleTypeDef hdma_usart2_tx;
 //NOTE there is not handle-y thing for the CDC for us (well, sort of, there is
 //an object buried in the 'middleware', but we don't need it.)
 
 
-//UART transmit/receive circular buffers
-CIRCBUF(UART1_txbuff,uint8_t,128);
-CIRCBUF(UART1_rxbuff,uint8_t,128);
+//UART transmit circular buffer.  The queues are all single-producer/single-
+//consumer (a task on one side, an ISR on the other), so they are lock-free.
+//This one is the type-specialized inline flavor.
+//Transmit is by DMA straight out of the queue, a contiguous span at a time;
+//the span stays in the queue until the DMA is done with it.
+SPSCBUF_SIMPLE(UART1_txq,uint8_t,SERIAL_UART1_TX_SIZE)
+static volatile size_t _nTxInFlightUART1;	//what the DMA is sending
+
+//UART receive is by circular DMA straight into this buffer; we are told at
+//half-full, full, and when the line goes idle (i.e. at the end of a burst), so
+//this must hold at least a couple bursts' worth.  (At 9600 bps, that's about
+//100 ms per half.)  The DMA is the producer, and the reader just chases the
+//DMA's write position, so no locking is needed.
+#define UART1_RXDMA_SIZE	SERIAL_UART1_RX_SIZE
+static uint8_t _abyRxDMAUART1[UART1_RXDMA_SIZE];
+static volatile size_t _nRxRdIdxUART1;	//where the reader is
+//an error restarts the receive DMA at ISR time, and moves the reader back to
+//the top; this counts those, so that a reader that was in the middle of a
+//read when it happened doesn't put back its stale position.
+static volatile uint32_t _nRxGenUART1;
 
 //USB CDC transmit/receive circular buffers
-CIRCBUF(CDC_txbuff,uint8_t,128);
-CIRCBUF(CDC_rxbuff,uint8_t,128);
+SPSCBUF(CDC_txbuff,SERIAL_CDC_TX_SIZE);
+SPSCBUF(CDC_rxbuff,SERIAL_CDC_RX_SIZE);
+//the USB transmits straight out of CDC_txbuff; this is how much of the front
+//of it is in flight (and so must stay put until the completion)
+static volatile size_t _nTxInFlightCDC;
+//and receive is straight into CDC_rxbuff, when a packet will fit contiguously
+static volatile int _bRxInPlaceCDC;	//the armed receive is into the queue
+static volatile int _bRxNAKingCDC;	//no room; the USB is holding off the host
 
+//UART2 (the headless monitor port) works just like UART1
+SPSCBUF_SIMPLE(UART2_txq,uint8_t,SERIAL_UART2_TX_SIZE)
+static volatile size_t _nTxInFlightUART2;	//what the DMA is sending
+#define UART2_RXDMA_SIZE	SERIAL_UART2_RX_SIZE
+static uint8_t _abyRxDMAUART2[UART2_RXDMA_SIZE];
+static volatile size_t _nRxRdIdxUART2;	//where the reader is
+static volatile uint32_t _nRxGenUART2;	//(as for UART1)
 
 
 
 
-//these are debug methods for tuning buffer sizes
-#ifdef DEBUG
 
-unsigned int UART1_txbuff_max ( void )
-{
-	return circbuff_max ( &UART1_txbuff );
-}
+//I/O statistics; these are kept in all builds.  (The queue high-water marks
+//are kept by the queues themselves, except for the UART1 receive DMA buffer.)
+static IOStreamStats _statsUART1;
+static IOStreamStats _statsCDC;
+static IOStreamStats _statsUART2;
 
-unsigned int UART1_rxbuff_max ( void )
-{
-	return circbuff_max ( &UART1_rxbuff );
-}
 
+//The few critical sections left are timed with the DWT cycle counter (which
+//main() starts), so we can see the worst interrupt latency we impose.
+typedef struct CritSect CritSect;
+struct CritSect
+{
+	UBaseType_t _uxSavedInterruptStatus;
+	uint32_t _nCycStart;
+};
 
-unsigned int CDC_txbuff_max ( void )
+static inline void _critEnter ( CritSect* pcs )
 {
-	return circbuff_max ( &CDC_txbuff );
+	pcs->_uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();
+	pcs->_nCycStart = DWT->CYCCNT;
 }
 
-unsigned int CDC_rxbuff_max ( void )
+static inline void _critExit ( CritSect* pcs, IOStreamStats* pstats )
 {
-	return circbuff_max ( &CDC_rxbuff );
+	uint32_t nCycles = DWT->CYCCNT - pcs->_nCycStart;
+	if ( nCycles > pstats->_nCritMaxCycles )
+		pstats->_nCritMaxCycles = nCycles;
+	taskEXIT_CRITICAL_FROM_ISR(pcs->_uxSavedInterruptStatus);
 }
 
-#endif
-
 
 //========================================================================
 
@@ -88,6 +149,14 @@ static size_t USBCDC_transmit ( const IOStreamIF* pthis, const void* pv, size_t
 static size_t USBCDC_receive ( const IOStreamIF* pthis, void* pv, const size_t nLen );
 
 
+static void UART2_flushTtransmit ( const IOStreamIF* pthis );
+static size_t UART2_transmitFree ( const IOStreamIF* pthis );
+static size_t UART2_transmit ( const IOStreamIF* pthis, const void* pv, size_t nLen );
+static void UART2_flushReceive ( const IOStreamIF* pthis );
+static size_t UART2_receiveAvailable ( const IOStreamIF* pthis );
+static size_t UART2_receive ( const IOStreamIF* pthis, void* pv, const size_t nLen );
+
+
 static int Serial_transmitCompletely ( const IOStreamIF* pcom, const void* pv, size_t nLen, uint32_t to );
 static int Serial_receiveCompletely ( const IOStreamIF* pcom, void* pv, const size_t nLen, uint32_t to );
 
@@ -118,40 +187,132 @@ const IOStreamIF g_pifCDC = {
 };
 
 
+const IOStreamIF g_pifUART2 = {
+	UART2_flushTtransmit,
+	UART2_transmitFree,
+	UART2_transmit,
+	UART2_flushReceive,
+	UART2_receiveAvailable,
+	UART2_receive,
+	Serial_transmitCompletely,
+	Serial_receiveCompletely,
+	&huart2
+};
+
+
 
 
 //====================================================
 //UART support; this glues the UART to the relevant circular buffers
 
 
-//goofy kickstarters; the STM HAL functions take a pointer to a buffer which
-//needs to be stable for later processing at ISR time, so we have these
-//knumbskull 1-byte buffers to satisfy that.  There could be a way for me
-//to point directly into the circular queue space, but it would be messy and
-//bug-prone, so I am punting on that now.  Later, I'll probably write my own
-//low-level UART code, since I'm not in love with the HAL API for that, anyway.
-
-static volatile uint8_t _byTxNow;	//knumbskull TX buffer for UART1
+//kickstarters; the STM HAL functions take a pointer to a buffer which needs
+//to be stable for later processing at ISR time.  For transmit, we point the
+//DMA directly at the next contiguous span of the circular queue, and we don't
+//consume it until the completion.  (If the queue has wrapped, the rest goes
+//out in the next span.)
 static void __kickstartTransmitUART1()
 {
-	circbuff_dequeue(&UART1_txbuff,(void*)&_byTxNow);	//
-	if(HAL_UART_Transmit_IT(&huart1, (uint8_t*)&_byTxNow, sizeof(_byTxNow)) != HAL_OK)
+	uint8_t* pbySpan;
+	_nTxInFlightUART1 = UART1_txq_readSpan ( &pbySpan );
+	if ( 0 == _nTxInFlightUART1 )
+		return;
+	if(HAL_UART_Transmit_DMA(&huart1, pbySpan, _nTxInFlightUART1) != HAL_OK)
 	{
-		//XXX horror
+		_nTxInFlightUART1 = 0;	//(it's not going anywhere)
+		++_statsUART1._nErrors;
 //		LightLamp ( 2000, &g_lltOr, _ledOnWh );
 	}
 }
 
-volatile uint8_t _byRxNow;	//knumbskull RX buffer for UART1
+//(receive doesn't need such silliness; the DMA runs forever in circular mode)
 static void __kickstartReceiveUART1()
 {
-	//set up to receive more
-	//if ( HAL_UART_STATE_BUSY_RX == huart1.State || HAL_UART_STATE_BUSY_TX_RX == huart1.State )	//must grope for RX only state
-	if(HAL_UART_Receive_IT(&huart1, (uint8_t*)&_byRxNow, sizeof(_byRxNow)) != HAL_OK)
+	++_nRxGenUART1;	//(any read in progress is now stale)
+	_nRxRdIdxUART1 = 0;	//(DMA starts from the top)
+	if(HAL_UART_Receive_DMA(&huart1, _abyRxDMAUART1, sizeof(_abyRxDMAUART1)) != HAL_OK)
 	{
-		//XXX horror
+		++_statsUART1._nErrors;
 //		LightLamp ( 2000, &g_lltOr, _ledOnWh );
 	}
+	//the HAL doesn't do idle line detection, so we do that ourselves
+	__HAL_UART_CLEAR_IDLEFLAG(&huart1);
+	__HAL_UART_ENABLE_IT(&huart1, UART_IT_IDLE);
+}
+
+
+//where the DMA will write next
+static size_t _rxWrIdxUART1 ( void )
+{
+	size_t nWr = UART1_RXDMA_SIZE - __HAL_DMA_GET_COUNTER(&hdma_usart1_rx);
+	//(the counter reloads on wrap, but be tolerant of catching it at 0)
+	return ( nWr >= UART1_RXDMA_SIZE ) ? 0 : nWr;
+}
+
+
+
+//At each half buffer, see if the DMA is now writing over what the reader
+//hasn't got to yet (i.e. the reader is most of a lap behind):  that's when
+//it is in the same half, but ahead of the DMA.
+static void _checkOverrunUART1 ( void )
+{
+	size_t nRd = _nRxRdIdxUART1;
+	size_t nWr = _rxWrIdxUART1();
+	if ( nRd > nWr && nRd / ( UART1_RXDMA_SIZE / 2 ) == nWr / ( UART1_RXDMA_SIZE / 2 ) )
+		++_statsUART1._nOverruns;
+}
+
+
+
+//count of receive interrupts on UART1, for measuring the load the GPS puts
+//on us
+static volatile uint32_t _nRxIrqsUART1;
+
+uint32_t UART1_rxInterrupts ( void )
+{
+	return _nRxIrqsUART1;
+}
+
+
+
+//(and the same for UART2)
+static void __kickstartTransmitUART2()
+{
+	uint8_t* pbySpan;
+	_nTxInFlightUART2 = UART2_txq_readSpan ( &pbySpan );
+	if ( 0 == _nTxInFlightUART2 )
+		return;
+	if(HAL_UART_Transmit_DMA(&huart2, pbySpan, _nTxInFlightUART2) != HAL_OK)
+	{
+		_nTxInFlightUART2 = 0;	//(it's not going anywhere)
+		++_statsUART2._nErrors;
+	}
+}
+
+static void __kickstartReceiveUART2()
+{
+	++_nRxGenUART2;
+	_nRxRdIdxUART2 = 0;	//(DMA starts from the top)
+	if(HAL_UART_Receive_DMA(&huart2, _abyRxDMAUART2, sizeof(_abyRxDMAUART2)) != HAL_OK)
+	{
+		++_statsUART2._nErrors;
+	}
+	__HAL_UART_CLEAR_IDLEFLAG(&huart2);
+	__HAL_UART_ENABLE_IT(&huart2, UART_IT_IDLE);
+}
+
+static size_t _rxWrIdxUART2 ( void )
+{
+	size_t nWr = UART2_RXDMA_SIZE - __HAL_DMA_GET_COUNTER(&hdma_usart2_rx);
+	return ( nWr >= UART2_RXDMA_SIZE ) ? 0 : nWr;
+}
+
+static void _checkOverrunUART2 ( void )
+{
+	size_t nRd = _nRxRdIdxUART2;
+	size_t nWr = _rxWrIdxUART2();
+	if ( nRd > nWr && nRd / ( UART2_RXDMA_SIZE / 2 ) == nWr / ( UART2_RXDMA_SIZE / 2 ) )
+		++_statsUART2._nOverruns;
 }
 
 
@@ -159,6 +320,79 @@ static void __kickstartReceiveUART1()
 //our stub implementation of the optional notification callbacks
 __weak void UART1_DataAvailable ( void ){}
 __weak void UART1_TransmitEmpty ( void ){}
+__weak void UART2_DataAvailable ( void ){}
+__weak void UART2_TransmitEmpty ( void ){}
+
+
+
+//The tasks (if any) blocked in the xxxCompletely() methods on each stream.
+//They are woken with the same TNB_DAV/TNB_TBMT notifications as the optional
+//callbacks above use, but sent to whoever is actually waiting, since that
+//isn't necessarily the task that owns the stream.  (There is one of each,
+//just as there is one producer and one consumer on each queue.)  When it is
+//first woken is noted, so the waiter can tell how long it took to run.
+typedef struct StreamWaiter StreamWaiter;
+struct StreamWaiter
+{
+	TaskHandle_t volatile _th;
+	volatile int _bWoken;			//since it last went to sleep
+	volatile uint32_t _nCycWoken;	//DWT->CYCCNT when it was
+};
+
+typedef struct StreamWaiters StreamWaiters;
+struct StreamWaiters
+{
+	StreamWaiter _swTransmit;	//waiting for transmit room
+	StreamWaiter _swReceive;	//waiting for receive data
+	IOStreamStats* const _pstats;
+};
+
+static StreamWaiters _swUART1 = { { NULL }, { NULL }, &_statsUART1 };
+static StreamWaiters _swCDC = { { NULL }, { NULL }, &_statsCDC };
+static StreamWaiters _swUART2 = { { NULL }, { NULL }, &_statsUART2 };
+
+
+static StreamWaiters* _waitersFor ( const IOStreamIF* pcom )
+{
+	if ( &g_pifCDC == pcom )
+		return &_swCDC;
+	return ( &g_pifUART1 == pcom ) ? &_swUART1 : &_swUART2;
+}
+
+
+//wake a waiter, if there is one.  (This is usually called at ISR time.)
+static void _wakeWaiter ( StreamWaiter* psw, uint32_t nBit )
+{
+	TaskHandle_t thWaiter = psw->_th;
+	if ( NULL != thWaiter )
+	{
+		BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+		if ( ! psw->_bWoken )
+		{
+			psw->_nCycWoken = DWT->CYCCNT;
+			psw->_bWoken = 1;
+		}
+		xTaskNotifyFromISR ( thWaiter, nBit, eSetBits, &xHigherPriorityTaskWoken );
+		portYIELD_FROM_ISR( xHigherPriorityTaskWoken );
+	}
+}
+
+
+//these combine the waking with the optional callbacks.  A transmit waiter
+//only needs room, not an empty queue, so it is woken whenever some is freed;
+//the callbacks are still only for when it's all gone.
+static void _dataAvailableUART1 ( void )
+{
+	++_nRxIrqsUART1;
+	_wakeWaiter ( &_swUART1._swReceive, TNB_DAV );
+	UART1_DataAvailable();	//notify anyone interested
+}
+
+static void _dataAvailableUART2 ( void )
+{
+	_wakeWaiter ( &_swUART2._swReceive, TNB_DAV );
+	UART2_DataAvailable();	//notify anyone interested
+}
 
 
 
@@ -167,56 +401,121 @@ void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart)
 {
 	if ( USART1 == huart->Instance )
 	{
-		int bEmpty;
-		UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();	//lock queue
-		//if there is more in the queue, pluck and transmit
-		if ( ! circbuff_empty(&UART1_txbuff) )
+		//the DMA is done with that span; now it can be reused
+		UART1_txq_consume ( _nTxInFlightUART1 );
+		_nTxInFlightUART1 = 0;
+		_wakeWaiter ( &_swUART1._swTransmit, TNB_TBMT );	//(there's room now)
+		//if there is more in the queue, transmit the next span
+		if ( ! UART1_txq_empty() )
 		{
 			__kickstartTransmitUART1();
-			bEmpty = 0;
 		}
 		else
 		{
-			bEmpty = 1;
-		}
-		taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);	//unlock queue
-		if ( bEmpty )
 			UART1_TransmitEmpty();	//notify anyone interested
+		}
+	}
+	else if ( USART2 == huart->Instance )
+	{
+		UART2_txq_consume ( _nTxInFlightUART2 );
+		_nTxInFlightUART2 = 0;
+		_wakeWaiter ( &_swUART2._swTransmit, TNB_TBMT );	//(there's room now)
+		if ( ! UART2_txq_empty() )
+		{
+			__kickstartTransmitUART2();
+		}
+		else
+		{
+			UART2_TransmitEmpty();	//notify anyone interested
+		}
 	}
 }
 
 
 
-//A UART has completed reception.  Stick it in our queue if we can.
+//The UART receive DMA has filled the second half of its buffer (and wrapped).
+//The data is already where the reader will get it; just tell them.
 void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart)
 {
 	if ( USART1 == huart->Instance )
 	{
-		UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();	//lock queue
-		if ( ! circbuff_full(&UART1_rxbuff) )
-		{
-			circbuff_enqueue ( &UART1_rxbuff, (void*)&_byRxNow );
-		}
-		else
-		{
-			//XXX horror; buffer overrun
-//			LightLamp ( 2000, &g_lltOr, _ledOnWh );
-		}
-		//either way, set up to receive more
-		__kickstartReceiveUART1();
-		taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);	//unlock queue
-		UART1_DataAvailable();	//notify anyone interested
+		_checkOverrunUART1();
+		_dataAvailableUART1();
+	}
+	else if ( USART2 == huart->Instance )
+	{
+		_checkOverrunUART2();
+		_dataAvailableUART2();
 	}
 }
 
 
+//The UART receive DMA has filled the first half of its buffer.
+void HAL_UART_RxHalfCpltCallback(UART_HandleTypeDef *huart)
+{
+	if ( USART1 == huart->Instance )
+	{
+		_checkOverrunUART1();
+		_dataAvailableUART1();
+	}
+	else if ( USART2 == huart->Instance )
+	{
+		_checkOverrunUART2();
+		_dataAvailableUART2();
+	}
+}
+
+
+//The UART receive line has gone idle (called from the IRQ handler in
+//stm32f1xx_it.c); this is the end of a burst.
+void UART1_RxIdleCallback ( void )
+{
+	_dataAvailableUART1();
+}
+
+void UART2_RxIdleCallback ( void )
+{
+	_dataAvailableUART2();
+}
+
+
 
 //UART error
 void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
 {
 	if ( USART1 == huart->Instance )
 	{
-		//XXX III
+		if ( huart->ErrorCode & HAL_UART_ERROR_ORE )
+			++_statsUART1._nOverruns;
+		else
+			++_statsUART1._nErrors;
+		//the HAL aborts a DMA receive on any error (e.g. a framing error
+		//from line noise); we just start over.  (What was unread is lost.)
+		if ( HAL_UART_STATE_READY == huart->RxState )
+		{
+			__kickstartReceiveUART1();
+		}
+		//likewise a DMA transmit error ends the transmit; drop that span
+		//and carry on with the rest
+		if ( HAL_UART_STATE_READY == huart->gState && 0 != _nTxInFlightUART1 )
+		{
+			HAL_UART_TxCpltCallback ( huart );
+		}
+	}
+	else if ( USART2 == huart->Instance )
+	{
+		if ( huart->ErrorCode & HAL_UART_ERROR_ORE )
+			++_statsUART2._nOverruns;
+		else
+			++_statsUART2._nErrors;
+		if ( HAL_UART_STATE_READY == huart->RxState )
+		{
+			__kickstartReceiveUART2();
+		}
+		if ( HAL_UART_STATE_READY == huart->gState && 0 != _nTxInFlightUART2 )
+		{
+			HAL_UART_TxCpltCallback ( huart );
+		}
 	}
 }
 
@@ -235,34 +534,81 @@ void HAL_UART_ErrorCallback(UART_HandleTypeDef *huart)
 //Eventually, I may move this internal to the USB CDC implementation, but it is
 //not yet clear that this will improve things, so I am keeping them here for
 //the moment, ugly though that may be.
-size_t XXX_Pull_USBCDC_TxData ( uint8_t* pbyBuffer, const size_t nMax )
+//Transmit is zero-copy:  we lend the USB the first contiguous span of the
+//queue, and only consume it when the USB says it is done with it.  (The next
+//span, if it wrapped, goes out on the next transfer.)  These are only called
+//with the USB idle, so there is only one loan outstanding at a time.
+size_t XXX_Peek_USBCDC_TxData ( uint8_t** ppbyData, const size_t nMax )
 {
-	size_t nPulled;
-	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();	//lock queue
-	size_t nToPull = circbuff_count(&CDC_txbuff);	//max you could pull
-	if ( nMax < nToPull )	//no buffer overruns, please
-		nToPull = nMax;
-	for ( nPulled = 0; nPulled < nToPull; ++nPulled )
+	circbuff_span_t asSpans[2];
+	size_t nSpan;
+	spscbuff_readSpans ( &CDC_txbuff, asSpans );
+	nSpan = asSpans[0]._nCount;
+	if ( nSpan > nMax )
+		nSpan = nMax;
+	*ppbyData = (uint8_t*) asSpans[0]._pv;
+	_nTxInFlightCDC = nSpan;
+	return nSpan;
+}
+
+void XXX_Consume_USBCDC_TxData ( void )
+{
+	spscbuff_consume ( &CDC_txbuff, _nTxInFlightCDC );
+	_nTxInFlightCDC = 0;
+	_wakeWaiter ( &_swCDC._swTransmit, TNB_TBMT );	//(there's room now)
+}
+
+//Receive is zero-copy too:  we give the USB the free space at the end of the
+//queue to receive into, if there is room there for a whole packet.  If the
+//room is only there by wrapping, then it will have to use its bounce buffer,
+//and we copy in from that.  If there is no room at all, then we don't arm it,
+//and the USB NAKs the host until the reader makes some room.  So nothing is
+//ever dropped.
+//These are called from the USB ISR, or with it locked out.
+uint8_t* XXX_Arm_USBCDC_RxData ( uint8_t* pbyBounce, const size_t nPacket )
+{
+	circbuff_span_t asSpans[2];
+	unsigned int nFree = spscbuff_writeSpans ( &CDC_rxbuff, asSpans );
+	_bRxNAKingCDC = 0;
+	if ( asSpans[0]._nCount >= nPacket )
 	{
-		circbuff_dequeue(&CDC_txbuff,&pbyBuffer[nPulled]);
+		_bRxInPlaceCDC = 1;
+		return (uint8_t*) asSpans[0]._pv;
 	}
-	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);	//unlock queue
-	return nPulled;
+	_bRxInPlaceCDC = 0;
+	if ( nFree >= nPacket )
+	{
+		return pbyBounce;
+	}
+	_bRxNAKingCDC = 1;
+	++_statsCDC._nRxHeldOff;
+	return NULL;
 }
 
 size_t XXX_Push_USBCDC_RxData ( const uint8_t* pbyBuffer, const size_t nAvail )
 {
-	size_t nPushed;
-	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();	//lock queue
-	size_t nToPush = circbuff_capacity(&CDC_rxbuff) - circbuff_count(&CDC_rxbuff);	//max you could push
-	if ( nAvail < nToPush )	//no buffer overruns, please
-		nToPush = nAvail;
-	for ( nPushed = 0; nPushed < nToPush; ++nPushed )
+	if ( _bRxInPlaceCDC )
 	{
-		circbuff_enqueue ( &CDC_rxbuff, &pbyBuffer[nPushed] );
+		spscbuff_commit ( &CDC_rxbuff, nAvail );	//(already there)
+		++_statsCDC._nRxInPlace;
+		return nAvail;
+	}
+	++_statsCDC._nRxBounced;
+	return spscbuff_write ( &CDC_rxbuff, pbyBuffer, nAvail );	//(there's room)
+}
+
+
+//the reader has made some room; if we were NAKing, get the USB going again
+static void __resumeReceiveUSBCDC ( void )
+{
+	if ( _bRxNAKingCDC )
+	{
+		CritSect cs;
+		_critEnter ( &cs );	//lock USB
+		if ( _bRxNAKingCDC )	//(still?)
+			CDC_RxResume_FS();
+		_critExit ( &cs, &_statsCDC );	//unlock USB
 	}
-	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);	//unlock queue
-	return nPushed;
 }
 
 
@@ -272,19 +618,24 @@ size_t XXX_Push_USBCDC_RxData ( const uint8_t* pbyBuffer, const size_t nAvail )
 
 
 
+//(flushing touches both ends, so this one does need the lock)
 static void UART1_flushTtransmit ( const IOStreamIF* pthis )
 {
-	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();	//lock queue
-	circbuff_init(&UART1_txbuff);
-	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);	//unlock queue
+	CritSect cs;
+	_critEnter ( &cs );	//lock queue
+	//(what the DMA is in the middle of sending must stay where it is)
+	UART1_txq_discard ( _nTxInFlightUART1 );
+	_critExit ( &cs, &_statsUART1 );	//unlock queue
 }
 
 
 static void UART1_flushReceive ( const IOStreamIF* pthis )
 {
-	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();	//lock queue
-	circbuff_init(&UART1_rxbuff);
-	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);	//unlock queue
+	//just skip to where the DMA is (locked, so a restart can't come between)
+	CritSect cs;
+	_critEnter ( &cs );
+	_nRxRdIdxUART1 = _rxWrIdxUART1();
+	_critExit ( &cs, &_statsUART1 );
 }
 
 
@@ -292,14 +643,14 @@ static void UART1_flushReceive ( const IOStreamIF* pthis )
 static size_t UART1_transmit ( const IOStreamIF* pthis, const void* pv, size_t nLen )
 {
 	size_t nPushed;
-	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();	//lock queue
-	size_t nToPush = circbuff_capacity(&UART1_txbuff) - circbuff_count(&UART1_txbuff);	//max you could push
-	if ( nLen < nToPush )	//no buffer overruns, please
-		nToPush = nLen;
-	for ( nPushed = 0; nPushed < nToPush; ++nPushed )
-	{
-		circbuff_enqueue ( &UART1_txbuff, &((uint8_t*)pv)[nPushed] );
-	}
+	CritSect cs;
+	nPushed = UART1_txq_write ( pv, nLen );	//(as much as will fit)
+	_statsUART1._nBytesOut += nPushed;
+	//The queue needs no lock, but the kickstart does:  the HAL_UART_xxx calls
+	//take the handle's lock, which receive restarts at ISR time also take.
+	//(If the TX ISR goes idle just after we looked, it will have seen what we
+	//queued already; and if it's still busy, it will get to it.)
+	_critEnter ( &cs );	//lock UART
 	//if the transmitter is idle, we will need to kickstart it
 	//old HAL lib had one state var
 	//if ( HAL_UART_STATE_READY == huart1.State ||
@@ -314,24 +665,45 @@ static size_t UART1_transmit ( const IOStreamIF* pthis, const void* pv, size_t n
 	{
 		//dummy = 0;
 	}
-	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);	//unlock queue
+	_critExit ( &cs, &_statsUART1 );	//unlock UART
 	return nPushed;
 }
 
 
 
+//we copy out in (at most two) contiguous spans up to the DMA's write position
 static size_t UART1_receive ( const IOStreamIF* pthis, void* pv, const size_t nLen )
 {
-	size_t nPulled;
-	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();	//lock queue
-	size_t nToPull = circbuff_count(&UART1_rxbuff);	//max you could pull
-	if ( nLen < nToPull )	//no buffer overruns, please
-		nToPull = nLen;
-	for ( nPulled = 0; nPulled < nToPull; ++nPulled )
+	size_t nPulled = 0;
+	uint32_t nGen = _nRxGenUART1;	//(before we look at the indices)
+	size_t nRd = _nRxRdIdxUART1;
+	size_t nWr = _rxWrIdxUART1();
+	size_t nPending = ( nWr + UART1_RXDMA_SIZE - nRd ) % UART1_RXDMA_SIZE;
+	if ( nPending > _statsUART1._nRxHighWater )
+		_statsUART1._nRxHighWater = nPending;
+	while ( nRd != nWr && nPulled < nLen )
 	{
-		circbuff_dequeue(&UART1_rxbuff, &((uint8_t*)pv)[nPulled]);
+		size_t nSpan = ( ( nWr > nRd ) ? nWr : UART1_RXDMA_SIZE ) - nRd;
+		if ( nSpan > nLen - nPulled )	//no buffer overruns, please
+			nSpan = nLen - nPulled;
+		memcpy ( &((uint8_t*)pv)[nPulled], &_abyRxDMAUART1[nRd], nSpan );
+		nPulled += nSpan;
+		nRd += nSpan;
+		if ( UART1_RXDMA_SIZE == nRd )
+			nRd = 0;
 	}
-	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);	//unlock queue
+	//If the receive was restarted while we were copying, the DMA has
+	//started over at the top (maybe over what we were copying), and the
+	//reader's position with it; so drop what we got rather than put back
+	//the stale position, which would replay old bytes.
+	CritSect cs;
+	_critEnter ( &cs );
+	if ( nGen == _nRxGenUART1 )
+		_nRxRdIdxUART1 = nRd;
+	else
+		nPulled = 0;
+	_critExit ( &cs, &_statsUART1 );
+	_statsUART1._nBytesIn += nPulled;
 	return nPulled;
 }
 
@@ -340,11 +712,7 @@ static size_t UART1_receive ( const IOStreamIF* pthis, void* pv, const size_t nL
 //what are the number of bytes available to be read now
 static size_t UART1_receiveAvailable ( const IOStreamIF* pthis )
 {
-	size_t n;
-	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();	//lock queue
-	n = circbuff_count(&UART1_rxbuff);
-	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);	//unlock queue
-	return n;
+	return ( _rxWrIdxUART1() + UART1_RXDMA_SIZE - _nRxRdIdxUART1 ) % UART1_RXDMA_SIZE;
 }
 
 
@@ -352,11 +720,91 @@ static size_t UART1_receiveAvailable ( const IOStreamIF* pthis )
 //how much can be pushed into the transmitter buffers now
 static size_t UART1_transmitFree ( const IOStreamIF* pthis )
 {
-	size_t n;
-	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();	//lock queue
-	n = circbuff_capacity(&UART1_txbuff) - circbuff_count(&UART1_txbuff);
-	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);	//unlock queue
-	return n;
+	return UART1_txq_free();
+}
+
+
+
+//====================================================
+//UART2 read/write API; these are just as for UART1
+
+
+static void UART2_flushTtransmit ( const IOStreamIF* pthis )
+{
+	CritSect cs;
+	_critEnter ( &cs );	//lock queue
+	UART2_txq_discard ( _nTxInFlightUART2 );
+	_critExit ( &cs, &_statsUART2 );	//unlock queue
+}
+
+
+static void UART2_flushReceive ( const IOStreamIF* pthis )
+{
+	CritSect cs;
+	_critEnter ( &cs );
+	_nRxRdIdxUART2 = _rxWrIdxUART2();
+	_critExit ( &cs, &_statsUART2 );
+}
+
+
+static size_t UART2_transmit ( const IOStreamIF* pthis, const void* pv, size_t nLen )
+{
+	size_t nPushed;
+	CritSect cs;
+	nPushed = UART2_txq_write ( pv, nLen );	//(as much as will fit)
+	_statsUART2._nBytesOut += nPushed;
+	_critEnter ( &cs );	//lock UART
+	if ( HAL_UART_STATE_READY == huart2.gState )	//must grope for TX only ready state
+	{
+		__kickstartTransmitUART2();
+	}
+	_critExit ( &cs, &_statsUART2 );	//unlock UART
+	return nPushed;
+}
+
+
+static size_t UART2_receive ( const IOStreamIF* pthis, void* pv, const size_t nLen )
+{
+	size_t nPulled = 0;
+	uint32_t nGen = _nRxGenUART2;	//(before we look at the indices)
+	size_t nRd = _nRxRdIdxUART2;
+	size_t nWr = _rxWrIdxUART2();
+	size_t nPending = ( nWr + UART2_RXDMA_SIZE - nRd ) % UART2_RXDMA_SIZE;
+	if ( nPending > _statsUART2._nRxHighWater )
+		_statsUART2._nRxHighWater = nPending;
+	while ( nRd != nWr && nPulled < nLen )
+	{
+		size_t nSpan = ( ( nWr > nRd ) ? nWr : UART2_RXDMA_SIZE ) - nRd;
+		if ( nSpan > nLen - nPulled )	//no buffer overruns, please
+			nSpan = nLen - nPulled;
+		memcpy ( &((uint8_t*)pv)[nPulled], &_abyRxDMAUART2[nRd], nSpan );
+		nPulled += nSpan;
+		nRd += nSpan;
+		if ( UART2_RXDMA_SIZE == nRd )
+			nRd = 0;
+	}
+	//(a restart while we were copying makes this stale; see UART1)
+	CritSect cs;
+	_critEnter ( &cs );
+	if ( nGen == _nRxGenUART2 )
+		_nRxRdIdxUART2 = nRd;
+	else
+		nPulled = 0;
+	_critExit ( &cs, &_statsUART2 );
+	_statsUART2._nBytesIn += nPulled;
+	return nPulled;
+}
+
+
+static size_t UART2_receiveAvailable ( const IOStreamIF* pthis )
+{
+	return ( _rxWrIdxUART2() + UART2_RXDMA_SIZE - _nRxRdIdxUART2 ) % UART2_RXDMA_SIZE;
+}
+
+
+static size_t UART2_transmitFree ( const IOStreamIF* pthis )
+{
+	return UART2_txq_free();
 }
 
 
@@ -368,32 +816,28 @@ static size_t UART1_transmitFree ( const IOStreamIF* pthis )
 
 static void USBCDC_flushTtransmit ( const IOStreamIF* pthis )
 {
-	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();	//lock queue
-	circbuff_init(&CDC_txbuff);
-	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);	//unlock queue
+	CritSect cs;
+	_critEnter ( &cs );	//lock queue
+	//(what the USB is in the middle of sending must stay where it is)
+	spscbuff_discard(&CDC_txbuff,_nTxInFlightCDC);
+	_critExit ( &cs, &_statsCDC );	//unlock queue
 }
 
 
+//(we just read past everything; the USB may be receiving into the queue
+//beyond that, so we can't reset it)
 static void USBCDC_flushReceive ( const IOStreamIF* pthis )
 {
-	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();	//lock queue
-	circbuff_init(&CDC_rxbuff);
-	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);	//unlock queue
+	spscbuff_consume ( &CDC_rxbuff, spscbuff_count(&CDC_rxbuff) );
+	__resumeReceiveUSBCDC();
 }
 
 
 static size_t USBCDC_transmit ( const IOStreamIF* pthis, const void* pv, size_t nLen )
 {
 	size_t nPushed;
-	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();	//lock queue
-	size_t nToPush = circbuff_capacity(&CDC_txbuff) - circbuff_count(&CDC_txbuff);	//max you could push
-	if ( nLen < nToPush )	//no buffer overruns, please
-		nToPush = nLen;
-	for ( nPushed = 0; nPushed < nToPush; ++nPushed )
-	{
-		circbuff_enqueue ( &CDC_txbuff, &((uint8_t*)pv)[nPushed] );
-	}
-	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);	//unlock queue
+	nPushed = spscbuff_write ( &CDC_txbuff, pv, nLen );	//(as much as will fit)
+	_statsCDC._nBytesOut += nPushed;
 	//notify to kick-start transmission, if needed
 	CDC_Transmit_FS(NULL, 0);
 	return nPushed;
@@ -403,16 +847,10 @@ static size_t USBCDC_transmit ( const IOStreamIF* pthis, const void* pv, size_t
 
 static size_t USBCDC_receive ( const IOStreamIF* pthis, void* pv, const size_t nLen )
 {
-	size_t nPulled;
-	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();	//lock queue
-	size_t nToPull = circbuff_count(&CDC_rxbuff);	//max you could pull
-	if ( nLen < nToPull )	//no buffer overruns, please
-		nToPull = nLen;
-	for ( nPulled = 0; nPulled < nToPull; ++nPulled )
-	{
-		circbuff_dequeue(&CDC_rxbuff,&((uint8_t*)pv)[nPulled]);
-	}
-	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);	//unlock queue
+	size_t nPulled = spscbuff_read ( &CDC_rxbuff, pv, nLen );	//(no more than nLen)
+	_statsCDC._nBytesIn += nPulled;
+	if ( 0 != nPulled )
+		__resumeReceiveUSBCDC();
 	return nPulled;
 }
 
@@ -421,11 +859,7 @@ static size_t USBCDC_receive ( const IOStreamIF* pthis, void* pv, const size_t n
 //what are the number of bytes available to be read now
 static size_t USBCDC_receiveAvailable ( const IOStreamIF* pthis )
 {
-	size_t n;
-	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();	//lock queue
-	n = circbuff_count(&CDC_rxbuff);
-	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);	//unlock queue
-	return n;
+	return spscbuff_count(&CDC_rxbuff);
 }
 
 
@@ -433,11 +867,7 @@ static size_t USBCDC_receiveAvailable ( const IOStreamIF* pthis )
 //how much can be pushed into the transmitter buffers now
 static size_t USBCDC_transmitFree ( const IOStreamIF* pthis )
 {
-	size_t n;
-	UBaseType_t uxSavedInterruptStatus = taskENTER_CRITICAL_FROM_ISR();	//lock queue
-	n = circbuff_capacity(&CDC_txbuff) - circbuff_count(&CDC_txbuff);
-	taskEXIT_CRITICAL_FROM_ISR(uxSavedInterruptStatus);	//unlock queue
-	return n;
+	return spscbuff_free(&CDC_txbuff);
 }
 
 
@@ -446,6 +876,20 @@ static size_t USBCDC_transmitFree ( const IOStreamIF* pthis )
 __weak void USBCDC_DataAvailable ( void ){}
 __weak void USBCDC_TransmitEmpty ( void ){}
 
+//the USB CDC events; these wake any waiter, and then do the optional
+//callbacks.  (As for the UARTs, a transmit waiter is woken whenever room is
+//freed, in XXX_Consume_USBCDC_TxData, not just here when it's all gone.)
+void XXX_USBCDC_DataAvailable ( void )
+{
+	_wakeWaiter ( &_swCDC._swReceive, TNB_DAV );
+	USBCDC_DataAvailable();	//notify anyone interested
+}
+
+void XXX_USBCDC_TransmitEmpty ( void )
+{
+	USBCDC_TransmitEmpty();	//notify anyone interested
+}
+
 
 
 
@@ -455,21 +899,73 @@ __weak void USBCDC_TransmitEmpty ( void ){}
 
 
 
-//A simple blocking transmit function.  This just does a sleep when the
-//transmit buffer cannot accept more.  Not sophisticated, but still better than
-//polling.
+//Wait for an event on a stream (we must already be registered as the waiter),
+//or for what's left of the timeout; false if the time has run out.
+//We may be woken by some other notification meant for the task's own event
+//loop.  Its bit stays set (we only clear ours), but the wait has used up the
+//notification, so the task's loop would not wake for it.  So we collect
+//those in *pnOther, and the caller posts them back when it is done.  (Doing
+//it here would just wake us again, straight away.)
+static int _streamWait ( StreamWaiter* psw, IOStreamStats* pstats, uint32_t nBit,
+		uint32_t tsStart, uint32_t to, uint32_t* pnOther )
+{
+	TickType_t xTicks;
+	uint32_t tsSleep = HAL_GetTick();
+	if ( TO_INFINITY == to )
+	{
+		xTicks = portMAX_DELAY;
+	}
+	else
+	{
+		uint32_t nElapsed = tsSleep - tsStart;
+		if ( nElapsed > to )
+			return 0;
+		xTicks = pdMS_TO_TICKS ( to - nElapsed ) + 1;	//(at least a tick)
+	}
+	uint32_t ulNotificationValue = 0;
+	psw->_bWoken = 0;
+	++pstats->_nWaits;
+	if ( pdPASS == xTaskNotifyWait ( 0,	//Don't clear bits on entry.
+			nBit,	//Clear only the one we are waiting on, on exit.
+			&ulNotificationValue, xTicks ) )
+	{
+		if ( ( ulNotificationValue & nBit ) && psw->_bWoken )
+		{
+			uint32_t nCycles = DWT->CYCCNT - psw->_nCycWoken;
+			++pstats->_nWakeups;
+			if ( nCycles > pstats->_nWakeMaxCycles )
+				pstats->_nWakeMaxCycles = nCycles;
+		}
+		*pnOther |= ulNotificationValue & ~nBit;
+	}
+	uint32_t nSlept = HAL_GetTick() - tsSleep;
+	if ( nSlept > pstats->_nWaitMaxMs )
+		pstats->_nWaitMaxMs = nSlept;
+	return 1;
+}
+
+
+
+//A simple blocking transmit function.  This sleeps until the transmitter
+//tells us it has made some room, whenever the transmit buffer cannot accept
+//more.  (It is registered as the waiter before it tries, so the event cannot
+//be missed; a stale one just causes an extra try.)
 //The return value is the portion of nLen that has /not/ been processed; so
 //0 means success, and non-zero means failure, and nLen-(return) means how
 //much /was/ processed.
 static int Serial_transmitCompletely ( const IOStreamIF* pcom, const void* pv, size_t nLen, uint32_t to )
 {
+	StreamWaiters* psw = _waitersFor ( pcom );
 	uint32_t tsStart;
 	size_t nIdxNow;
 	size_t nRemaining;
 	size_t nDone;
+	uint32_t nOther = 0;
+	int nRet = 0;
 	
 	tsStart = HAL_GetTick();
 	
+	psw->_swTransmit._th = xTaskGetCurrentTaskHandle();
 	nIdxNow = 0;
 	while ( nRemaining = nLen - nIdxNow, 0 != nRemaining )
 	{
@@ -477,38 +973,43 @@ static int Serial_transmitCompletely ( const IOStreamIF* pcom, const void* pv, s
 		nIdxNow += nDone;
 		if ( nDone != nRemaining )
 		{
-			if ( ( HAL_GetTick() - tsStart ) > to )
+			if ( ! _streamWait ( &psw->_swTransmit, psw->_pstats, TNB_TBMT,
+					tsStart, to, &nOther ) )
 			{
-				return nLen - nIdxNow;	//(must recompute since we're at this point)
+				nRet = nLen - nIdxNow;	//(must recompute since we're at this point)
+				break;
 			}
-			osDelay(1);
 		}
 	}
-	
-/*
-	//Reeeeally completely
-	while ( ! UART2_txbuff_empty() )
+	psw->_swTransmit._th = NULL;
+	//give back the notifications that weren't for us
+	if ( 0 != nOther )
 	{
-		osDelay ( 1 );
+		xTaskNotify ( xTaskGetCurrentTaskHandle(), nOther, eSetBits );
 	}
-*/
-	return 0;	//tada!
+	
+	return nRet;	//tada! (or not)
 }
 
 
 
-//A simple blocking receive function.  This just does a sleep when the receive
-//buffer cannot produce what is requested.  Not sophisticated, but still better
-//than polling.
+//A simple blocking receive function.  This sleeps until the receiver tells
+//us there is data, whenever the receive buffer cannot produce what is
+//requested.
 static int Serial_receiveCompletely ( const IOStreamIF* pcom, void* pv, const size_t nLen, uint32_t to )
 {
+	StreamWaiters* psw = _waitersFor ( pcom );
 	uint32_t tsStart;
 	size_t nIdxNow;
 	size_t nRemaining;
 	size_t nDone;
+	int bWaited = 0;
+	uint32_t nOther = 0;
+	int nRet = 0;
 	
 	tsStart = HAL_GetTick();
 	
+	psw->_swReceive._th = xTaskGetCurrentTaskHandle();
 	nIdxNow = 0;
 	while ( nRemaining = nLen - nIdxNow, 0 != nRemaining )
 	{
@@ -516,14 +1017,28 @@ static int Serial_receiveCompletely ( const IOStreamIF* pcom, void* pv, const si
 		nIdxNow += nDone;
 		if ( nDone != nRemaining )
 		{
-			if ( ( HAL_GetTick() - tsStart ) > to )
+			if ( ! _streamWait ( &psw->_swReceive, psw->_pstats, TNB_DAV,
+					tsStart, to, &nOther ) )
 			{
-				return nLen - nIdxNow;	//(must recompute since we're at this point)
+				nRet = nLen - nIdxNow;
+				break;
 			}
-			osDelay(1);
+			bWaited = 1;
 		}
 	}
-	return 0;	//tada!
+	psw->_swReceive._th = NULL;
+	//the owning task's event loop may be depending on the TNB_DAV that we
+	//just cleared, so if we left anything unread, put it back (along with
+	//the notifications that weren't for us)
+	if ( bWaited && 0 != pcom->_receiveAvailable ( pcom ) )
+	{
+		nOther |= TNB_DAV;
+	}
+	if ( 0 != nOther )
+	{
+		xTaskNotify ( xTaskGetCurrentTaskHandle(), nOther, eSetBits );
+	}
+	return nRet;	//tada! (or not)
 }
 
 
@@ -534,17 +1049,130 @@ static int Serial_receiveCompletely ( const IOStreamIF* pcom, void* pv, const si
 
 void UART1_Init ( void )
 {
-	circbuff_init(&UART1_txbuff);
-	circbuff_init(&UART1_rxbuff);
+	UART1_txq_init();
+	_nTxInFlightUART1 = 0;
 	//set up the receive action on UART 1
 	__kickstartReceiveUART1();
 }
 
 
+//change the UART1 bit rate.  Anything being received is lost; the caller
+//should make sure that transmission has finished (UART1_transmitIdle()).
+int UART1_setBitRate ( uint32_t nBitRate )
+{
+	HAL_UART_AbortReceive ( &huart1 );
+	huart1.Init.BaudRate = nBitRate;
+	int bOK = ( HAL_OK == HAL_UART_Init ( &huart1 ) );
+	//either way, set up to receive more
+	__kickstartReceiveUART1();
+	return bOK;
+}
+
+
+//if UART1 has finished sending everything we gave it
+int UART1_transmitIdle ( void )
+{
+	int bIdle;
+	CritSect cs;
+	_critEnter ( &cs );	//lock queue
+	bIdle = UART1_txq_empty() && HAL_UART_STATE_READY == huart1.gState;
+	_critExit ( &cs, &_statsUART1 );	//unlock queue
+	return bIdle;
+}
+
+
+void UART2_Init ( void )
+{
+	UART2_txq_init();
+	_nTxInFlightUART2 = 0;
+	__kickstartReceiveUART2();
+}
+
+
+//if UART2 has finished sending everything we gave it
+int UART2_transmitIdle ( void )
+{
+	int bIdle;
+	CritSect cs;
+	_critEnter ( &cs );	//lock queue
+	bIdle = UART2_txq_empty() && HAL_UART_STATE_READY == huart2.gState;
+	_critExit ( &cs, &_statsUART2 );	//unlock queue
+	return bIdle;
+}
+
+
 void USBCDC_Init ( void )
 {
-	circbuff_init(&CDC_txbuff);
-	circbuff_init(&CDC_rxbuff);
+	spscbuff_init(&CDC_txbuff);
+	spscbuff_init(&CDC_rxbuff);
+	_nTxInFlightCDC = 0;
+	_bRxInPlaceCDC = 0;
+	_bRxNAKingCDC = 0;
+}
+
+
+
+//get a snapshot of a stream's statistics; false if we don't know the stream
+int Serial_getStats ( const IOStreamIF* pio, IOStreamStats* pstats )
+{
+	if ( &g_pifUART1 == pio )
+	{
+		*pstats = _statsUART1;
+		pstats->_nRxCapacity = UART1_RXDMA_SIZE;
+		pstats->_nTxHighWater = UART1_txq_max();
+		pstats->_nTxCapacity = UART1_txq_capacity();
+	}
+	else if ( &g_pifCDC == pio )
+	{
+		*pstats = _statsCDC;
+		pstats->_nRxHighWater = spscbuff_max ( &CDC_rxbuff );
+		pstats->_nRxCapacity = spscbuff_capacity ( &CDC_rxbuff );
+		pstats->_nTxHighWater = spscbuff_max ( &CDC_txbuff );
+		pstats->_nTxCapacity = spscbuff_capacity ( &CDC_txbuff );
+	}
+	else if ( &g_pifUART2 == pio )
+	{
+		*pstats = _statsUART2;
+		pstats->_nRxCapacity = UART2_RXDMA_SIZE;
+		pstats->_nTxHighWater = UART2_txq_max();
+		pstats->_nTxCapacity = UART2_txq_capacity();
+	}
+	else
+	{
+		return 0;
+	}
+	return 1;
+}
+
+
+//the RAM committed to the serial buffers, queue structures included.  (The
+//sizes are powers of 2 of at least 4, so the structures have no padding.)
+size_t Serial_getIORamBytes ( void )
+{
+	return sizeof(UART1_txq_spscbuff) + sizeof(_abyRxDMAUART1) +
+			sizeof(CDC_txbuff) + sizeof(CDC_rxbuff) +
+			sizeof(UART2_txq_spscbuff) + sizeof(_abyRxDMAUART2);
+}
+
+
+void Serial_resetStats ( const IOStreamIF* pio )
+{
+	if ( &g_pifUART1 == pio )
+	{
+		memset ( &_statsUART1, 0, sizeof(_statsUART1) );
+		UART1_txq_resetMax();
+	}
+	else if ( &g_pifCDC == pio )
+	{
+		memset ( &_statsCDC, 0, sizeof(_statsCDC) );
+		spscbuff_resetMax ( &CDC_rxbuff );
+		spscbuff_resetMax ( &CDC_txbuff );
+	}
+	else if ( &g_pifUART2 == pio )
+	{
+		memset ( &_statsUART2, 0, sizeof(_statsUART2) );
+		UART2_txq_resetMax();
+	}
 }
 
 
@@ -18,6 +18,7 @@ extern "C" {
 //the stream interface objects we expose.
 extern const IOStreamIF g_pifUART1;
 extern const IOStreamIF g_pifCDC;
+extern const IOStreamIF g_pifUART2;
 
 
 //these init methods are intended to be called once; they initialize internal
@@ -25,6 +26,15 @@ extern const IOStreamIF g_pifCDC;
 //also some other init that is done in main.c that is generated code.
 void UART1_Init ( void );
 void USBCDC_Init ( void );
+void UART2_Init ( void );
+
+//change the UART1 bit rate at runtime; returns true on success.  Anything
+//being received is lost, and transmission should be finished first.
+int UART1_setBitRate ( uint32_t nBitRate );
+//if UART1 has finished sending everything we gave it
+int UART1_transmitIdle ( void );
+//likewise UART2
+int UART2_transmitIdle ( void );
 
 
 //these are optional callbacks that you can implement to catch these events.
@@ -34,15 +44,51 @@ void UART1_TransmitEmpty ( void );
 
 void USBCDC_DataAvailable ( void );
 void USBCDC_TransmitEmpty ( void );
+void UART2_DataAvailable ( void );
+void UART2_TransmitEmpty ( void );
 
 
-//these are debug methods for tuning buffer sizes
-#ifdef DEBUG
-unsigned int UART1_txbuff_max ( void );
-unsigned int UART1_rxbuff_max ( void );
-unsigned int CDC_txbuff_max ( void );
-unsigned int CDC_rxbuff_max ( void );
-#endif
+//the count of receive interrupts taken on UART1 since boot (it wraps).  Receive
+//is by DMA, so these are half/full buffer and idle line events, not bytes.
+uint32_t UART1_rxInterrupts ( void );
+
+//the idle line events; these are called from the USARTn IRQ handlers
+void UART1_RxIdleCallback ( void );
+void UART2_RxIdleCallback ( void );
+
+
+//I/O statistics for a stream.  These are cheap, so they are kept in all
+//builds; the field is where we most need to know.  Counts wrap.
+typedef struct IOStreamStats IOStreamStats;
+struct IOStreamStats
+{
+	uint32_t _nBytesIn;		//bytes read by the application
+	uint32_t _nBytesOut;	//bytes queued by the application
+	uint32_t _nOverruns;	//times received data was lost
+	uint32_t _nErrors;		//line errors, and driver calls that failed
+	uint32_t _nRxHighWater;	//most bytes ever waiting to be read
+	uint32_t _nRxCapacity;
+	uint32_t _nTxHighWater;	//most bytes ever waiting to be sent
+	uint32_t _nTxCapacity;
+	uint32_t _nCritMaxCycles;	//longest we held off interrupts, in CPU cycles
+	//(USB CDC only) how the received packets got into the queue
+	uint32_t _nRxInPlace;	//straight into it
+	uint32_t _nRxBounced;	//via the bounce buffer, where the room wrapped
+	uint32_t _nRxHeldOff;	//times there was no room, so the host was NAKed
+	//the blocking (xxxCompletely) calls
+	uint32_t _nWaits;		//times one slept, for room or for data
+	uint32_t _nWakeups;		//times it was woken by that (not by a timeout, or another event)
+	uint32_t _nWaitMaxMs;	//longest it slept
+	uint32_t _nWakeMaxCycles;	//longest from being woken to running, in CPU cycles
+};
+
+//get a snapshot of a stream's statistics; false if we don't know the stream
+int Serial_getStats ( const IOStreamIF* pio, IOStreamStats* pstats );
+//reset them (the capacities remain, of course)
+void Serial_resetStats ( const IOStreamIF* pio );
+
+//the RAM committed to the serial buffers (sized in serial_config.h)
+size_t Serial_getIORamBytes ( void );
 
 
 #ifdef __cplusplus
@@ -12,12 +12,33 @@
 #include "stm32f1xx_hal.h"
 
 #include "task_wspr.h"	//to notify of lock changes
+#include "CarelessWSPR_settings.h"
+#include "maidenhead.h"
+#include "nmea_parser.h"
+#include "serial_devices.h"
+#include "ubx.h"
 
 #ifndef COUNTOF
 #define COUNTOF(arr) (sizeof(arr)/sizeof(arr[0]))
 #endif
 
 
+//when tracking, how far (in latitude micro-degrees; longitude is double) we
+//must stray outside the grid square before we change it.  This is about 2 km,
+//and keeps us from flapping when sitting on a boundary.
+#define GRID_HYSTERESIS_MICRO	20000
+
+//how long after startup we let the receiver run unconfigured before sending
+//the UBX configuration; this lets it finish booting, and gives us a baseline
+//measurement of the receive interrupt rate
+#define GPS_UBX_SETTLE_MS	2000
+
+//when changing bit rates, how long we listen for valid sentences, and how
+//many we need to hear, before we believe we're in sync with the receiver
+#define GPS_SYNC_TIMEOUT_MS	2500
+#define GPS_SYNC_SENTENCES	2
+
+
 //the task that consumes GPS data on the serial port
 osThreadId g_thGPS = NULL;
 uint32_t g_tbGPS[ 128 ];
@@ -27,75 +48,101 @@ osStaticThreadDef_t g_tcbGPS;
 const IOStreamIF* g_pGPSIOIf = NULL;	//the IO device to which the gps is attached
 
 
-volatile int g_bLock = 0;
+//The fix is published through a double buffer.  We (the only writer) fill
+//in the back buffer, then flip by bumping the generation; its low bit selects
+//the front buffer.  Readers copy the front buffer and then check that the
+//generation did not move while they did; if it did, they go again.  Readers
+//never wait on the writer, so there is no priority inversion, and nobody has
+//to disable interrupts.
+static GPSFix g_afix[2] =
+{
+	{ ._nFixQuality = -1 },	//-1 until we have seen a GGA
+	{ ._nFixQuality = -1 },
+};
+static volatile uint32_t g_nFixGen;
 
-volatile int g_nGPSHour;
-volatile int g_nGPSMinute;
-volatile int g_nGPSSecond;
-volatile int g_nGPSMonth;
-volatile int g_nGPSDay;
-volatile int g_nGPSYear;
+//set by other tasks to make us forget we had a lock, so that the next fix
+//will stimulate a notification of lock
+static volatile int g_bForgetLock;
 
-volatile float g_fLat;	//+ is N, - is S
-volatile float g_fLon;	//+ is E, - is W
+//lock state machine; the length of the current run of fixes that disagree
+//with the lock state, and statistics
+static uint32_t g_nLockRun;
+static GPSLockStats g_lockStats;
 
 
 
-//====================================================
-//GPS task
-//The GPS sends NMEA sentences over the serial port.  We interpret them and
-//store interesting information in variables.
+//start updating the fix; this is a copy of the current one to modify
+static GPSFix* _fixBegin ( void )
+{
+	uint32_t nGen = g_nFixGen;
+	GPSFix* pfix = &g_afix[( nGen + 1 ) & 1];
+	*pfix = g_afix[nGen & 1];
+	return pfix;
+}
 
 
+//make the fix we have been updating the current one
+static void _fixPublish ( void )
+{
+	__DMB();	//the data must land before the flip
+	++g_nFixGen;
+}
 
-//sentence buffer
-char g_achNMEA0183Sentence[82];	//abs max len is 82
 
+//get a coherent snapshot of the current fix; returns its generation
+uint32_t GPS_getFix ( GPSFix* pfix )
+{
+	uint32_t nGen;
+	do
+	{
+		nGen = g_nFixGen;
+		__DMB();
+		*pfix = g_afix[nGen & 1];
+		__DMB();
+	} while ( nGen != g_nFixGen );
+	return nGen;
+}
 
-static char _gpsGetChar ( const IOStreamIF* pio )
+
+//forget that we have a lock
+void GPS_forgetLock ( void )
 {
-	char ret;
-	pio->_receiveCompletely ( pio, &ret, 1, TO_INFINITY );
-	return ret;
+	g_bForgetLock = 1;
 }
 
 
-//this gets characters from the input stream until line termination occurs.
-static void _getSentence ( const IOStreamIF* pio )
+//lock state machine statistics
+void GPS_getLockStats ( GPSLockStats* pstats )
 {
-	int nIdxSentence;
+	taskENTER_CRITICAL();
+	*pstats = g_lockStats;
+	taskEXIT_CRITICAL();
+}
 
-	int bCont = 1;
 
-	//pull characters into sentence buffer until full or line terminated
-	nIdxSentence = 0;
-	while ( bCont && nIdxSentence < COUNTOF(g_achNMEA0183Sentence) )
-	{
-		char chNow = _gpsGetChar ( pio );
-		switch ( chNow )
-		{
-		case '\r':	//CR is a line terminator
-		case '\n':	//LF is a line terminator
-			memset ( &g_achNMEA0183Sentence[nIdxSentence], '\0', COUNTOF(g_achNMEA0183Sentence) - nIdxSentence );	//clear rest of buffer
-			++nIdxSentence;
-			bCont = 0;
-		break;
-
-		default:
-			//everything else simply accumulates the character
-			g_achNMEA0183Sentence[nIdxSentence] = chNow;
-			++nIdxSentence;
-		break;
-		}
-	}
-	g_achNMEA0183Sentence[COUNTOF(g_achNMEA0183Sentence)-1] = '\0';	//just for safety
+void GPS_resetLockStats ( void )
+{
+	taskENTER_CRITICAL();
+	memset ( &g_lockStats, 0, sizeof(g_lockStats) );
+	taskEXIT_CRITICAL();
 }
 
 
 
+//====================================================
+//GPS task
+//The GPS sends NMEA sentences over the serial port.  We interpret them and
+//store interesting information in variables.
+
+
+
 /*
 http://aprs.gids.nl/nmea
 
+(The talker may be other than 'GP'; e.g. 'GN' for multi-constellation
+receivers.  We accept any talker.)
+
 $GPRMC
 Recommended minimum specific GPS/Transit data
 
@@ -113,168 +160,743 @@ eg2. $GPRMC,225446,A,4916.45,N,12311.12,W,000.5,054.7,191194,020.3,E*68
 */
 
 
-typedef enum GPSProcRetval GPSProcRetval;
-enum GPSProcRetval
+//the RMC values, staged as the fields arrive; they are made 'live' only when
+//the sentence completes.
+typedef struct RMCStage RMCStage;
+struct RMCStage
 {
-	GPSPROC_SUCCESS = 0,	//a command was dispatched successfully
-	GPSPROC_ERROR = 1,		//a command was received, but there were problems
-	GPSPROC_QUIT = 2,		//it is time to exit the command processor
+	int _bTimeValid;	//the time field was present
+	int _nHour;
+	int _nMinute;
+	int _nSecond;
+	char _chStatus;		//'A' is valid, 'V' is warning
+	int32_t _nLat;		//micro-degrees magnitude; hemisphere separately; -1 if malformed
+	char _chLatHemi;
+	int32_t _nLon;		//micro-degrees magnitude; hemisphere separately; -1 if malformed
+	char _chLonHemi;
+	int _bDateValid;	//the date field was present
+	int _nDay;
+	int _nMonth;
+	int _nYear;
 };
+static RMCStage g_rmcStage;
 
 
-//Advance the pointer to the next string in the message.  Note, no error
-//checking for beyond end of string, so this is suitable only for internal
-//use.
-static void nextStr ( char** ppszThisStr )
+//two decimal digits into a value
+static int _parse2 ( const char* psz )
 {
-	while ( '\0' != **ppszThisStr )
+	return ( psz[0] - '0' ) * 10 + ( psz[1] - '0' );
+}
+
+
+//a decimal number into an integer scaled by 100 (e.g. "1.25" -> 125); we only
+//need this for small positive things like DOPs
+static int _parseHundredths ( const char* pszField )
+{
+	int nVal = 0;
+	int nFrac = -1;	//digits after the point; -1 before we've seen it
+	for ( ; '\0' != *pszField && nFrac < 2; ++pszField )
 	{
-		++(*ppszThisStr);
+		if ( '.' == *pszField )
+		{
+			nFrac = 0;
+			continue;
+		}
+		nVal = nVal * 10 + ( *pszField - '0' );
+		if ( nFrac >= 0 )
+			++nFrac;
 	}
-	++(*ppszThisStr);
+	if ( nFrac < 0 )	//(no point at all)
+		nFrac = 0;
+	for ( ; nFrac < 2; ++nFrac )
+	{
+		nVal *= 10;
+	}
+	return nVal;
 }
 
 
-
-GPSProcRetval GPS_process ( const IOStreamIF* pio )
+//lat/lon in ddmm.mmmm or dddmm.mmmm; nDegDigits is 2 or 3.  The result is in
+//micro-degrees, and it is all integer; no soft float.  (Receivers give up to
+//5 places of minutes, which is about 2 cm, so micro-degrees (about 11 cm)
+//loses nothing of practical use.)
+//A malformed field (empty, not digits, or more than two digits of whole
+//minutes, or 60 or more of them) gives -1, which is no fix.  (Capping the
+//digits also means a line-noise field can't overflow the arithmetic.)
+static int32_t _parseDegMinMicro ( const char* pszField, int nLen, int nDegDigits )
 {
-	GPSProcRetval retval;
+	if ( nLen <= nDegDigits )
+		return -1;
+	int32_t nDeg = 0;
+	int nIdx;
+	for ( nIdx = 0; nIdx < nDegDigits; ++nIdx )
+	{
+		if ( pszField[nIdx] < '0' || pszField[nIdx] > '9' )
+			return -1;
+		nDeg = nDeg * 10 + ( pszField[nIdx] - '0' );
+	}
+	//remainder is minutes; take it as micro-minutes (under 60e6; fits).
+	//Places past the sixth are checked, but dropped.
+	int32_t nMicroMin = 0;
+	int nWhole = 0;	//digits before the point
+	int nFrac = -1;	//digits after the point; -1 before we've seen it
+	for ( ; nIdx < nLen; ++nIdx )
+	{
+		if ( '.' == pszField[nIdx] && nFrac < 0 )
+		{
+			nFrac = 0;
+			continue;
+		}
+		if ( pszField[nIdx] < '0' || pszField[nIdx] > '9' )
+			return -1;
+		if ( nFrac < 0 )
+		{
+			if ( ++nWhole > 2 )
+				return -1;
+		}
+		else if ( nFrac < 6 )
+		{
+			++nFrac;
+		}
+		else
+		{
+			continue;
+		}
+		nMicroMin = nMicroMin * 10 + ( pszField[nIdx] - '0' );
+	}
+	if ( nFrac < 0 )	//(no point at all; whole minutes)
+		nFrac = 0;
+	for ( ; nFrac < 6; ++nFrac )
+	{
+		nMicroMin *= 10;
+	}
+	if ( nMicroMin >= 60000000 )
+		return -1;
+	//minutes to degrees, rounded
+	return nDeg * 1000000 + ( nMicroMin + 30 ) / 60;
+}
 
-	//get a tokenized series of strings
-	do
+
+static void _rmcField ( NMEAParser* pthis, int nField, const char* pszField, int nLen )
+{
+	//$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W*6A
+	switch ( nField )
 	{
-		_getSentence ( pio );	//get the command line from the IO stream
-	} while ( '\0' == g_achNMEA0183Sentence[0] );	//skip the empties
-	retval = GPSPROC_SUCCESS;
+	case 0:	//address; new sentence, so forget anything staged
+		memset ( &g_rmcStage, 0, sizeof(g_rmcStage) );
+	break;
 
-//_ledToggleGn();
+	case 1:	//time hhmmss(.sss)
+		if ( nLen >= 6 )	//must have enough stuff
+		{
+			g_rmcStage._nHour = _parse2 ( &pszField[0] );
+			g_rmcStage._nMinute = _parse2 ( &pszField[2] );
+			g_rmcStage._nSecond = _parse2 ( &pszField[4] );
+			g_rmcStage._bTimeValid = 1;
+		}
+	break;
+
+	case 2:	//status
+		g_rmcStage._chStatus = pszField[0];
+	break;
+
+	case 3:	//latitude; first two chars are deg, remainder is minutes
+		g_rmcStage._nLat = _parseDegMinMicro ( pszField, nLen, 2 );
+	break;
+
+	case 4:	//N/S
+		g_rmcStage._chLatHemi = pszField[0];
+	break;
 
-	//The NMEA data is basically CSV, we can do a simple strchr/replace of all
-	//the commas with nul, then treat it as a string sequence.  We will have to
-	//conscientiously not run off the end of buffer.
-	char* pszThisStr = g_achNMEA0183Sentence;
-	for ( ; (pszThisStr = strchr(pszThisStr, ',')); ++pszThisStr )
+	case 5:	//longitude; first three chars are deg, remainder is minutes
+		g_rmcStage._nLon = _parseDegMinMicro ( pszField, nLen, 3 );
+	break;
+
+	case 6:	//E/W
+		g_rmcStage._chLonHemi = pszField[0];
+	break;
+
+	//7 speed over ground, knots; 8 track angle; (not used)
+
+	case 9:	//date ddmmyy
+		if ( nLen >= 6 )	//must have enough stuff
+		{
+			g_rmcStage._nDay = _parse2 ( &pszField[0] );
+			g_rmcStage._nMonth = _parse2 ( &pszField[2] );
+			g_rmcStage._nYear = _parse2 ( &pszField[4] ) + 2000;	//y2.1k
+			g_rmcStage._bDateValid = 1;
+		}
+	break;
+
+	//10, 11 magnetic variation; (not used)
+	}
+}
+
+
+//is the fix we just got good enough to count towards lock.  RMC is the
+//primary indicator, but if the receiver also sends GGA then we further
+//require that it claims a fix there, too (some receivers will say 'A' during
+//dead-reckoning), and it must meet the configured satellites and HDOP.
+static int _isGoodFix ( const PersistentSettings* psettings, const GPSFix* pfix )
+{
+	if ( 'A' != g_rmcStage._chStatus )
+		return 0;
+	if ( g_rmcStage._nLat < 0 || g_rmcStage._nLon < 0 )	//(a garbled position)
+		return 0;
+	if ( pfix->_nFixQuality < 0 )
+		return 1;	//no GGA; RMC is all we have to go on
+	if ( 0 == pfix->_nFixQuality )
+		return 0;
+	if ( pfix->_nSats < (int) psettings->_nLockMinSats )
+		return 0;
+	if ( 0 != psettings->_nLockMaxHDOP && pfix->_nHDOP > (int) psettings->_nLockMaxHDOP )
+		return 0;
+	return 1;
+}
+
+
+//step the lock state machine with a good or bad fix; returns true if the
+//(debounced) lock state changed.  It takes _nLockAcquire consecutive good
+//fixes to gain lock, and _nLockLose consecutive bad ones to lose it, so that a
+//marginal receiver doesn't cause a storm of RTC sets and reschedules.
+static int _lockStep ( const PersistentSettings* psettings, GPSFix* pfix, int bGood )
+{
+	int bChanged = 0;
+	if ( bGood == pfix->_bLock )
 	{
-		*pszThisStr = '\0';
+		//agrees with the current state; any run towards changing is broken
+		if ( 0 != g_nLockRun )
+		{
+			++g_lockStats._nSuppressed;
+			g_nLockRun = 0;
+		}
 	}
-	pszThisStr = g_achNMEA0183Sentence;
-	//we parse only a couple well-known ones that we care about
-	if ( 0 == strcmp ( pszThisStr, "$GPRMC" ) )
+	else
 	{
-		//$GPRMC,123519,A,4807.038,N,01131.000,E,022.4,084.4,230394,003.1,W*6A
-		//4807.038,N   Latitude 48 deg 07.038' N
-		//01131.000,E  Longitude 11 deg 31.000' E
-		int bLockedStateChanged = 0;
-		nextStr ( &pszThisStr );
-		int nLen = strlen ( pszThisStr );
-		if ( nLen > 4 )	//must have enough stuff
+		uint32_t nNeeded = bGood ? psettings->_nLockAcquire : psettings->_nLockLose;
+		if ( ++g_nLockRun >= nNeeded )
 		{
-			char szHour[3], szMinute[3], * pszSecond;
-			szHour[0] = pszThisStr[0];
-			szHour[1] = pszThisStr[1];
-			szHour[2] = '\0';
-			szMinute[0] = pszThisStr[2];
-			szMinute[1] = pszThisStr[3];
-			szMinute[2] = '\0';
-			pszSecond = &pszThisStr[4];
-
-			nextStr ( &pszThisStr );
-			char* pszStatus = pszThisStr;
-			nextStr ( &pszThisStr );
-			char* pszLat = pszThisStr;
-			nextStr ( &pszThisStr );
-			char* pszLatHemi = pszThisStr;
-			nextStr ( &pszThisStr );
-			char* pszLon = pszThisStr;
-			nextStr ( &pszThisStr );
-			char* pszLonHemi = pszThisStr;
-			nextStr ( &pszThisStr );
-			//char* pszSpeedKnots = pszThisStr;
-			nextStr ( &pszThisStr );
-			//char* pszTrackAngle = pszThisStr;
-
-			if ( 'A' == *pszStatus )
-			{
-				//first two chars are deg
-				//remainder is minutes
-				g_fLat = pszLat[0]-'0';
-				g_fLat *= 10;
-				g_fLat += pszLat[1]-'0';
-				float fmin = my_strtof(&pszLat[2], NULL);
-				g_fLat += fmin/60;
-				if ( 'S' == *pszLatHemi )	//+ is N, - is S
-				{
-					g_fLat *= -1;
-				}
-
-				//first three chars are deg
-				//remainder is minute
-				g_fLon = pszLon[0]-'0';
-				g_fLon *= 10;
-				g_fLon += pszLon[1]-'0';
-				g_fLon *= 10;
-				g_fLon += pszLon[2]-'0';
-				fmin = my_strtof(&pszLon[3], NULL);
-				g_fLon += fmin/60;
-				if ( 'W' == *pszLonHemi )	//+ is E, - is W
-				{
-					g_fLon *= -1;
-				}
-
-				bLockedStateChanged = ( 0 == g_bLock );	//take note if we changed
-				g_bLock = 1;
-			}
+			pfix->_bLock = bGood;
+			g_nLockRun = 0;
+			if ( bGood )
+				++g_lockStats._nAcquired;
 			else
-			{
-				bLockedStateChanged = ( 0 != g_bLock );	//take note if we changed
-				g_bLock = 0;
-			}
-
-			nextStr ( &pszThisStr );
-			nLen = strlen ( pszThisStr );
-			if ( nLen > 5 )	//must have enough stuff
-			{
-				char szDate[3], szMonth[3], * pszYear;
-				szDate[0] = pszThisStr[0];
-				szDate[1] = pszThisStr[1];
-				szDate[2] = '\0';
-				szMonth[0] = pszThisStr[2];
-				szMonth[1] = pszThisStr[3];
-				szMonth[2] = '\0';
-				pszYear = &pszThisStr[4];
-
-				nextStr ( &pszThisStr );
-				//char* pszMagVar = pszThisStr;
-				nextStr ( &pszThisStr );
-				//char* pszMagVarHemi = pszThisStr;
-
-				g_nGPSHour = my_atol(szHour,NULL);
-				g_nGPSMinute = my_atol(szMinute,NULL);
-				g_nGPSSecond = my_atol(pszSecond,NULL);
-				g_nGPSDay = my_atol(szDate,NULL);
-				g_nGPSMonth = my_atol(szMonth,NULL);
-				g_nGPSYear = my_atol(pszYear,NULL) + 2000;	//y2.1k
-			}
-
-			//now that we're done parsing, if the lock state changed, tell the
-			//WSPR task
-			if ( bLockedStateChanged )
-			{
-				xTaskNotify ( g_thWSPR, TNB_WSPR_GPSLOCK, eSetBits );
-			}
+				++g_lockStats._nLost;
+			bChanged = 1;
+		}
+	}
+	return bChanged;
+}
+
+
+static void _rmcCommit ( NMEAParser* pthis )
+{
+	if ( ! g_rmcStage._bTimeValid )	//must have enough stuff
+		return;
+
+	PersistentSettings* psettings = Settings_getStruct();
+	GPSFix* pfix = _fixBegin();
+	if ( g_bForgetLock )
+	{
+		pfix->_bLock = 0;
+		g_nLockRun = 0;
+		g_bForgetLock = 0;
+	}
+
+	//this fix is good or not; then the lock state machine debounces that
+	int bGood = _isGoodFix ( psettings, pfix );
+	if ( bGood )
+	{
+		pfix->_nLatMicro = ( 'S' == g_rmcStage._chLatHemi ) ? -g_rmcStage._nLat : g_rmcStage._nLat;	//+ is N, - is S
+		pfix->_nLonMicro = ( 'W' == g_rmcStage._chLonHemi ) ? -g_rmcStage._nLon : g_rmcStage._nLon;	//+ is E, - is W
+	}
+	int bLockedStateChanged = _lockStep ( psettings, pfix, bGood );
+
+	//if we're tracking a moving platform, tell the WSPR task when we have
+	//left our grid square.  (On a lock change, it will update the grid
+	//anyway.)
+	int bGridChanged = pfix->_bLock && bGood && ! bLockedStateChanged &&
+			psettings->_bTrackGrid && psettings->_bUseGPS &&
+			! inMaidenhead ( psettings->_achMaidenhead,
+					pfix->_nLatMicro, pfix->_nLonMicro,
+					GRID_HYSTERESIS_MICRO );
+
+	if ( g_rmcStage._bDateValid )
+	{
+		pfix->_nHour = g_rmcStage._nHour;
+		pfix->_nMinute = g_rmcStage._nMinute;
+		pfix->_nSecond = g_rmcStage._nSecond;
+		pfix->_nDay = g_rmcStage._nDay;
+		pfix->_nMonth = g_rmcStage._nMonth;
+		pfix->_nYear = g_rmcStage._nYear;
+	}
+
+	//publish before we notify, so the WSPR task sees what we decided on
+	_fixPublish();
+
+	if ( bGridChanged )
+	{
+		xTaskNotify ( g_thWSPR, TNB_WSPR_GRIDCHANGE, eSetBits );
+	}
+
+	//now that we're done, if the lock state changed, tell the WSPR task
+	if ( bLockedStateChanged )
+	{
+		xTaskNotify ( g_thWSPR, TNB_WSPR_GPSLOCK, eSetBits );
+	}
+}
+
+
+/*
+$GPGGA
+Global Positioning System Fix Data
+
+eg. $GPGGA,123519,4807.038,N,01131.000,E,1,08,0.9,545.4,M,46.9,M,,*47
+
+           123519       Fix taken at 12:35:19 UTC
+           4807.038,N   Latitude 48 deg 07.038' N
+           01131.000,E  Longitude 11 deg 31.000' E
+           1            Fix quality: 0 = invalid, 1 = GPS fix, 2 = DGPS fix, ...
+           08           Number of satellites being tracked
+           0.9          Horizontal dilution of position
+           545.4,M      Altitude, Metres, above mean sea level
+           46.9,M       Height of geoid (mean sea level) above WGS84 ellipsoid
+           (empty)      time in seconds since last DGPS update
+           (empty)      DGPS station ID number
+*/
+
+
+//the GGA values, staged
+typedef struct GGAStage GGAStage;
+struct GGAStage
+{
+	int _nFixQuality;
+	int _nSats;
+	int _nHDOP;		//x 100
+	int _nAltitude;	//meters (MSL)
+};
+static GGAStage g_ggaStage;
+
+
+static void _ggaField ( NMEAParser* pthis, int nField, const char* pszField, int nLen )
+{
+	switch ( nField )
+	{
+	case 0:	//address; new sentence, so forget anything staged
+		memset ( &g_ggaStage, 0, sizeof(g_ggaStage) );
+	break;
+
+	//1 time, 2-5 lat/lon; (we take those from RMC)
+
+	case 6:	//fix quality
+		g_ggaStage._nFixQuality = atoi ( pszField );
+	break;
+
+	case 7:	//satellites in use
+		g_ggaStage._nSats = atoi ( pszField );
+	break;
+
+	case 8:	//HDOP
+		g_ggaStage._nHDOP = _parseHundredths ( pszField );
+	break;
+
+	case 9:	//altitude (units are field 10, and are always 'M')
+		g_ggaStage._nAltitude = atoi ( pszField );
+	break;
+
+	//11, 12 geoid height; 13, 14 DGPS; (not used)
+	}
+}
+
+
+static void _ggaCommit ( NMEAParser* pthis )
+{
+	GPSFix* pfix = _fixBegin();
+	pfix->_nFixQuality = g_ggaStage._nFixQuality;
+	pfix->_nSats = g_ggaStage._nSats;
+	pfix->_nHDOP = g_ggaStage._nHDOP;
+	pfix->_nAltitude = g_ggaStage._nAltitude;
+	_fixPublish();
+	//(the lock decision is made on the next RMC)
+}
+
+
+
+/*
+$GPZDA
+Date & Time
+
+eg. $GPZDA,201530.00,04,07,2002,00,00*60
+
+           201530.00    UTC time
+           04           day, 01 to 31
+           07           month, 01 to 12
+           2002         year
+           00           local zone hours, -13 to 13
+           00           local zone minutes, 00 to 59
+*/
+
 
+//the ZDA values, staged
+typedef struct ZDAStage ZDAStage;
+struct ZDAStage
+{
+	int _bTimeValid;
+	int _nHour;
+	int _nMinute;
+	int _nSecond;
+	int _nDay;
+	int _nMonth;
+	int _nYear;
+	int _nTzHour;
+	int _nTzMinute;
+};
+static ZDAStage g_zdaStage;
+
+
+static void _zdaField ( NMEAParser* pthis, int nField, const char* pszField, int nLen )
+{
+	switch ( nField )
+	{
+	case 0:	//address; new sentence, so forget anything staged
+		memset ( &g_zdaStage, 0, sizeof(g_zdaStage) );
+	break;
+
+	case 1:	//time hhmmss(.ss)
+		if ( nLen >= 6 )	//must have enough stuff
+		{
+			g_zdaStage._nHour = _parse2 ( &pszField[0] );
+			g_zdaStage._nMinute = _parse2 ( &pszField[2] );
+			g_zdaStage._nSecond = _parse2 ( &pszField[4] );
+			g_zdaStage._bTimeValid = 1;
 		}
+	break;
+
+	case 2:	//day
+		g_zdaStage._nDay = atoi ( pszField );
+	break;
+
+	case 3:	//month
+		g_zdaStage._nMonth = atoi ( pszField );
+	break;
+
+	case 4:	//year (all four digits)
+		g_zdaStage._nYear = atoi ( pszField );
+	break;
+
+	case 5:	//local zone hours
+		g_zdaStage._nTzHour = atoi ( pszField );
+	break;
+
+	case 6:	//local zone minutes
+		g_zdaStage._nTzMinute = atoi ( pszField );
+	break;
 	}
+}
+
+
+static void _zdaCommit ( NMEAParser* pthis )
+{
+	//receivers send empty fields until they have the time from the sky
+	if ( ! g_zdaStage._bTimeValid || 0 == g_zdaStage._nYear ||
+			0 == g_zdaStage._nDay || 0 == g_zdaStage._nMonth )
+		return;
+
+	GPSFix* pfix = _fixBegin();
+	pfix->_nHour = g_zdaStage._nHour;
+	pfix->_nMinute = g_zdaStage._nMinute;
+	pfix->_nSecond = g_zdaStage._nSecond;
+	pfix->_nDay = g_zdaStage._nDay;
+	pfix->_nMonth = g_zdaStage._nMonth;
+	pfix->_nYear = g_zdaStage._nYear;
+	pfix->_nTzHour = g_zdaStage._nTzHour;
+	pfix->_nTzMinute = g_zdaStage._nTzMinute;
+	_fixPublish();
+}
+
+
+
+/*
+$GPGSA
+GPS DOP and active satellites
+
+eg. $GPGSA,A,3,04,05,,09,12,,,24,,,,,2.5,1.3,2.1*39
+
+           A            Auto selection of 2D or 3D fix (M = manual)
+           3            3D fix - values include: 1 = no fix, 2 = 2D, 3 = 3D
+           04,05...     PRNs of satellites used for fix (12 fields)
+           2.5          PDOP (dilution of precision)
+           1.3          Horizontal dilution of precision (HDOP)
+           2.1          Vertical dilution of precision (VDOP)
+*/
+
+
+//the GSA values, staged
+typedef struct GSAStage GSAStage;
+struct GSAStage
+{
+	int _nFixType;
+	int _nPDOP;		//x 100
+};
+static GSAStage g_gsaStage;
+
+
+static void _gsaField ( NMEAParser* pthis, int nField, const char* pszField, int nLen )
+{
+	switch ( nField )
+	{
+	case 0:	//address; new sentence, so forget anything staged
+		memset ( &g_gsaStage, 0, sizeof(g_gsaStage) );
+	break;
+
+	case 2:	//fix type
+		g_gsaStage._nFixType = atoi ( pszField );
+	break;
+
+	//3-14 satellite PRNs; (not used)
+
+	case 15:	//PDOP
+		g_gsaStage._nPDOP = _parseHundredths ( pszField );
+	break;
+
+	//16 HDOP (we take that from GGA); 17 VDOP (not used)
+	}
+}
+
+
+static void _gsaCommit ( NMEAParser* pthis )
+{
+	//(multi-constellation receivers send one of these per constellation;
+	//they all carry the same combined fix type and DOPs, so last one wins)
+	GPSFix* pfix = _fixBegin();
+	pfix->_nFixType = g_gsaStage._nFixType;
+	pfix->_nPDOP = g_gsaStage._nPDOP;
+	_fixPublish();
+}
+
+
+
+//the sentences we are interested in; everything else is skipped.  These are
+//keyed by sentence id only; any talker is accepted.  The parser rejects
+//unknown sentences on the first byte of the id that matches none of these.
+static NMEASentenceStats g_nssRMC;
+static NMEASentenceStats g_nssGGA;
+static NMEASentenceStats g_nssZDA;
+static NMEASentenceStats g_nssGSA;
+static const NMEASentenceDef g_asNMEADefs[] =
+{
+	{ "RMC", _rmcField, _rmcCommit, &g_nssRMC },
+	{ "GGA", _ggaField, _ggaCommit, &g_nssGGA },
+	{ "ZDA", _zdaField, _zdaCommit, &g_nssZDA },
+	{ "GSA", _gsaField, _gsaCommit, &g_nssGSA },
+};
+
+static NMEAParser g_nmeaParser;
+
+
+
+//get the good/bad statistics for the sentence types we parse; nIdx from 0
+//returns 0 when nIdx is past the end
+int GPS_getSentenceStats ( size_t nIdx, const char** ppszName, NMEASentenceStats* pstats )
+{
+	if ( nIdx >= COUNTOF(g_asNMEADefs) )
+		return 0;
+	*ppszName = g_asNMEADefs[nIdx]._pszSentence;
+	taskENTER_CRITICAL();
+	*pstats = *g_asNMEADefs[nIdx]._pstats;
+	taskEXIT_CRITICAL();
+	return 1;
+}
+
+
+
+//receive interrupt rate measurement; the 'before' is the rate from startup
+//until we configured the receiver, and the 'now' is the rate since then
+static uint32_t g_nRxIrqRateBefore;	//per second; 0 if not configured
+static uint32_t g_tsRxIrqBase;		//start of the current measurement
+static uint32_t g_nRxIrqBase;
+
+
+//the receive interrupt rates (per second) before the receiver was configured
+//(0 if it wasn't) and since then
+void GPS_getRxInterruptRates ( uint32_t* pnBefore, uint32_t* pnNow )
+{
+	uint32_t tsElapsed = HAL_GetTick() - g_tsRxIrqBase;
+	*pnBefore = g_nRxIrqRateBefore;
+	*pnNow = ( 0 == tsElapsed ) ? 0 :
+			(uint32_t) ( (uint64_t)( UART1_rxInterrupts() - g_nRxIrqBase ) * 1000 / tsElapsed );
+}
+
+
+//send the receiver the UBX configuration to quiet it down
+static void _configureUBX ( void )
+{
+	//note the 'before' rate, and restart the measurement
+	uint32_t nUnconfigured, nRate;
+	GPS_getRxInterruptRates ( &nUnconfigured, &nRate );
+	g_nRxIrqRateBefore = ( 0 != nRate ) ? nRate : 1;	//(so it reads as 'configured')
+
+	//keep the bit rate we're currently running at
+	const UART_HandleTypeDef* phuart = (const UART_HandleTypeDef*) g_pGPSIOIf->huart;
+	UBX_configureMinimalNMEA ( g_pGPSIOIf, phuart->Init.BaudRate );
+
+	g_tsRxIrqBase = HAL_GetTick();
+	g_nRxIrqBase = UART1_rxInterrupts();
+}
+
+
 
+//bit rate change requests from other tasks
+static volatile uint32_t g_nBitRateRequested;
+static volatile GPSBitRateResult g_nBitRateResult;
+
+
+//total good sentences (of any type) so far
+static uint32_t _goodSentences ( void )
+{
+	uint32_t nGood = 0;
+	size_t nIdx;
+	for ( nIdx = 0; nIdx < COUNTOF(g_asNMEADefs); ++nIdx )
+	{
+		nGood += g_asNMEADefs[nIdx]._pstats->_nGood;
+	}
+	return nGood;
+}
+
+
+//the bit rate we are currently running the link at
+static uint32_t _currentBitRate ( void )
+{
+	return ( (const UART_HandleTypeDef*) g_pGPSIOIf->huart )->Init.BaudRate;
+}
+
+
+//listen at the current bit rate for valid (checksummed) sentences; true if we
+//heard some
+static int _syncCheck ( void )
+{
+	uint32_t nGoodStart = _goodSentences();
+	uint32_t tsStart = HAL_GetTick();
+	while ( HAL_GetTick() - tsStart < GPS_SYNC_TIMEOUT_MS )
+	{
+		uint32_t ulNotificationValue;
+		xTaskNotifyWait( pdFALSE,	//Don't clear bits on entry.
+				TNB_DAV,	//Clear only data available on exit.
+				&ulNotificationValue,	//Stores the notified value.
+				pdMS_TO_TICKS(100) );
+		GPS_drain ( g_pGPSIOIf );
+		if ( _goodSentences() - nGoodStart >= GPS_SYNC_SENTENCES )
+			return 1;
+	}
+	return 0;
+}
+
+
+//change our end of the link
+static void _setLocalBitRate ( uint32_t nBitRate )
+{
+	//let anything we've sent the receiver finish going out at the old rate
+	while ( ! UART1_transmitIdle() )
+	{
+		osDelay ( 5 );
+	}
+	UART1_setBitRate ( nBitRate );
+	GPS_resetParser();	//(whatever was partial is garbage)
+}
+
+
+//tell the receiver to change its bit rate (we send at the current rate)
+static void _sendBitRateCommand ( const PersistentSettings* psettings, uint32_t nBitRate )
+{
+	if ( psettings->_bGPSConfigUBX )
+	{
+		UBX_setPortNMEA ( g_pGPSIOIf, nBitRate );
+	}
 	else
 	{
-		//unknown sentence
+		//MediaTek style:  $PMTK251,<rate>*hh
+		char ach[24];
+		char* pch = ach;
+		strcpy ( pch, "$PMTK251," );
+		pch += strlen ( pch );
+		pch = my_itoa_sortof ( pch, nBitRate, 0 );
+		uint8_t byCk = 0;
+		const char* pchCk;
+		for ( pchCk = &ach[1]; pchCk != pch; ++pchCk )
+		{
+			byCk ^= (uint8_t) *pchCk;
+		}
+		*pch++ = '*';
+		*pch++ = "0123456789ABCDEF"[byCk >> 4];
+		*pch++ = "0123456789ABCDEF"[byCk & 0x0f];
+		*pch++ = '\r';
+		*pch++ = '\n';
+		g_pGPSIOIf->_transmitCompletely ( g_pGPSIOIf, ach, pch - ach, 500 );
 	}
+}
+
+
+//switch the receiver and ourselves to the new rate, and verify that we can
+//hear it; if we can't, go back to the old one.
+static GPSBitRateResult _changeBitRate ( const PersistentSettings* psettings, uint32_t nBitRate )
+{
+	uint32_t nOld = _currentBitRate();
+	if ( nOld == nBitRate )
+		return GPS_BITRATE_OK;
+
+	_sendBitRateCommand ( psettings, nBitRate );
+	_setLocalBitRate ( nBitRate );
+	if ( _syncCheck() )
+		return GPS_BITRATE_OK;
+
+	//didn't work; go back.  (If we can't hear it there, either, then the
+	//receiver must have switched after all, and we just didn't hear it for
+	//some other reason, so we'd best stay at the new rate.)
+	_setLocalBitRate ( nOld );
+	if ( _syncCheck() )
+		return GPS_BITRATE_FAILED;
+	_setLocalBitRate ( nBitRate );
+	return GPS_BITRATE_UNHEARD;
+}
 
-	return retval;
+
+//get onto the configured bit rate at startup.  The receiver boots at its
+//default rate, unless it has kept the one we set before (many have battery-
+//backed configuration), so we try the configured rate first.
+static void _startupBitRate ( const PersistentSettings* psettings )
+{
+	uint32_t nBoot = _currentBitRate();
+	uint32_t nWant = psettings->_nGPSbitRate;
+	if ( nWant == nBoot )
+		return;
+
+	_setLocalBitRate ( nWant );
+	if ( _syncCheck() )
+		return;	//it remembered
+
+	_setLocalBitRate ( nBoot );
+	_changeBitRate ( psettings, nWant );
 }
 
 
+//change the bit rate to the receiver (from another task); this waits for the
+//GPS task to do it
+GPSBitRateResult GPS_changeBitRate ( uint32_t nBitRate, uint32_t to )
+{
+	g_nBitRateResult = GPS_BITRATE_PENDING;
+	g_nBitRateRequested = nBitRate;
+	xTaskNotify ( g_thGPS, TNB_GPS_BITRATE, eSetBits );
+
+	uint32_t tsStart = HAL_GetTick();
+	while ( GPS_BITRATE_PENDING == g_nBitRateResult && HAL_GetTick() - tsStart < to )
+	{
+		osDelay ( 50 );
+	}
+	return g_nBitRateResult;
+}
+
+
+
 //XXX might want to have these direct to whatever device based on config
 void UART1_DataAvailable ( void )
 {
@@ -306,17 +928,67 @@ void UART1_TransmitEmpty ( void )
 //implementation for the gps processor
 
 
+//(re)start the sentence parser from scratch
+void GPS_resetParser ( void )
+{
+	NMEA_init ( &g_nmeaParser, g_asNMEADefs, COUNTOF(g_asNMEADefs), NULL );
+}
+
+
+//take everything available on the stream, in chunks straight into the parser
+void GPS_drain ( const IOStreamIF* pio )
+{
+	uint8_t abyChunk[32];
+	size_t nRead;
+	while ( 0 != ( nRead = pio->_receive ( pio, abyChunk, sizeof(abyChunk) ) ) )
+	{
+		NMEA_feed ( &g_nmeaParser, abyChunk, nRead );
+	}
+}
+
+
 
 void thrdfxnGPSTask ( void const* argument )
 {
+	GPS_resetParser();
+
+	//get onto the bit rate that has been configured
+	PersistentSettings* psettings = Settings_getStruct();
+	if ( psettings->_bUseGPS )
+	{
+		_startupBitRate ( psettings );
+	}
+
+	//we'll configure the receiver after it has settled a bit
+	int bUBXPending = psettings->_bUseGPS && psettings->_bGPSConfigUBX;
+	g_tsRxIrqBase = HAL_GetTick();
+	g_nRxIrqBase = UART1_rxInterrupts();
+
 	for(;;)
 	{
-		while ( GPSPROC_QUIT != GPS_process ( g_pGPSIOIf ) )
+		//wait for data to arrive (UART1_DataAvailable() tells us).  (If we
+		//still need to configure the receiver, don't sleep forever.)
+		uint32_t ulNotificationValue;
+		xTaskNotifyWait( pdFALSE,	//Don't clear bits on entry.
+				0xffffffff,	//Clear all bits on exit.
+				&ulNotificationValue,	//Stores the notified value.
+				bUBXPending ? pdMS_TO_TICKS(100) : portMAX_DELAY );
+
+		if ( bUBXPending && HAL_GetTick() - g_tsRxIrqBase >= GPS_UBX_SETTLE_MS )
 		{
-			//XXX
+			_configureUBX();
+			bUBXPending = 0;
 		}
-	}
-}
-
 
+		//someone wants a different bit rate
+		if ( ulNotificationValue & TNB_GPS_BITRATE )
+		{
+			g_nBitRateResult = _changeBitRate ( psettings, g_nBitRateRequested );
+		}
 
+		//then take all that we've got.  (more may arrive while we do this;
+		//that will leave a notification pending, so we'll come right back
+		//around)
+		GPS_drain ( g_pGPSIOIf );
+	}
+}
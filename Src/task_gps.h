@@ -1,10 +1,10 @@
 //the task that handles incoming GPS NMEA data
 //This is part of the CarelessWSPR project.
 //Note:  no effort has been made to make this a general-purpose NMEA processor;
-//in particular we only parse the few messages in which we are interested, and
-//moreover for the GPS device we are particularly using.  If you use a
-//different GPS module, you'll probably want to review and possibly change the
-//parsing done in GPS_process() to handle any different messages for your unit.
+//in particular we only parse the few messages in which we are interested
+//(RMC, GGA, ZDA, GSA, from any talker).  If you use a different GPS module,
+//you'll probably want to review the sentence table in task_gps.c to handle
+//any different messages for your unit.
 
 #ifndef __TASK_GPS_H
 #define __TASK_GPS_H
@@ -16,6 +16,7 @@ extern "C" {
 #include "cmsis_os.h"
 #include "system_interfaces.h"
 #include "task_notification_bits.h"
+#include "nmea_parser.h"
 
 extern osThreadId g_thGPS;
 extern uint32_t g_tbGPS[ 128 ];
@@ -23,19 +24,90 @@ extern osStaticThreadDef_t g_tcbGPS;
 
 extern const IOStreamIF* g_pGPSIOIf;	//the IO device to which the monitor is attached
 
-extern volatile int g_bLock;		//if we have a GPS lock
+//what we know from the GPS; this is always read as a whole (see GPS_getFix())
+//so that the parts are consistent with each other
+typedef struct GPSFix GPSFix;
+struct GPSFix
+{
+	int _bLock;			//if we have a GPS lock
 
-extern volatile int g_nGPSHour;		//UTC time from satellites
-extern volatile int g_nGPSMinute;
-extern volatile int g_nGPSSecond;
-extern volatile int g_nGPSMonth;
-extern volatile int g_nGPSDay;
-extern volatile int g_nGPSYear;
-extern volatile int g_nGPSTzHour;
-extern volatile int g_nGPSTzMinute;
+	int _nHour;			//UTC time from satellites
+	int _nMinute;
+	int _nSecond;
+	int _nMonth;
+	int _nDay;
+	int _nYear;
+	int _nTzHour;		//local zone (from ZDA, if sent)
+	int _nTzMinute;
 
-extern volatile float g_fLat;	//+ is N, - is S
-extern volatile float g_fLon;	//+ is E, - is W
+	int32_t _nLatMicro;	//micro-degrees; + is N, - is S
+	int32_t _nLonMicro;	//micro-degrees; + is E, - is W
+
+	int _nFixQuality;	//from GGA; 0 is none, -1 is no GGA seen
+	int _nSats;			//satellites in use
+	int _nHDOP;			//x 100
+	int _nAltitude;		//meters (MSL)
+	int _nFixType;		//from GSA; 1 is none, 2 is 2D, 3 is 3D
+	int _nPDOP;			//x 100
+};
+
+
+//get a coherent snapshot of the current fix; returns its generation (which
+//changes every time any part of it is updated).  This does not block.
+uint32_t GPS_getFix ( GPSFix* pfix );
+
+//forget that we have a lock, so that the next good fix will notify the WSPR
+//task of lock anew
+void GPS_forgetLock ( void );
+
+
+//lock state machine statistics
+typedef struct GPSLockStats GPSLockStats;
+struct GPSLockStats
+{
+	uint32_t _nAcquired;	//lock gained (WSPR task notified)
+	uint32_t _nLost;		//lock lost (WSPR task notified)
+	uint32_t _nSuppressed;	//runs of good/bad fixes too short to change state
+};
+
+void GPS_getLockStats ( GPSLockStats* pstats );
+void GPS_resetLockStats ( void );
+
+
+//get the good/bad statistics for the sentence types we parse; nIdx from 0
+//returns 0 when nIdx is past the end
+int GPS_getSentenceStats ( size_t nIdx, const char** ppszName, NMEASentenceStats* pstats );
+
+//the receive interrupt rates (per second) before the receiver was configured
+//via UBX (0 if it wasn't) and since then
+void GPS_getRxInterruptRates ( uint32_t* pnBefore, uint32_t* pnNow );
+
+
+//how a bit rate change went
+typedef enum GPSBitRateResult GPSBitRateResult;
+enum GPSBitRateResult
+{
+	GPS_BITRATE_PENDING = -1,	//the GPS task hadn't finished when we gave up waiting
+	GPS_BITRATE_FAILED = 0,		//the receiver didn't follow; we went back to the old rate
+	GPS_BITRATE_OK = 1,			//the receiver followed, and we can hear it
+	GPS_BITRATE_UNHEARD = 2,	//we can't hear it at either rate, so we stayed at the new one
+};
+
+//change the bit rate to the receiver (called from another task); this tells
+//the receiver, follows it, and verifies that we can hear it (going back if
+//not).  It waits up to 'to' ms for the GPS task to do that.
+GPSBitRateResult GPS_changeBitRate ( uint32_t nBitRate, uint32_t to );
+
+
+//(re)start the sentence parser from scratch
+void GPS_resetParser ( void );
+
+//parse everything that is available now on the stream; the results are
+//published (GPS_getFix()) and the WSPR task notified as sentences complete.
+//The GPS task calls this whenever data arrives, but it does not depend on the
+//task, so recorded receiver output can be replayed through it (from a stream
+//that reads from memory) at full speed.
+void GPS_drain ( const IOStreamIF* pio );
 
 
 void thrdfxnGPSTask ( void const* argument );
@@ -3,28 +3,83 @@
 #include "task_monitor.h"
 #include "command_processor.h"
 #include "CarelessWSPR_commands.h"
+#include "serial_devices.h"
 
 #include <string.h>
 
 
+#ifndef COUNTOF
+#define COUNTOF(arr) (sizeof(arr)/sizeof(arr[0]))
+#endif
+
+
 //the task that runs an interactive monitor on the USB data
 osThreadId g_thMonitor = NULL;
 uint32_t g_tbMonitor[ 128 ];
 osStaticThreadDef_t g_tcbMonitor;
 
 
-const IOStreamIF* g_pMonitorIOIf = NULL;	//the IO device to which the monitor is attached
+//the IO devices to which the monitor can be attached.  Each has its own
+//command line, so the same monitor can serve them all at once.
+typedef struct MonitorPort MonitorPort;
+struct MonitorPort
+{
+	const IOStreamIF* _pio;
+	uint32_t _nPortBit;	//MONITOR_PORT_xxx
+	int _bCanConnect;	//we get TNB_CLIENT_CONNECT for this one
+	CmdProcLine _line;
+};
+
+static MonitorPort _ampPorts[] =
+{
+	{ &g_pifCDC, MONITOR_PORT_CDC, 1 },
+	{ &g_pifUART2, MONITOR_PORT_UART2, 0 },
+};
+
+static uint32_t _nBoundPorts;	//MONITOR_PORT_xxx; the ones we are serving
+static uint32_t _nGreetPorts;	//newly bound ones that should be greeted
 
 
 
 //====================================================
 //Monitor task
 //The monitor is a command processing interface attached to the USB CDC virtual
-//serial port.  It processes incoming commands from the user.
+//serial port, and/or UART2.  It processes incoming commands from the user.
+
+
+
+void Monitor_setPorts ( uint32_t nPorts )
+{
+	size_t nIdx;
+	nPorts &= MONITOR_PORT_ALL;
+	for ( nIdx = 0; nIdx < COUNTOF(_ampPorts); ++nIdx )
+	{
+		MonitorPort* pmp = &_ampPorts[nIdx];
+		if ( ( nPorts & pmp->_nPortBit ) && ! ( _nBoundPorts & pmp->_nPortBit ) )
+		{
+			//(start with a clean line, and whatever is in the pipe is stale)
+			pmp->_pio->_flushReceive ( pmp->_pio );
+			pmp->_line._nIdxCmd = 0;
+			if ( ! pmp->_bCanConnect )
+				_nGreetPorts |= pmp->_nPortBit;
+		}
+	}
+	_nBoundPorts = nPorts;
+	//if the task is running, get it to do the greetings
+	if ( NULL != g_thMonitor && 0 != _nGreetPorts )
+		xTaskNotify ( g_thMonitor, TNB_MONITOR_GREET, eSetBits );
+}
+
+
+uint32_t Monitor_getPorts ( void )
+{
+	return _nBoundPorts;
+}
 
 
 
-//XXX might want to have these direct to whatever device based on config
+//(these are all the same for each of the ports; the task works out which
+//have something for it)
 void USBCDC_DataAvailable ( void )
 {
 	//YYY you could use this opportunity to signal an event
@@ -38,7 +93,6 @@ void USBCDC_DataAvailable ( void )
 }
 
 
-//XXX might want to have these direct to whatever device based on config
 void USBCDC_TransmitEmpty ( void )
 {
 	//YYY you could use this opportunity to signal an event
@@ -52,12 +106,32 @@ void USBCDC_TransmitEmpty ( void )
 }
 
 
-//implementation for the command processor; bind IO to the USB CDC port
+void UART2_DataAvailable ( void )
+{
+	USBCDC_DataAvailable();
+}
+
+
+void UART2_TransmitEmpty ( void )
+{
+	USBCDC_TransmitEmpty();
+}
+
+
+
+//implementation for the command processor; bind IO to the ports
 
 
 void thrdfxnMonitorTask ( void const* argument )
 {
-	uint32_t msWait = 1000;
+	size_t nIdx;
+
+	//greet the ports that won't tell us when someone connects (but only once
+	//there's a task to do it)
+	if ( 0 != _nGreetPorts )
+		xTaskNotify ( g_thMonitor, TNB_MONITOR_GREET, eSetBits );
+
+	//we only have work when a port has something for us, so wait forever
 	for(;;)
 	{
 		//wait on various task notifications
@@ -65,19 +139,43 @@ void thrdfxnMonitorTask ( void const* argument )
 		BaseType_t xResult = xTaskNotifyWait( pdFALSE,	//Don't clear bits on entry.
 				0xffffffff,	//Clear all bits on exit.
 				&ulNotificationValue,	//Stores the notified value.
-				pdMS_TO_TICKS(msWait) );
+				portMAX_DELAY );
 		if( xResult == pdPASS )
 		{
-			//if we got a new client connection, do a greeting
+			//if we got a new client connection, do a greeting.  (The USB
+			//tells us about that; the others are greeted when bound.)
+			uint32_t nGreet = 0;
 			if ( ulNotificationValue & TNB_CLIENT_CONNECT )
 			{
-				CWCMD_SendGreeting ( g_pMonitorIOIf );
-				CWCMD_SendPrompt ( g_pMonitorIOIf );
+				nGreet |= MONITOR_PORT_CDC;
+			}
+			if ( ulNotificationValue & TNB_MONITOR_GREET )
+			{
+				nGreet |= _nGreetPorts;
+				_nGreetPorts = 0;
+			}
+			for ( nIdx = 0; nIdx < COUNTOF(_ampPorts); ++nIdx )
+			{
+				if ( nGreet & _nBoundPorts & _ampPorts[nIdx]._nPortBit )
+				{
+					CWCMD_SendGreeting ( _ampPorts[nIdx]._pio );
+					CWCMD_SendPrompt ( _ampPorts[nIdx]._pio );
+				}
 			}
 			if ( ulNotificationValue & TNB_DAV )
 			{
-				//we use the non-blocking version in this notification loop
-				CMDPROC_process_nb ( g_pMonitorIOIf, g_aceCommands, g_nAceCommands );
+				//we use the non-blocking version in this notification loop,
+				//on whichever ports have something (all the lines there)
+				for ( nIdx = 0; nIdx < COUNTOF(_ampPorts); ++nIdx )
+				{
+					MonitorPort* pmp = &_ampPorts[nIdx];
+					if ( ! ( _nBoundPorts & pmp->_nPortBit ) )
+						continue;
+					while ( CMDPROC_INCOMPLETE != CMDPROC_process_nb ( pmp->_pio,
+							&pmp->_line, g_aceCommands, g_nAceCommands ) )
+					{
+					}
+				}
 			}
 		}
 	}
@@ -15,7 +15,16 @@ extern osThreadId g_thMonitor;
 extern uint32_t g_tbMonitor[ 128 ];
 extern osStaticThreadDef_t g_tcbMonitor;
 
-extern const IOStreamIF* g_pMonitorIOIf;	//the IO device to which the monitor is attached
+//the ports the monitor can be attached to; any combination may be bound
+#define MONITOR_PORT_CDC	0x01	//USB CDC
+#define MONITOR_PORT_UART2	0x02	//UART2; for units without USB access
+#define MONITOR_PORT_ALL	( MONITOR_PORT_CDC | MONITOR_PORT_UART2 )
+
+//attach the monitor to the ports (MONITOR_PORT_xxx bits); call before the
+//task starts, or from the monitor's own commands.  Ports that are newly
+//bound, and which cannot tell us when a client connects, get a greeting.
+void Monitor_setPorts ( uint32_t nPorts );
+uint32_t Monitor_getPorts ( void );
 
 void thrdfxnMonitorTask ( void const* argument );
 
@@ -26,7 +26,7 @@ enum TaskNotificationBits
 {
 	//these are generally used for byte streams events
 	TNB_DAV = 0x00000001,	//data is available (serial receive)
-	TNB_TBMT = 0x00000002,	//transmit buffer is empty (serial send)
+	TNB_TBMT = 0x00000002,	//transmit buffer has room (serial send; the callbacks: is empty)
 	//0x00000004,	//reserved; maybe for errors?
 	//0x00000008,	//reserved; maybe for errors?
 
@@ -36,12 +36,18 @@ enum TaskNotificationBits
 	//bits for the monitor
 	TNB_CLIENT_CONNECT = 0x00010000,	//a client has (probably) connected
 	TNB_CLIENT_DISCONNECT = 0x00020000,	//a client has (probably) disconnected
+	TNB_MONITOR_GREET = 0x00040000,		//greet ports that have just been bound
 
 	//bits for the WSPR process
 	TNB_WSPRSTART = 0x00010000,		//start the transmission
 	TNB_WSPRNEXTBIT = 0x00020000,	//send next bit in transmission
 	TNB_WSPR_GPSLOCK = 0x00040000,	//GPS lock status changed
 	TNB_REFADJ = 0x00080000,		//periodic adjustment of reference output
+	TNB_WSPR_GRIDCHANGE = 0x00100000,	//GPS position left the current grid square
+	TNB_WSPR_RESCHEDULE = 0x00200000,	//the schedule criteria changed, or we were started
+
+	//bits for the GPS process
+	TNB_GPS_BITRATE = 0x00010000,	//change the bit rate to the receiver
 };
 
 
@@ -15,8 +15,11 @@
 #include "task_gps.h"	//for global status
 
 #include "backup_registers.h"
+#include "low_power.h"
+#include "tx_calendar.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 
 #ifndef COUNTOF
@@ -31,17 +34,26 @@ osStaticThreadDef_t g_tcbWSPR;
 
 //the WSPR message we transmit
 uint8_t g_abyWSPR[162];
+//encoder state cached for re-encoding when only the grid or power changes
+static WSPREncodeCache g_wecWSPR = { 0 };
 //state machine
 enum WSPR_FLAGS
 {
 	WF_WSPR = 1,		//should we be WSPR'ing sweet nothings at all
 	WF_REFERENCE = 2,	//should we be emitting a CW tone for calibration
 	WF_REENCODE = 4,	//need to re-encode the WSPR message first
+	WF_CHOSEN = 8,		//the scheduled slot was pre-chosen for transmission
 };
 uint32_t g_nWSPRFlags = 0;	//any of several flags
 int g_nWSPRSymbolIndex;		//which of g_abyWSPR are we on
 uint32_t g_nWSPRBaseFreq;	//this base frequency of this sub-band; Hz
 
+//scheduling statistics
+WSPRSchedStats g_wsstats = { 0 };
+//slots passed over when making the current schedule; these become 'avoided'
+//wakeups only when the schedule actually comes due
+uint32_t g_nWSPRPendingAvoided = 0;
+
 
 
 uint32_t _impl_testFlag ( uint32_t n )
@@ -133,12 +145,37 @@ extern RTC_HandleTypeDef hrtc;	//in main.c
 
 
 
+//decide whether to transmit in a slot, based on the duty cycle
+static int _impl_WSPR_rollDuty ( void )
+{
+	//randomize duty cycle selection
+	int chance = rand() / (RAND_MAX/100);
+	PersistentSettings* psettings = Settings_getStruct();
+	return chance < psettings->_nDutyPct;
+}
+
+
 //cancel any scheduled future WSPR transmissions
 static void _impl_WSPR_CancelSchedule ( void )
 {
+	_impl_clearFlag ( WF_CHOSEN );
+	g_nWSPRPendingAvoided = 0;
 	HAL_PWR_EnableBkUpAccess();	//... and leave it that way
 	HAL_StatusTypeDef ret = HAL_RTC_DeactivateAlarm ( &hrtc, RTC_ALARM_A );
 	(void)ret;
+	LowPower_noteAlarm ( NULL );	//no alarm for low-power idle to restore
+}
+
+
+//is the current slot one we are permitted to transmit in
+static int _impl_WSPR_isSlotPermittedNow ( void )
+{
+	RTC_TimeTypeDef sTime;
+	RTC_DateTypeDef sDate;
+	HAL_RTC_GetTime ( &hrtc, &sTime, RTC_FORMAT_BIN );
+	HAL_RTC_GetDate ( &hrtc, &sDate, RTC_FORMAT_BIN );
+	return TxCal_isPermitted ( Settings_getStruct(), sDate.WeekDay,
+			TXCAL_SLOT ( sTime.Hours, sTime.Minutes ) );
 }
 
 
@@ -149,28 +186,60 @@ static void _impl_WSPR_ScheduleNext ( void )
 
 	//get current time
 	RTC_TimeTypeDef sTime;
+	RTC_DateTypeDef sDate;
 	HAL_RTC_GetTime ( &hrtc, &sTime, RTC_FORMAT_BIN );
+	HAL_RTC_GetDate ( &hrtc, &sDate, RTC_FORMAT_BIN );
 
-	//round up to next even minute start
-	RTC_AlarmTypeDef sAlarm;
-	sAlarm.Alarm = RTC_ALARM_A;
-	sAlarm.AlarmTime = sTime;
-	sAlarm.AlarmTime.Seconds = 0;	//always at start of minute
-	sAlarm.AlarmTime.Minutes = (sAlarm.AlarmTime.Minutes + 2) & 0xfe;
-	if ( sAlarm.AlarmTime.Minutes > 59 )	//check for rollover minute
+	//round up to next even minute start, as a calendar slot
+	int nWeekDay = sDate.WeekDay;
+	int nSlot = TXCAL_SLOT ( sTime.Hours, sTime.Minutes ) + 1;
+	if ( nSlot >= TXCAL_SLOTS )	//check for rollover day
 	{
-		sAlarm.AlarmTime.Minutes -= 60;
-		++sAlarm.AlarmTime.Hours;
+		nSlot = 0;
+		nWeekDay = ( nWeekDay + 1 ) % 7;
 	}
-	if ( sAlarm.AlarmTime.Hours > 23 )	//check for rollover hour
+
+	//skip ahead to the next slot the calendar permits.  If there are none
+	//left today, we check in again at midnight, since it is a new day then
+	//(and the alarm can only be a time-of-day anyway).
+	//In the 'direct' scheduling mode, we also roll the duty cycle dice for
+	//each permitted slot now, rather than when it comes due, and keep going
+	//until we find one that we will actually transmit in.  That way we
+	//don't wake up at all for the slots we would have passed on.
+	PersistentSettings* psettings = Settings_getStruct();
+	for(;;)
 	{
-		sAlarm.AlarmTime.Hours -= 24;
+		nSlot = TxCal_nextPermitted ( psettings, nWeekDay, nSlot );
+		if ( nSlot < 0 )
+		{
+			nSlot = 0;	//midnight check-in
+			break;
+		}
+		if ( WSPR_SCHED_DIRECT != psettings->_nWSPRSchedMode )
+		{
+			break;	//the dice will be rolled when the slot comes due
+		}
+		if ( _impl_WSPR_rollDuty() )
+		{
+			_impl_setFlag ( WF_CHOSEN );
+			break;
+		}
+		++g_nWSPRPendingAvoided;
+		++nSlot;
 	}
 
+	RTC_AlarmTypeDef sAlarm;
+	sAlarm.Alarm = RTC_ALARM_A;
+	sAlarm.AlarmTime = sTime;
+	sAlarm.AlarmTime.Seconds = 0;	//always at start of minute
+	sAlarm.AlarmTime.Minutes = TXCAL_SLOT_MIN ( nSlot );
+	sAlarm.AlarmTime.Hours = TXCAL_SLOT_HOUR ( nSlot );
+
 	//set the alarm
 	HAL_PWR_EnableBkUpAccess();	//... and leave it that way
 	HAL_StatusTypeDef ret = HAL_RTC_SetAlarm_IT ( &hrtc, &sAlarm, RTC_FORMAT_BIN );
 	(void)ret;
+	LowPower_noteAlarm ( &sAlarm.AlarmTime );	//low-power idle borrows it
 }
 
 
@@ -242,7 +311,9 @@ void WSPR_StartWSPR ( void )
 	{
 		WSPR_StopReference();	//these must be mutually exclusive
 		_impl_setFlag ( WF_WSPR );
-		_impl_WSPR_ScheduleNext();
+		//this is called from the monitor, too, so have the WSPR task set up
+		//the schedule, as for WSPR_Reschedule()
+		xTaskNotify ( g_thWSPR, TNB_WSPR_RESCHEDULE, eSetBits );
 	}
 }
 
@@ -260,12 +331,52 @@ void WSPR_ReEncode ( void )
 }
 
 
+void WSPR_getSchedStats ( WSPRSchedStats* pstats )
+{
+	taskENTER_CRITICAL();
+	*pstats = g_wsstats;
+	taskEXIT_CRITICAL();
+}
+
+
+void WSPR_resetSchedStats ( void )
+{
+	taskENTER_CRITICAL();
+	memset ( &g_wsstats, 0, sizeof(g_wsstats) );
+	taskEXIT_CRITICAL();
+}
+
+
+void WSPR_Reschedule ( void )
+{
+	//the schedule state belongs to the WSPR task (a start may be pending
+	//on the choice we'd be throwing away), so have it do the work
+	xTaskNotify ( g_thWSPR, TNB_WSPR_RESCHEDULE, eSetBits );
+}
+
+
+//re-encode the WSPR message from the current settings; this must not be done
+//while transmitting, since it changes the symbols in-place.
+static int _impl_WSPR_ReEncodeNow ( void )
+{
+	PersistentSettings* psettings = Settings_getStruct();
+	if ( wspr_encode_cached ( g_abyWSPR, &g_wecWSPR, psettings->_achCallSign, 
+			psettings->_achMaidenhead, psettings->_nTxPowerDbm ) )
+	{
+		//success!
+		_impl_clearFlag ( WF_REENCODE );
+		return 1;
+	}
+	return 0;
+}
+
+
 //implementation for the WSPR task
 void thrdfxnWSPRTask ( void const* argument )
 {
 	//GPS may have come up before we did, so clear the 'locked' state
-	g_bLock = 0;
-	uint32_t msWait = 1000;
+	GPS_forgetLock();
+	//the RTC alarm and the bit timer drive everything; no periodic wakeup
 	for(;;)
 	{
 		//wait on various task notifications
@@ -273,7 +384,7 @@ void thrdfxnWSPRTask ( void const* argument )
 		BaseType_t xResult = xTaskNotifyWait( pdFALSE,	//Don't clear bits on entry.
 				0xffffffff,	//Clear all bits on exit.
 				&ulNotificationValue,	//Stores the notified value.
-				pdMS_TO_TICKS(msWait) );
+				portMAX_DELAY );
 		if( xResult == pdPASS )
 		{
 
@@ -281,19 +392,21 @@ void thrdfxnWSPRTask ( void const* argument )
 			if ( ulNotificationValue & TNB_WSPR_GPSLOCK )
 			{
 				PersistentSettings* psettings = Settings_getStruct();
-				if ( g_bLock )	//got a lock
+				GPSFix fix;
+				GPS_getFix ( &fix );
+				if ( fix._bLock )	//got a lock
 				{
 					//first, update the RTC time
 					HAL_PWR_EnableBkUpAccess();	//... and leave it that way
 					RTC_TimeTypeDef sTime;
 					RTC_DateTypeDef sDate;
-					sTime.Hours = g_nGPSHour;
-					sTime.Minutes = g_nGPSMinute;
-					sTime.Seconds = g_nGPSSecond;
+					sTime.Hours = fix._nHour;
+					sTime.Minutes = fix._nMinute;
+					sTime.Seconds = fix._nSecond;
 					sDate.WeekDay = RTC_WEEKDAY_SUNDAY;	//(arbitrary)
-					sDate.Date = g_nGPSDay;
-					sDate.Month = g_nGPSMonth;
-					sDate.Year = g_nGPSYear - 2000;
+					sDate.Date = fix._nDay;
+					sDate.Month = fix._nMonth;
+					sDate.Year = fix._nYear - 2000;
 					HAL_RTC_SetTime ( &hrtc, &sTime, RTC_FORMAT_BIN );
 					HAL_RTC_SetDate ( &hrtc, &sDate, RTC_FORMAT_BIN );
 
@@ -312,7 +425,8 @@ void thrdfxnWSPRTask ( void const* argument )
 					if ( psettings->_bUseGPS )	//do we care about GPS?
 					{
 						//now, update the maidenhead
-						toMaidenhead ( g_fLat, g_fLon, psettings->_achMaidenhead, 4 );
+						toMaidenheadMicro ( fix._nLatMicro, fix._nLonMicro,
+								psettings->_achMaidenhead, 4 );
 						_impl_setFlag ( WF_REENCODE );	//because we changed the data
 
 						WSPR_StartWSPR();
@@ -325,22 +439,45 @@ void thrdfxnWSPRTask ( void const* argument )
 				}
 			}
 
+			//if we are tracking and have moved to a new grid square, update it
+			if ( ulNotificationValue & TNB_WSPR_GRIDCHANGE )
+			{
+				PersistentSettings* psettings = Settings_getStruct();
+				GPSFix fix;
+				GPS_getFix ( &fix );
+				char achGrid[5];
+				if ( psettings->_bTrackGrid && fix._bLock &&
+						toMaidenheadMicro ( fix._nLatMicro, fix._nLonMicro, achGrid, 4 ) &&
+						0 != strcmp ( achGrid, psettings->_achMaidenhead ) )
+				{
+					strcpy ( psettings->_achMaidenhead, achGrid );
+					_impl_setFlag ( WF_REENCODE );	//because we changed the data
+					//only the locator changed, so this is a quick partial
+					//re-encode; but we can't change the symbols while they
+					//are being sent, so otherwise it waits until we're done.
+					if ( ! WSPR_isTransmitting() )
+					{
+						_impl_WSPR_ReEncodeNow();
+					}
+				}
+			}
+
 			//if our scheduled WSPR start has occurred, start
 			if ( ulNotificationValue & TNB_WSPRSTART )
 			{
-				int doitnow = _impl_testFlag ( WF_WSPR );
+				//(this might just be a midnight check-in, or the calendar
+				//might have changed since we scheduled, so check again)
+				int doitnow = _impl_testFlag ( WF_WSPR ) &&
+						_impl_WSPR_isSlotPermittedNow();
+				int chosen = _impl_clearFlag ( WF_CHOSEN );
+				++g_wsstats._nWakeups;
+				g_wsstats._nWakeupsAvoided += g_nWSPRPendingAvoided;
+				g_nWSPRPendingAvoided = 0;
 
 				//first, update our WSPR message if needed
 				if ( _impl_testFlag ( WF_REENCODE ) )
 				{
-					PersistentSettings* psettings = Settings_getStruct();
-					if ( wspr_encode ( g_abyWSPR, psettings->_achCallSign, 
-							psettings->_achMaidenhead, psettings->_nTxPowerDbm ) )
-					{
-						//success!
-						_impl_clearFlag ( WF_REENCODE );
-					}
-					else
+					if ( ! _impl_WSPR_ReEncodeNow() )
 					{
 						//horror; do not proceed with bad message
 						doitnow = 0;
@@ -350,11 +487,12 @@ void thrdfxnWSPRTask ( void const* argument )
 				//now we can proceed with the wspr'ing
 				if ( doitnow )	//but should be wspr'ing?
 				{
-					//randomize duty cycle selection
-					int chance = rand() / (RAND_MAX/100);
+					//if the slot was not already chosen when it was
+					//scheduled, roll for it now
 					PersistentSettings* psettings = Settings_getStruct();
-					if ( chance < psettings->_nDutyPct )
+					if ( chosen || _impl_WSPR_rollDuty() )
 					{
+						++g_wsstats._nTransmissions;
 						//start transmission
 						StartBitClock();	//get bit clock cranked up
 						//compute the base frequency.  first determine the
@@ -393,6 +531,16 @@ _ledOnGn();
 				_impl_WSPR_ScheduleNext();
 			}
 
+			//if the schedule criteria changed, or we were just started,
+			//re-evaluate when we next wake (unless we just did that above,
+			//after a start)
+			if ( ( ulNotificationValue & TNB_WSPR_RESCHEDULE ) &&
+					! ( ulNotificationValue & TNB_WSPRSTART ) &&
+					_impl_testFlag ( WF_WSPR ) )	//only if we have a schedule
+			{
+				_impl_WSPR_ScheduleNext();
+			}
+
 			//if it is time to shift out the next WSPR symbol, do so
 			if ( ulNotificationValue & TNB_WSPRNEXTBIT )
 			{
@@ -402,6 +550,12 @@ _ledOffGn();
 					si5351aOutputOff(SI_CLK0_CONTROL);	//extinguish signal
 					StopBitClock();	//stop shifting bits
 					g_nWSPRSymbolIndex = 0;	//setup to start at beginning next time
+					//if the message changed while we were sending, we can
+					//now get it ready ahead of the next slot
+					if ( _impl_testFlag ( WF_REENCODE ) )
+					{
+						_impl_WSPR_ReEncodeNow();
+					}
 				}
 				else
 				{
@@ -20,6 +20,24 @@ extern osStaticThreadDef_t g_tcbWSPR;
 extern uint8_t g_abyWSPR[162];
 
 
+//how we decide when to wake up for transmission slots (persistent setting)
+typedef enum WSPRSchedMode WSPRSchedMode;
+enum WSPRSchedMode
+{
+	WSPR_SCHED_EVERY = 0,	//wake each permitted slot; roll the duty then
+	WSPR_SCHED_DIRECT = 1,	//roll the duty ahead; wake only to transmit
+};
+
+//statistics about the scheduling
+typedef struct WSPRSchedStats WSPRSchedStats;
+struct WSPRSchedStats
+{
+	uint32_t	_nWakeups;			//times our scheduled alarm came due
+	uint32_t	_nWakeupsAvoided;	//permitted slots we did not need to wake for
+	uint32_t	_nTransmissions;	//times we started transmitting
+};
+
+
 //called once at reset to get things ready
 void WSPR_Initialize ( void );
 
@@ -31,6 +49,14 @@ void WSPR_StopWSPR ( void );
 //happen prior to transmission.
 void WSPR_ReEncode ( void );
 
+//if the schedule criteria changed (e.g. the transmit calendar), re-evaluate
+//when we next need to wake up.
+void WSPR_Reschedule ( void );
+
+//get/clear the scheduling statistics
+void WSPR_getSchedStats ( WSPRSchedStats* pstats );
+void WSPR_resetSchedStats ( void );
+
 
 //for tuning of the synthesizer correction value, we can just emit a CW signal.
 //this can let us beat against WWV, or even tweak it via WSJT-X waterfall.
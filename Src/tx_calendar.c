@@ -0,0 +1,78 @@
+//==============================================================
+//This provides the transmit calendar.
+//This module is part of the CarelessWSPR project.
+//impl
+
+#include "tx_calendar.h"
+
+
+
+//is the time-of-day slot permitted
+int TxCal_isTimePermitted ( const PersistentSettings* psettings, int nSlot )
+{
+	if ( nSlot < 0 || nSlot >= TXCAL_SLOTS )
+		return 0;
+	return ! ( psettings->_anTxCalBlocked[nSlot >> 5] & ( 1UL << ( nSlot & 31 ) ) );
+}
+
+
+//is the slot on the weekday permitted
+int TxCal_isPermitted ( const PersistentSettings* psettings, int nWeekDay, int nSlot )
+{
+	if ( psettings->_nTxCalDaysBlocked & ( 1UL << nWeekDay ) )
+		return 0;
+	return TxCal_isTimePermitted ( psettings, nSlot );
+}
+
+
+//find the first permitted slot at or after nSlot on the weekday
+int TxCal_nextPermitted ( const PersistentSettings* psettings, int nWeekDay, int nSlot )
+{
+	if ( nSlot < 0 )
+		nSlot = 0;
+	if ( nSlot >= TXCAL_SLOTS )
+		return -1;
+	if ( psettings->_nTxCalDaysBlocked & ( 1UL << nWeekDay ) )
+		return -1;	//whole day is out
+
+	//we scan a word (32 slots; about an hour) at a time, so this is at most
+	//TXCAL_WORDS iterations.  The first word is masked to start at nSlot.
+	int nWord = nSlot >> 5;
+	uint32_t nFree = ~psettings->_anTxCalBlocked[nWord] & ( 0xffffffffUL << ( nSlot & 31 ) );
+	for(;;)
+	{
+		if ( 0 != nFree )
+		{
+			//lowest set bit is the first permitted slot (it compiles to
+			//RBIT/CLZ on this core)
+			int nFound = ( nWord << 5 ) + __builtin_ctz ( nFree );
+			//(the unused bits past the last slot are never blocked, so
+			//they look 'free'; they do not count)
+			return ( nFound < TXCAL_SLOTS ) ? nFound : -1;
+		}
+		if ( ++nWord >= TXCAL_WORDS )
+			return -1;
+		nFree = ~psettings->_anTxCalBlocked[nWord];
+	}
+}
+
+
+//permit (or block) the slots [nSlotStart, nSlotEnd), wrapping at midnight
+void TxCal_setRange ( PersistentSettings* psettings, int nSlotStart, int nSlotEnd, int bPermit )
+{
+	if ( nSlotStart < 0 || nSlotStart >= TXCAL_SLOTS ||
+			nSlotEnd < 0 || nSlotEnd > TXCAL_SLOTS )
+		return;
+
+	int nSlot = nSlotStart;
+	do
+	{
+		uint32_t nBit = 1UL << ( nSlot & 31 );
+		if ( bPermit )
+			psettings->_anTxCalBlocked[nSlot >> 5] &= ~nBit;
+		else
+			psettings->_anTxCalBlocked[nSlot >> 5] |= nBit;
+		if ( ++nSlot >= TXCAL_SLOTS )
+			nSlot = 0;
+	} while ( nSlot != nSlotEnd % TXCAL_SLOTS );
+}
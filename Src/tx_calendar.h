@@ -0,0 +1,50 @@
+//==============================================================
+//This provides the transmit calendar; i.e. which WSPR slots we are permitted
+//to transmit in (e.g. to honor band-sharing agreements).
+//This module is part of the CarelessWSPR project.
+//
+//The calendar lives in the persistent settings as a bitmap of the 720
+//even-minute slots in a day, and a mask of weekdays.  Both are 'blocked'
+//maps, so zero means 'permitted'.  A slot is permitted only if neither its
+//weekday nor its time-of-day is blocked.
+
+#ifndef __TX_CALENDAR_H
+#define __TX_CALENDAR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "CarelessWSPR_settings.h"
+
+
+//slot index for a time of day (odd minutes belong to the preceding slot)
+#define TXCAL_SLOT(hour,min)	((hour)*30+(min)/2)
+//time of day for a slot index
+#define TXCAL_SLOT_HOUR(slot)	((slot)/30)
+#define TXCAL_SLOT_MIN(slot)	(((slot)%30)*2)
+
+//all the weekdays, as a day mask
+#define TXCAL_DAYS_ALL	0x7f
+
+
+//is the time-of-day slot permitted (irrespective of the weekday)
+int TxCal_isTimePermitted ( const PersistentSettings* psettings, int nSlot );
+
+//is the slot on the weekday (RTC_WEEKDAY_xxx; 0 == Sunday) permitted
+int TxCal_isPermitted ( const PersistentSettings* psettings, int nWeekDay, int nSlot );
+
+//find the first permitted slot at or after nSlot on the weekday; returns -1 if
+//there are none remaining that day.
+int TxCal_nextPermitted ( const PersistentSettings* psettings, int nWeekDay, int nSlot );
+
+//permit (or block) the slots [nSlotStart, nSlotEnd).  If nSlotEnd <= nSlotStart
+//then the range wraps around midnight.  (So a range of 0-0 is the whole day.)
+void TxCal_setRange ( PersistentSettings* psettings, int nSlotStart, int nSlotEnd, int bPermit );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,130 @@
+//==============================================================
+//This provides a minimal u-blox UBX protocol sender.
+//This module is part of the CarelessWSPR project.
+//impl
+
+#include "ubx.h"
+
+#include "cmsis_os.h"
+
+
+
+//how long we'll wait for room in the transmit buffer
+#define UBX_TX_TIMEOUT	500
+
+
+
+//send a UBX frame
+int UBX_send ( const IOStreamIF* pio, uint8_t byClass, uint8_t byId,
+		const void* pvPayload, uint16_t nLen, uint32_t to )
+{
+	uint8_t abyHdr[6];
+	uint8_t abyCk[2];
+	const uint8_t* pby = (const uint8_t*) pvPayload;
+	uint8_t byCkA = 0;
+	uint8_t byCkB = 0;
+	size_t nIdx;
+
+	abyHdr[0] = 0xb5;	//sync chars
+	abyHdr[1] = 0x62;
+	abyHdr[2] = byClass;
+	abyHdr[3] = byId;
+	abyHdr[4] = (uint8_t) ( nLen & 0xff );	//little-endian
+	abyHdr[5] = (uint8_t) ( nLen >> 8 );
+
+	//8-bit Fletcher over class through end of payload
+	for ( nIdx = 2; nIdx < sizeof(abyHdr); ++nIdx )
+	{
+		byCkA += abyHdr[nIdx];
+		byCkB += byCkA;
+	}
+	for ( nIdx = 0; nIdx < nLen; ++nIdx )
+	{
+		byCkA += pby[nIdx];
+		byCkB += byCkA;
+	}
+	abyCk[0] = byCkA;
+	abyCk[1] = byCkB;
+
+	if ( 0 != pio->_transmitCompletely ( pio, abyHdr, sizeof(abyHdr), to ) )
+		return 1;
+	if ( 0 != nLen && 0 != pio->_transmitCompletely ( pio, pby, nLen, to ) )
+		return 1;
+	return pio->_transmitCompletely ( pio, abyCk, sizeof(abyCk), to );
+}
+
+
+
+//set the output rate of a message on the current port
+int UBX_setMessageRate ( const IOStreamIF* pio, uint8_t byClass, uint8_t byId, uint8_t byRate )
+{
+	//(short form of CFG-MSG; applies to the port it arrives on)
+	uint8_t abyPayload[3];
+	abyPayload[0] = byClass;
+	abyPayload[1] = byId;
+	abyPayload[2] = byRate;
+	return UBX_send ( pio, UBX_CLASS_CFG, UBX_ID_CFG_MSG, abyPayload, sizeof(abyPayload), UBX_TX_TIMEOUT );
+}
+
+
+
+//configure UART1 of the receiver for NMEA output only
+int UBX_setPortNMEA ( const IOStreamIF* pio, uint32_t nBitRate )
+{
+	uint8_t abyPayload[20] = { 0 };
+	abyPayload[0] = 1;		//portID; UART1
+	//2-3 txReady; (off)
+	abyPayload[4] = 0xd0;	//mode; 8 bits (and the 'always set' bit 4)
+	abyPayload[5] = 0x08;	//no parity, 1 stop bit
+	abyPayload[8] = (uint8_t) ( nBitRate );	//baudRate
+	abyPayload[9] = (uint8_t) ( nBitRate >> 8 );
+	abyPayload[10] = (uint8_t) ( nBitRate >> 16 );
+	abyPayload[11] = (uint8_t) ( nBitRate >> 24 );
+	abyPayload[12] = 0x03;	//inProtoMask; UBX + NMEA
+	abyPayload[14] = 0x02;	//outProtoMask; NMEA
+	return UBX_send ( pio, UBX_CLASS_CFG, UBX_ID_CFG_PRT, abyPayload, sizeof(abyPayload), UBX_TX_TIMEOUT );
+}
+
+
+
+//set the navigation solution rate
+int UBX_setNavRate ( const IOStreamIF* pio, uint16_t nMeasRateMs )
+{
+	uint8_t abyPayload[6];
+	abyPayload[0] = (uint8_t) ( nMeasRateMs & 0xff );	//measRate
+	abyPayload[1] = (uint8_t) ( nMeasRateMs >> 8 );
+	abyPayload[2] = 1;	//navRate; always 1
+	abyPayload[3] = 0;
+	abyPayload[4] = 1;	//timeRef; GPS time
+	abyPayload[5] = 0;
+	return UBX_send ( pio, UBX_CLASS_CFG, UBX_ID_CFG_RATE, abyPayload, sizeof(abyPayload), UBX_TX_TIMEOUT );
+}
+
+
+
+//the whole startup sequence
+int UBX_configureMinimalNMEA ( const IOStreamIF* pio, uint32_t nBitRate )
+{
+	//the sentences we parse stay on; the chatty ones go off.  (GSV alone is
+	//typically three or four sentences a second.)  ZDA is off by default on
+	//these receivers, but it is the only one with the four-digit year and
+	//the local zone, so we turn it on.
+	static const uint8_t abyOff[] = { UBX_NMEA_GLL, UBX_NMEA_GSV, UBX_NMEA_VTG };
+	static const uint8_t abyOn[] = { UBX_NMEA_RMC, UBX_NMEA_GGA, UBX_NMEA_ZDA, UBX_NMEA_GSA };
+	int nRet = 0;
+	size_t nIdx;
+
+	nRet |= UBX_setPortNMEA ( pio, nBitRate );
+	//the receiver re-inits its port after CFG-PRT; give it a moment
+	osDelay ( 100 );
+	nRet |= UBX_setNavRate ( pio, 1000 );
+	for ( nIdx = 0; nIdx < sizeof(abyOff); ++nIdx )
+	{
+		nRet |= UBX_setMessageRate ( pio, UBX_CLASS_NMEA, abyOff[nIdx], 0 );
+	}
+	for ( nIdx = 0; nIdx < sizeof(abyOn); ++nIdx )
+	{
+		nRet |= UBX_setMessageRate ( pio, UBX_CLASS_NMEA, abyOn[nIdx], 1 );
+	}
+	return nRet;
+}
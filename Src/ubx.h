@@ -0,0 +1,66 @@
+//==============================================================
+//This provides a minimal u-blox UBX protocol sender, for configuring the
+//GPS receiver (e.g. the NEO-6M).
+//This module is part of the CarelessWSPR project.
+//
+//We only ever send UBX (we don't parse it), and we only send the few
+//configuration messages needed to trim the receiver's output down to what we
+//actually use.  Out of the box, the receiver streams six or more NMEA
+//sentences every second, and every byte of them costs us an interrupt.
+
+#ifndef __UBX_H
+#define __UBX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "system_interfaces.h"
+
+
+//message classes and ids we use
+#define UBX_CLASS_CFG	0x06
+#define UBX_ID_CFG_PRT	0x00
+#define UBX_ID_CFG_MSG	0x01
+#define UBX_ID_CFG_RATE	0x08
+
+//the NMEA 'standard' messages have their own class for CFG-MSG
+#define UBX_CLASS_NMEA	0xf0
+#define UBX_NMEA_GGA	0x00
+#define UBX_NMEA_GLL	0x01
+#define UBX_NMEA_GSA	0x02
+#define UBX_NMEA_GSV	0x03
+#define UBX_NMEA_RMC	0x04
+#define UBX_NMEA_VTG	0x05
+#define UBX_NMEA_ZDA	0x08
+
+
+//send a UBX frame (sync, class, id, length, payload, checksum).  Returns 0 on
+//success, or nonzero if it could not all be sent within the timeout.
+int UBX_send ( const IOStreamIF* pio, uint8_t byClass, uint8_t byId,
+		const void* pvPayload, uint16_t nLen, uint32_t to );
+
+//set the output rate of a message (per navigation solution; 0 is off) on the
+//current port
+int UBX_setMessageRate ( const IOStreamIF* pio, uint8_t byClass, uint8_t byId, uint8_t byRate );
+
+//configure UART1 of the receiver for NMEA output only, at the bit rate given
+//(UBX is still accepted as input)
+int UBX_setPortNMEA ( const IOStreamIF* pio, uint32_t nBitRate );
+
+//set the navigation solution rate (ms between solutions)
+int UBX_setNavRate ( const IOStreamIF* pio, uint16_t nMeasRateMs );
+
+//the whole startup sequence:  NMEA-only at the bit rate given, 1 Hz, and
+//only the sentences we parse (RMC, GGA, ZDA, GSA) enabled
+int UBX_configureMinimalNMEA ( const IOStreamIF* pio, uint32_t nBitRate );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -29,7 +29,11 @@
 
 
 //(these are currently internal to serial_devices.c; may get moved out)
-extern size_t XXX_Pull_USBCDC_TxData ( uint8_t* pbyBuffer, const size_t nMax );
+extern size_t XXX_Peek_USBCDC_TxData ( uint8_t** ppbyData, const size_t nMax );
+extern void XXX_Consume_USBCDC_TxData ( void );
+extern void XXX_USBCDC_DataAvailable ( void );
+extern void XXX_USBCDC_TransmitEmpty ( void );
+extern uint8_t* XXX_Arm_USBCDC_RxData ( uint8_t* pbyBounce, const size_t nPacket );
 extern size_t XXX_Push_USBCDC_RxData ( const uint8_t* pbyBuffer, const size_t nAvail );
 /* USER CODE END INCLUDE */
 
@@ -78,8 +82,12 @@ extern size_t XXX_Push_USBCDC_RxData ( const uint8_t* pbyBuffer, const size_t nA
 //make it bigger.  I also don't see any reason to make it smaller, since there
 //is no provision for communicating the size of UserRxBufferFS, so it seems
 //like a buffer overflow fest to me in that regards.
+//(Receive now normally goes straight into the receive queue, so this is only
+//a bounce buffer for when the room there wraps around.)
+//The transmit one is only ever bound with zero length (we transmit straight
+//out of the transmit queue), so it need not take up any space.
 #define APP_RX_DATA_SIZE  CDC_DATA_FS_MAX_PACKET_SIZE
-#define APP_TX_DATA_SIZE  CDC_DATA_FS_MAX_PACKET_SIZE
+#define APP_TX_DATA_SIZE  1
 /* USER CODE END PRIVATE_DEFINES */
 
 /**
@@ -159,6 +167,7 @@ void XXX_USBCDC_PresenceHack ( void )
 /* USER CODE END MyCDCExt */
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_DECLARATION */
+static void _armReceive ( void );
 
 /* USER CODE END PRIVATE_FUNCTIONS_DECLARATION */
 
@@ -190,10 +199,9 @@ static int8_t CDC_Init_FS(void)
 	//code never uses that buffer again (it instead binds user buffers hoping
 	//they will remain stable for the lifetime of the transfer).
 	USBD_CDC_SetTxBuffer(&hUsbDeviceFS, UserTxBufferFS, 0);
-	USBD_CDC_SetRxBuffer(&hUsbDeviceFS, UserRxBufferFS);
 	
 	//immediately 'arm' reception of data to prime the pump
-	USBD_CDC_ReceivePacket(&hUsbDeviceFS);
+	_armReceive();
 	
   return (USBD_OK);
   /* USER CODE END 3 */
@@ -360,17 +368,15 @@ static int8_t CDC_Receive_FS(uint8_t* Buf, uint32_t *Len)
 	return (USBD_OK);
 	*/
 	
-	//new implementation; get it, and push it out of here for others to
-	//deal with.  This
-	USBD_CDC_SetRxBuffer(&hUsbDeviceFS, &Buf[0]);
-	USBD_CDC_ReceivePacket(&hUsbDeviceFS);
-	size_t nPushed = XXX_Push_USBCDC_RxData ( &Buf[0], (size_t)*Len );
-	if ( nPushed != *Len )
-	{
-		//horror; dropped data
-	}
+	//new implementation; it was received where we said (usually straight
+	//into the receive queue), so make it part of the queue, and then arm
+	//for the next packet if there's room.  If there isn't, the endpoint
+	//stays NAKing until the reader makes some (CDC_RxResume_FS).  We only
+	//ever arm with room for a whole packet, so nothing can be dropped.
+	XXX_Push_USBCDC_RxData ( &Buf[0], (size_t)*Len );
+	_armReceive();
 	
-	USBCDC_DataAvailable();	//notify data is available
+	XXX_USBCDC_DataAvailable();	//notify data is available
 
 	return (USBD_OK);
 	
@@ -410,28 +416,29 @@ uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len)
 	*/
 	
 	//XXX new implementation:
-	//If we are not 'busy', try to kickstart the transmission by dequeueing
-	//as much as possible into our (goofy) private /linear buffer, and
-	//invoking USBD_CDC_SetTxBuffer and USBD_CDC_TransmitPacket.
+	//If we are not 'busy', try to kickstart the transmission by pointing the
+	//USB directly at the next contiguous span of the transmit queue, and
+	//invoking USBD_CDC_SetTxBuffer and USBD_CDC_TransmitPacket.  The span
+	//stays in the queue until the CDC_TsComplete_FS callback consumes it.
+	//(The class splits it into packets, and sends the ZLP if needed.)
 	//If we are 'busy', then we don't need to do anything special, because
 	//the CDC_TsComplete_FS callback will continue the process until the
 	//data is exhausted.
-	//There.  No goofy polling timers.  It's tacky we have to have these
-	//goofy private linear buffers, so maybe I'll eventually rewrite this
-	//stuff, but right now I'm going to leave well enough alone.
+	//There.  No goofy polling timers, and no goofy private linear buffers.
 	USBD_CDC_HandleTypeDef *hcdc = (USBD_CDC_HandleTypeDef*)hUsbDeviceFS.pClassData;
 	if (hcdc->TxState != 0){
 		return USBD_BUSY;
 	}
-	size_t nPulled = XXX_Pull_USBCDC_TxData ( UserTxBufferFS, APP_TX_DATA_SIZE );
-	if ( 0 != nPulled )
+	uint8_t* pbySpan;
+	size_t nSpan = XXX_Peek_USBCDC_TxData ( &pbySpan, 0xffff );	//(the length is 16 bits)
+	if ( 0 != nSpan )
 	{
-		USBD_CDC_SetTxBuffer ( &hUsbDeviceFS, UserTxBufferFS, nPulled );
+		USBD_CDC_SetTxBuffer ( &hUsbDeviceFS, pbySpan, nSpan );
 		result = USBD_CDC_TransmitPacket ( &hUsbDeviceFS );
 	}
 	else
 	{
-		USBCDC_TransmitEmpty();	//notify transmit is empty
+		XXX_USBCDC_TransmitEmpty();	//notify transmit is empty
 	}
 	UNUSED(Buf);
 	UNUSED(Len);
@@ -442,10 +449,32 @@ uint8_t CDC_Transmit_FS(uint8_t* Buf, uint16_t Len)
 
 /* USER CODE BEGIN PRIVATE_FUNCTIONS_IMPLEMENTATION */
 
+//point the OUT endpoint at wherever the next packet can go, and enable it;
+//if there is nowhere, then leave it disabled (so the host gets NAKs)
+static void _armReceive ( void )
+{
+	uint8_t* pbyRx = XXX_Arm_USBCDC_RxData ( UserRxBufferFS, APP_RX_DATA_SIZE );
+	if ( NULL != pbyRx )
+	{
+		USBD_CDC_SetRxBuffer ( &hUsbDeviceFS, pbyRx );
+		USBD_CDC_ReceivePacket ( &hUsbDeviceFS );
+	}
+}
+
+
+void CDC_RxResume_FS ( void )
+{
+	if ( NULL != hUsbDeviceFS.pClassData )	//(not if we're not configured)
+		_armReceive();
+}
+
+
 //I added this callback (lower driver into us) to get notification that a
 //transmission has completed, and that now we can start some more.
 static void CDC_TsComplete_FS (uint8_t* pbuf, uint32_t Len)
 {
+	//the USB is done with the span it was lent; now it can be reused
+	XXX_Consume_USBCDC_TxData();
 	//just kick off a new transmission if we can.
 	CDC_Transmit_FS(NULL,0);	//Note, these parameters no longer have meaning
 	UNUSED(pbuf);
@@ -17,45 +17,7 @@
 #include <string.h>
 
 
-//==============================================================
-//simple circular buffer
-
-//This queue is realized with a fixed-size buffer known at compile-time.
-//There are separate code instantiations with that constants and object
-//names embedded in the implementation.
-
-
-//This defines the instance data for the circular buffer.
-//'prefix' is a name prefix, so you can have several if you like.
-//'type' is the data type; e.g. uint8_t
-//'size' is the count of types in the queue.  NOTE:  MUST be power of 2!
-
-/*
-For example, the following:
-	CIRCBUF_SIMPLE(MyQueue,uint8_t,128)
-will cause this API to be realized:
-
-initialize, or reset, the circular buffer
-inline unsigned int MyQueue_init ( void );
-
-what is the capacity of the buffer
-inline unsigned int MyQueue_capacity ( void );
-
-how many items are in the buffer
-inline unsigned int MyQueue_count ( void );
-
-is the buffer empty?
-inline int MyQueue_empty ( void );
-
-is the buffer full?
-inline int MyQueue_full ( void );
-
-put something in the buffer; true on success, false of fail (full)
-int MyQueue_enqueue ( uint8_t val );
-
-take something out of the buffer, if you can, 0 otherwise
-uint8_t MyQueue_dequeue();
-*/
+//(the type-specialized CIRCBUF_SIMPLE is entirely in the header)
 
 
 
@@ -147,6 +109,101 @@ void circbuff_dequeue ( void* pvCirc, void* val )
 
 
 
+//==============================================================
+//bulk access
+
+
+unsigned int circbuff_writeSpans ( void* pvCirc, circbuff_span_t asSpans[2] )
+{
+	unsigned int nCap = circbuff_capacity(pvCirc);
+	unsigned int nFree = nCap - DOWNCAST(pvCirc)->_nLength;
+	unsigned int nIdxWrite = circbuff_idxMod(pvCirc, DOWNCAST(pvCirc)->_nIdxRead + DOWNCAST(pvCirc)->_nLength);
+	unsigned int nFirst = nCap - nIdxWrite;	//up to the end of the buffer
+	if ( nFirst > nFree )
+		nFirst = nFree;
+	asSpans[0]._pv = (void*)&((pseudotype_circbuff_t*)pvCirc)->_abyBuffer[
+			nIdxWrite * DOWNCAST(pvCirc)->_nTypeSize];
+	asSpans[0]._nCount = nFirst;
+	asSpans[1]._pv = (void*)&((pseudotype_circbuff_t*)pvCirc)->_abyBuffer[0];
+	asSpans[1]._nCount = nFree - nFirst;	//(the rest is from the start)
+	return nFree;
+}
+
+
+void circbuff_commit ( void* pvCirc, unsigned int n )
+{
+	DOWNCAST(pvCirc)->_nLength += n;
+#ifdef DEBUG
+	if ( DOWNCAST(pvCirc)->_nLength > DOWNCAST(pvCirc)->_nMaxLength )
+		DOWNCAST(pvCirc)->_nMaxLength = DOWNCAST(pvCirc)->_nLength;
+#endif
+}
+
+
+unsigned int circbuff_readSpans ( void* pvCirc, circbuff_span_t asSpans[2] )
+{
+	unsigned int nCount = DOWNCAST(pvCirc)->_nLength;
+	unsigned int nIdxRead = DOWNCAST(pvCirc)->_nIdxRead;
+	unsigned int nFirst = circbuff_capacity(pvCirc) - nIdxRead;	//up to the end of the buffer
+	if ( nFirst > nCount )
+		nFirst = nCount;
+	asSpans[0]._pv = (void*)&((pseudotype_circbuff_t*)pvCirc)->_abyBuffer[
+			nIdxRead * DOWNCAST(pvCirc)->_nTypeSize];
+	asSpans[0]._nCount = nFirst;
+	asSpans[1]._pv = (void*)&((pseudotype_circbuff_t*)pvCirc)->_abyBuffer[0];
+	asSpans[1]._nCount = nCount - nFirst;	//(the rest is from the start)
+	return nCount;
+}
+
+
+void circbuff_consume ( void* pvCirc, unsigned int n )
+{
+	DOWNCAST(pvCirc)->_nIdxRead = circbuff_idxMod ( pvCirc, DOWNCAST(pvCirc)->_nIdxRead + n );
+	DOWNCAST(pvCirc)->_nLength -= n;
+}
+
+
+unsigned int circbuff_write ( void* pvCirc, const void* pv, unsigned int nMax )
+{
+	circbuff_span_t asSpans[2];
+	unsigned int nTypeSize = DOWNCAST(pvCirc)->_nTypeSize;
+	unsigned int nDone = 0;
+	int nIdx;
+	circbuff_writeSpans ( pvCirc, asSpans );
+	for ( nIdx = 0; nIdx < 2; ++nIdx )
+	{
+		unsigned int n = asSpans[nIdx]._nCount;
+		if ( n > nMax - nDone )
+			n = nMax - nDone;
+		memcpy ( asSpans[nIdx]._pv, &((const uint8_t*)pv)[nDone * nTypeSize], n * nTypeSize );
+		nDone += n;
+	}
+	circbuff_commit ( pvCirc, nDone );
+	return nDone;
+}
+
+
+unsigned int circbuff_read ( void* pvCirc, void* pv, unsigned int nMax )
+{
+	circbuff_span_t asSpans[2];
+	unsigned int nTypeSize = DOWNCAST(pvCirc)->_nTypeSize;
+	unsigned int nDone = 0;
+	int nIdx;
+	circbuff_readSpans ( pvCirc, asSpans );
+	for ( nIdx = 0; nIdx < 2; ++nIdx )
+	{
+		unsigned int n = asSpans[nIdx]._nCount;
+		if ( n > nMax - nDone )
+			n = nMax - nDone;
+		memcpy ( &((uint8_t*)pv)[nDone * nTypeSize], asSpans[nIdx]._pv, n * nTypeSize );
+		nDone += n;
+	}
+	circbuff_consume ( pvCirc, nDone );
+	return nDone;
+}
+
+
+
 #ifdef DEBUG
 unsigned int circbuff_max ( void* pvCirc )
 {
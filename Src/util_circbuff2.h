@@ -93,12 +93,129 @@ int circbuff_full ( void* pvCirc );
 int circbuff_enqueue ( void* pvCirc, const void* val );
 void circbuff_dequeue ( void* pvCirc, void* val );
 
+
+//bulk access.  The buffer contents (or free space) are at most two contiguous
+//spans (the second being non-empty only when it wraps), so you can get those,
+//copy directly to/from them, and then say how much you actually used.  Counts
+//are in items, not bytes.
+typedef struct circbuff_span_t circbuff_span_t;
+struct circbuff_span_t
+{
+	void* _pv;
+	unsigned int _nCount;
+};
+
+//the spans of free space you can write into; returns the total free
+unsigned int circbuff_writeSpans ( void* pvCirc, circbuff_span_t asSpans[2] );
+//you have written n items into the write spans; make them part of the queue
+void circbuff_commit ( void* pvCirc, unsigned int n );
+//the spans of queued items you can read; returns the total count
+unsigned int circbuff_readSpans ( void* pvCirc, circbuff_span_t asSpans[2] );
+//you have read n items from the read spans; remove them from the queue
+void circbuff_consume ( void* pvCirc, unsigned int n );
+
+//copy in/out as many as will fit/are available, up to nMax items, using the
+//spans; returns the number of items actually copied
+unsigned int circbuff_write ( void* pvCirc, const void* pv, unsigned int nMax );
+unsigned int circbuff_read ( void* pvCirc, void* pv, unsigned int nMax );
+
 #ifdef DEBUG
 unsigned int circbuff_max ( void* pvCirc );
 #endif
 
 
 
+//==============================================================
+//type-specialized circular buffer
+
+//The above is one implementation shared by every instance, so the size and
+//item size are looked up at runtime, and every item goes through memcpy.
+//That's fine for bulk, but for an item at a time it's a lot of work.  This
+//one realizes a separate, static inline, implementation per instance, with
+//the type, capacity, and mask all compile-time constants, so a byte queue
+//compiles to a handful of instructions.  The cost is code per instance (if it
+//is used in more than one place), so prefer it for the hot ones.
+//As with the above, there is no locking, and size MUST be power of 2.
+
+/*
+For example, the following:
+	CIRCBUF_SIMPLE(MyQueue,uint8_t,128)
+will cause this API to be realized (all static inline):
+
+initialize, or reset, the circular buffer
+void MyQueue_init ( void );
+
+what is the capacity of the buffer
+unsigned int MyQueue_capacity ( void );
+
+how many items are in the buffer
+unsigned int MyQueue_count ( void );
+
+is the buffer empty?
+int MyQueue_empty ( void );
+
+is the buffer full?
+int MyQueue_full ( void );
+
+put something in the buffer; true on success, false of fail (full)
+int MyQueue_enqueue ( uint8_t val );
+
+take something out of the buffer, if you can, 0 otherwise
+uint8_t MyQueue_dequeue ( void );
+*/
+
+#define CIRCBUF_SIMPLE(instance,type,size)	\
+static struct	\
+{	\
+	volatile unsigned int _nIdxRead;	\
+	volatile unsigned int _nLength;	\
+	type _aBuffer[size];	\
+} instance##_circbuff;	\
+static inline void instance##_init ( void )	\
+{	\
+	instance##_circbuff._nIdxRead = 0;	\
+	instance##_circbuff._nLength = 0;	\
+}	\
+static inline unsigned int instance##_capacity ( void )	\
+{	\
+	return (size);	\
+}	\
+static inline unsigned int instance##_count ( void )	\
+{	\
+	return instance##_circbuff._nLength;	\
+}	\
+static inline int instance##_empty ( void )	\
+{	\
+	return 0 == instance##_circbuff._nLength;	\
+}	\
+static inline int instance##_full ( void )	\
+{	\
+	return (size) == instance##_circbuff._nLength;	\
+}	\
+static inline int instance##_enqueue ( type val )	\
+{	\
+	unsigned int nLength = instance##_circbuff._nLength;	\
+	if ( (size) == nLength )	\
+		return 0;	\
+	instance##_circbuff._aBuffer[( instance##_circbuff._nIdxRead + nLength ) & ((size)-1)] = val;	\
+	instance##_circbuff._nLength = nLength + 1;	\
+	return 1;	\
+}	\
+static inline type instance##_dequeue ( void )	\
+{	\
+	type val = (type) 0;	\
+	if ( 0 != instance##_circbuff._nLength )	\
+	{	\
+		unsigned int nIdxRead = instance##_circbuff._nIdxRead;	\
+		val = instance##_circbuff._aBuffer[nIdxRead];	\
+		instance##_circbuff._nIdxRead = ( nIdxRead + 1 ) & ((size)-1);	\
+		--instance##_circbuff._nLength;	\
+	}	\
+	return val;	\
+}
+
+
+
 #ifdef __cplusplus
 }
 #endif
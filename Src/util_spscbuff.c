@@ -0,0 +1,181 @@
+//========================================================================
+//utilities for defining lock-free single-producer/single-consumer byte
+//circular buffers
+//impl
+
+//The ordering that matters:  the producer must have stored the data before it
+//publishes the new head (release), and the consumer must load the head before
+//it reads the data (acquire); likewise for the tail and the free space going
+//the other way.  On this core the 32-bit loads and stores are atomic anyway,
+//and these compile to plain LDR/STR with a DMB, but they also keep the
+//compiler from reordering, and make it right on a multi-core host.
+
+#include "util_spscbuff.h"
+#include <string.h>
+
+
+#define LOAD_ACQUIRE(p)		SPSC_LOAD_ACQUIRE(p)
+#define STORE_RELEASE(p,v)	SPSC_STORE_RELEASE(p,v)
+
+
+//This definition is simply to facilitate a macro to downcast to the base type
+//and access the derived buffer pointer.
+SPSCBUFTYPE(pseudotype,1)
+#define DOWNCAST(ptrder) (&((pseudotype_spscbuff_t*)(ptrder))->_base)
+#define BUFFER(ptrder) (((pseudotype_spscbuff_t*)(ptrder))->_abyBuffer)
+
+
+
+void spscbuff_init ( void* pvSpsc )
+{
+	DOWNCAST(pvSpsc)->_nHead = 0;
+	DOWNCAST(pvSpsc)->_nTail = 0;
+	DOWNCAST(pvSpsc)->_nMaxLength = 0;
+}
+
+
+unsigned int spscbuff_capacity ( void* pvSpsc )
+{
+	return DOWNCAST(pvSpsc)->_nSize;
+}
+
+
+unsigned int spscbuff_count ( void* pvSpsc )
+{
+	//(either index may move while we look, but the result is a count that
+	//was true at some point, which is all either side can use anyway)
+	return LOAD_ACQUIRE(&DOWNCAST(pvSpsc)->_nHead) - LOAD_ACQUIRE(&DOWNCAST(pvSpsc)->_nTail);
+}
+
+
+int spscbuff_empty ( void* pvSpsc )
+{
+	return 0 == spscbuff_count ( pvSpsc );
+}
+
+
+
+//==============================================================
+//producer side
+
+
+unsigned int spscbuff_free ( void* pvSpsc )
+{
+	return DOWNCAST(pvSpsc)->_nSize -
+			( DOWNCAST(pvSpsc)->_nHead - LOAD_ACQUIRE(&DOWNCAST(pvSpsc)->_nTail) );
+}
+
+
+unsigned int spscbuff_writeSpans ( void* pvSpsc, circbuff_span_t asSpans[2] )
+{
+	unsigned int nSize = DOWNCAST(pvSpsc)->_nSize;
+	unsigned int nFree = spscbuff_free ( pvSpsc );
+	unsigned int nIdxWrite = DOWNCAST(pvSpsc)->_nHead & ( nSize - 1 );
+	unsigned int nFirst = nSize - nIdxWrite;	//up to the end of the buffer
+	if ( nFirst > nFree )
+		nFirst = nFree;
+	asSpans[0]._pv = &BUFFER(pvSpsc)[nIdxWrite];
+	asSpans[0]._nCount = nFirst;
+	asSpans[1]._pv = &BUFFER(pvSpsc)[0];
+	asSpans[1]._nCount = nFree - nFirst;	//(the rest is from the start)
+	return nFree;
+}
+
+
+void spscbuff_commit ( void* pvSpsc, unsigned int n )
+{
+	unsigned int nHead = DOWNCAST(pvSpsc)->_nHead + n;
+	STORE_RELEASE ( &DOWNCAST(pvSpsc)->_nHead, nHead );
+	unsigned int nLength = nHead - LOAD_ACQUIRE(&DOWNCAST(pvSpsc)->_nTail);
+	if ( nLength > DOWNCAST(pvSpsc)->_nMaxLength )
+		DOWNCAST(pvSpsc)->_nMaxLength = nLength;
+}
+
+
+unsigned int spscbuff_write ( void* pvSpsc, const void* pv, unsigned int nMax )
+{
+	circbuff_span_t asSpans[2];
+	unsigned int nDone = 0;
+	int nIdx;
+	spscbuff_writeSpans ( pvSpsc, asSpans );
+	for ( nIdx = 0; nIdx < 2; ++nIdx )
+	{
+		unsigned int n = asSpans[nIdx]._nCount;
+		if ( n > nMax - nDone )
+			n = nMax - nDone;
+		memcpy ( asSpans[nIdx]._pv, &((const uint8_t*)pv)[nDone], n );
+		nDone += n;
+	}
+	spscbuff_commit ( pvSpsc, nDone );
+	return nDone;
+}
+
+
+
+void spscbuff_discard ( void* pvSpsc, unsigned int nKeep )
+{
+	unsigned int nTail = DOWNCAST(pvSpsc)->_nTail;
+	if ( nKeep > DOWNCAST(pvSpsc)->_nHead - nTail )
+		return;	//there isn't that much; nothing to discard
+	STORE_RELEASE ( &DOWNCAST(pvSpsc)->_nHead, nTail + nKeep );
+}
+
+
+
+//==============================================================
+//consumer side
+
+
+unsigned int spscbuff_readSpans ( void* pvSpsc, circbuff_span_t asSpans[2] )
+{
+	unsigned int nSize = DOWNCAST(pvSpsc)->_nSize;
+	unsigned int nTail = DOWNCAST(pvSpsc)->_nTail;
+	unsigned int nCount = LOAD_ACQUIRE(&DOWNCAST(pvSpsc)->_nHead) - nTail;
+	unsigned int nIdxRead = nTail & ( nSize - 1 );
+	unsigned int nFirst = nSize - nIdxRead;	//up to the end of the buffer
+	if ( nFirst > nCount )
+		nFirst = nCount;
+	asSpans[0]._pv = &BUFFER(pvSpsc)[nIdxRead];
+	asSpans[0]._nCount = nFirst;
+	asSpans[1]._pv = &BUFFER(pvSpsc)[0];
+	asSpans[1]._nCount = nCount - nFirst;	//(the rest is from the start)
+	return nCount;
+}
+
+
+void spscbuff_consume ( void* pvSpsc, unsigned int n )
+{
+	STORE_RELEASE ( &DOWNCAST(pvSpsc)->_nTail, DOWNCAST(pvSpsc)->_nTail + n );
+}
+
+
+unsigned int spscbuff_read ( void* pvSpsc, void* pv, unsigned int nMax )
+{
+	circbuff_span_t asSpans[2];
+	unsigned int nDone = 0;
+	int nIdx;
+	spscbuff_readSpans ( pvSpsc, asSpans );
+	for ( nIdx = 0; nIdx < 2; ++nIdx )
+	{
+		unsigned int n = asSpans[nIdx]._nCount;
+		if ( n > nMax - nDone )
+			n = nMax - nDone;
+		memcpy ( &((uint8_t*)pv)[nDone], asSpans[nIdx]._pv, n );
+		nDone += n;
+	}
+	spscbuff_consume ( pvSpsc, nDone );
+	return nDone;
+}
+
+
+
+unsigned int spscbuff_max ( void* pvSpsc )
+{
+	return DOWNCAST(pvSpsc)->_nMaxLength;
+}
+
+
+void spscbuff_resetMax ( void* pvSpsc )
+{
+	DOWNCAST(pvSpsc)->_nMaxLength = 0;
+}
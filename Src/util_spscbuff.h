@@ -0,0 +1,258 @@
+//========================================================================
+//utilities for defining lock-free single-producer/single-consumer byte
+//circular buffers
+
+//This is the counterpart to util_circbuff2 for the very common case where
+//one side of a byte stream is an ISR and the other is a task (e.g. a serial
+//port).  The producer only ever changes the head, and the consumer only ever
+//changes the tail, so there is no shared count that needs locking; neither
+//side needs to mask interrupts.  The indices are free-running, and are masked
+//on use, so full and empty are distinguishable without wasting a slot.
+
+//The rules:
+//*  exactly one context (task or ISR) writes; exactly one context reads
+//*  init and flush are not safe while the other side is active; lock for
+//   those (they are rare)
+//If you need multiple producers or consumers, use util_circbuff2 and lock.
+
+#ifndef __UTIL_SPSCBUFF_H
+#define __UTIL_SPSCBUFF_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "util_circbuff2.h"	//for circbuff_span_t
+#include <string.h>
+
+
+//the ordering primitives (see the impl for why)
+#define SPSC_LOAD_ACQUIRE(p)		__atomic_load_n ( (p), __ATOMIC_ACQUIRE )
+#define SPSC_STORE_RELEASE(p,v)	__atomic_store_n ( (p), (v), __ATOMIC_RELEASE )
+
+
+//the base type consists of indices, size, and the high-water mark (which is
+//cheap enough that we keep it in release builds, too)
+typedef struct spscbuff_t spscbuff_t;
+struct spscbuff_t
+{
+	volatile unsigned int _nHead;	//items ever written; producer owns
+	volatile unsigned int _nTail;	//items ever read; consumer owns
+	const unsigned int _nSize;
+	volatile unsigned int _nMaxLength;	//(producer updates)
+};
+
+
+//the derived type consists of the base type, with the buffer following.
+//'size' is the count of bytes in the queue.  NOTE:  MUST be power of 2!
+#define SPSCBUFTYPE(instance,size)	\
+typedef struct instance##_spscbuff_t instance##_spscbuff_t;	\
+struct instance##_spscbuff_t	\
+{	\
+spscbuff_t _base;	\
+uint8_t _abyBuffer[size];	\
+};
+
+
+//the instance data is initialized with the size
+#define SPSCBUFINST(instance,size)	\
+instance##_spscbuff_t instance =	\
+{	\
+	{ 0, 0, size }	\
+};
+
+
+//you can declare the type and instance in one go, which is probably the usual case
+#define SPSCBUF(instance,size)	\
+SPSCBUFTYPE(instance,size)	\
+SPSCBUFINST(instance,size)
+
+
+
+//either side
+void spscbuff_init ( void* pvSpsc );	//(not concurrent-safe)
+unsigned int spscbuff_capacity ( void* pvSpsc );
+unsigned int spscbuff_count ( void* pvSpsc );
+int spscbuff_empty ( void* pvSpsc );
+
+//producer side
+unsigned int spscbuff_free ( void* pvSpsc );
+unsigned int spscbuff_writeSpans ( void* pvSpsc, circbuff_span_t asSpans[2] );
+void spscbuff_commit ( void* pvSpsc, unsigned int n );
+unsigned int spscbuff_write ( void* pvSpsc, const void* pv, unsigned int nMax );
+//throw away what has been written but not yet consumed, except for the first
+//nKeep (e.g. what the consumer is still working on in place).  The consumer
+//must not be running (i.e. lock) for this one.
+void spscbuff_discard ( void* pvSpsc, unsigned int nKeep );
+
+//consumer side
+unsigned int spscbuff_readSpans ( void* pvSpsc, circbuff_span_t asSpans[2] );
+void spscbuff_consume ( void* pvSpsc, unsigned int n );
+unsigned int spscbuff_read ( void* pvSpsc, void* pv, unsigned int nMax );
+
+//the high-water mark, and resetting it
+unsigned int spscbuff_max ( void* pvSpsc );
+void spscbuff_resetMax ( void* pvSpsc );
+
+
+
+//==============================================================
+//type-specialized SPSC buffer
+
+//As with CIRCBUF_SIMPLE, this realizes a static inline implementation per
+//instance, with the type, capacity, and mask as compile-time constants; it's
+//for the hot queues that are worked an item at a time (e.g. from a TX
+//interrupt).  The same single-producer/single-consumer rules apply, and size
+//MUST be power of 2.
+
+/*
+For example, the following:
+	SPSCBUF_SIMPLE(MyQueue,uint8_t,128)
+will cause this API to be realized (all static inline):
+
+either side:
+void MyQueue_init ( void );	//(not concurrent-safe)
+unsigned int MyQueue_capacity ( void );
+unsigned int MyQueue_count ( void );
+int MyQueue_empty ( void );
+
+producer side:
+unsigned int MyQueue_free ( void );
+int MyQueue_enqueue ( uint8_t val );	//true on success, false if full
+unsigned int MyQueue_write ( const uint8_t* p, unsigned int nMax );	//returns count put
+void MyQueue_discard ( unsigned int nKeep );	//(as spscbuff_discard)
+
+consumer side:
+int MyQueue_dequeue ( uint8_t* pval );	//true on success, false if empty
+unsigned int MyQueue_read ( uint8_t* p, unsigned int nMax );	//returns count got
+unsigned int MyQueue_readSpan ( uint8_t** pp );	//the first contiguous span
+void MyQueue_consume ( unsigned int n );	//done with n from the span
+
+high-water mark:
+unsigned int MyQueue_max ( void );
+void MyQueue_resetMax ( void );
+*/
+
+#define SPSCBUF_SIMPLE_MAXTRACK(instance,nHead)	\
+	{ unsigned int nLength = (nHead) - SPSC_LOAD_ACQUIRE(&instance##_spscbuff._nTail);	\
+	if ( nLength > instance##_spscbuff._nMaxLength )	\
+		instance##_spscbuff._nMaxLength = nLength; }
+
+#define SPSCBUF_SIMPLE(instance,type,size)	\
+static struct	\
+{	\
+	volatile unsigned int _nHead;	\
+	volatile unsigned int _nTail;	\
+	volatile unsigned int _nMaxLength;	\
+	type _aBuffer[size];	\
+} instance##_spscbuff;	\
+static inline void instance##_init ( void )	\
+{	\
+	instance##_spscbuff._nHead = 0;	\
+	instance##_spscbuff._nTail = 0;	\
+	instance##_spscbuff._nMaxLength = 0;	\
+}	\
+static inline unsigned int instance##_capacity ( void )	\
+{	\
+	return (size);	\
+}	\
+static inline unsigned int instance##_count ( void )	\
+{	\
+	return SPSC_LOAD_ACQUIRE(&instance##_spscbuff._nHead) -	\
+			SPSC_LOAD_ACQUIRE(&instance##_spscbuff._nTail);	\
+}	\
+static inline int instance##_empty ( void )	\
+{	\
+	return 0 == instance##_count();	\
+}	\
+static inline unsigned int instance##_free ( void )	\
+{	\
+	return (size) - ( instance##_spscbuff._nHead -	\
+			SPSC_LOAD_ACQUIRE(&instance##_spscbuff._nTail) );	\
+}	\
+static inline int instance##_enqueue ( type val )	\
+{	\
+	unsigned int nHead = instance##_spscbuff._nHead;	\
+	if ( 0 == instance##_free() )	\
+		return 0;	\
+	instance##_spscbuff._aBuffer[nHead & ((size)-1)] = val;	\
+	SPSC_STORE_RELEASE ( &instance##_spscbuff._nHead, nHead + 1 );	\
+	SPSCBUF_SIMPLE_MAXTRACK(instance,nHead + 1)	\
+	return 1;	\
+}	\
+static inline unsigned int instance##_write ( const type* p, unsigned int nMax )	\
+{	\
+	unsigned int nHead = instance##_spscbuff._nHead;	\
+	unsigned int nFree = instance##_free();	\
+	unsigned int nIdx = nHead & ((size)-1);	\
+	unsigned int nFirst = (size) - nIdx;	\
+	if ( nMax > nFree )	\
+		nMax = nFree;	\
+	if ( nFirst > nMax )	\
+		nFirst = nMax;	\
+	memcpy ( &instance##_spscbuff._aBuffer[nIdx], p, nFirst * sizeof(type) );	\
+	memcpy ( &instance##_spscbuff._aBuffer[0], &p[nFirst], ( nMax - nFirst ) * sizeof(type) );	\
+	SPSC_STORE_RELEASE ( &instance##_spscbuff._nHead, nHead + nMax );	\
+	SPSCBUF_SIMPLE_MAXTRACK(instance,nHead + nMax)	\
+	return nMax;	\
+}	\
+static inline void instance##_discard ( unsigned int nKeep )	\
+{	\
+	unsigned int nTail = instance##_spscbuff._nTail;	\
+	if ( nKeep <= instance##_spscbuff._nHead - nTail )	\
+		SPSC_STORE_RELEASE ( &instance##_spscbuff._nHead, nTail + nKeep );	\
+}	\
+static inline int instance##_dequeue ( type* pval )	\
+{	\
+	unsigned int nTail = instance##_spscbuff._nTail;	\
+	if ( SPSC_LOAD_ACQUIRE(&instance##_spscbuff._nHead) == nTail )	\
+		return 0;	\
+	*pval = instance##_spscbuff._aBuffer[nTail & ((size)-1)];	\
+	SPSC_STORE_RELEASE ( &instance##_spscbuff._nTail, nTail + 1 );	\
+	return 1;	\
+}	\
+static inline unsigned int instance##_read ( type* p, unsigned int nMax )	\
+{	\
+	unsigned int nTail = instance##_spscbuff._nTail;	\
+	unsigned int nCount = SPSC_LOAD_ACQUIRE(&instance##_spscbuff._nHead) - nTail;	\
+	unsigned int nIdx = nTail & ((size)-1);	\
+	unsigned int nFirst = (size) - nIdx;	\
+	if ( nMax > nCount )	\
+		nMax = nCount;	\
+	if ( nFirst > nMax )	\
+		nFirst = nMax;	\
+	memcpy ( p, &instance##_spscbuff._aBuffer[nIdx], nFirst * sizeof(type) );	\
+	memcpy ( &p[nFirst], &instance##_spscbuff._aBuffer[0], ( nMax - nFirst ) * sizeof(type) );	\
+	SPSC_STORE_RELEASE ( &instance##_spscbuff._nTail, nTail + nMax );	\
+	return nMax;	\
+}	\
+static inline unsigned int instance##_readSpan ( type** pp )	\
+{	\
+	unsigned int nTail = instance##_spscbuff._nTail;	\
+	unsigned int nCount = SPSC_LOAD_ACQUIRE(&instance##_spscbuff._nHead) - nTail;	\
+	unsigned int nIdx = nTail & ((size)-1);	\
+	*pp = &instance##_spscbuff._aBuffer[nIdx];	\
+	return ( nCount < (size) - nIdx ) ? nCount : (size) - nIdx;	\
+}	\
+static inline void instance##_consume ( unsigned int n )	\
+{	\
+	SPSC_STORE_RELEASE ( &instance##_spscbuff._nTail, instance##_spscbuff._nTail + n );	\
+}	\
+static inline unsigned int instance##_max ( void )	\
+{	\
+	return instance##_spscbuff._nMaxLength;	\
+}	\
+static inline void instance##_resetMax ( void )	\
+{	\
+	instance##_spscbuff._nMaxLength = 0;	\
+}
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
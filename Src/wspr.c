@@ -195,63 +195,76 @@ void wspr_pack ( uint8_t* packed, const char* pszCall, const char* pszLoc, uint8
 
 
 
-void wspr_convencode ( uint8_t* convolved, const uint8_t* packed )
+//This encodes the input bits [nBitFrom, nBitTo) (of the 81), continuing from
+//the register state provided, and leaving the register state for a subsequent
+//continuation.  The output is the whole 162 bit array; only the corresponding
+//output bits [2*nBitFrom, 2*nBitTo) are written.
+//Being able to stop and resume lets us cache the encoder state after the
+//callsign bits, which do not change, and just re-encode the rest.
+static void _wspr_convencode_range ( uint8_t* convolved, const uint8_t* packed,
+		unsigned int nBitFrom, unsigned int nBitTo, uint32_t* pReg0, uint32_t* pReg1 )
 {
 	uint32_t Reg0, Reg1;	//the infamous Reg0 and Reg1 registers...
 
-	Reg0 = Reg1 = 0;
-	unsigned int nIdxOutBit = 0;
-	//for each input byte (we won't use all the bits, though)
-	for ( unsigned int nIdxInByte = 0; nIdxInByte < 11; nIdxInByte++)
+	Reg0 = *pReg0;
+	Reg1 = *pReg1;
+	unsigned int nIdxOutBit = nBitFrom * 2;
+	//for each input bit
+	for ( unsigned int nIdxIn = nBitFrom; nIdxIn < nBitTo; ++nIdxIn )
 	{
-		//for each bit in that byte
-		for ( unsigned int nIdxInBit = 0; nIdxInBit < 8; ++nIdxInBit )
+		unsigned int nIdxInByte = nIdxIn >> 3;
+		unsigned int nIdxInBit = nIdxIn & 7;
+		//feed MSB first into LSB of the two stream registers
+		Reg0 <<= 1;
+		Reg1 <<= 1;
+		if ( (packed[nIdxInByte] << nIdxInBit) & 0x80)	//shifting in a 1?
 		{
-			//feed MSB first into LSB of the two stream registers
-			Reg0 <<= 1;
-			Reg1 <<= 1;
-			if ( (packed[nIdxInByte] << nIdxInBit) & 0x80)	//shifting in a 1?
-			{
-				Reg0 |= 1;
-				Reg1 |= 1;
-			}
-
-			//Layland-Lushbaugh
-			//do Reg0 parity computation; this is essentially the xor of
-			//specific bits (as per generator polynomial), and this parity bit
-			//gets emitted to the output data.
-			//We have a pre-computed parity table that makes this a little
-			//easier.
-			//Also, we are going to set the value to 2 or 0 (rather than 1 or
-			//0) because we would otherwise be shifting it up later, anyway.
-			uint32_t conv;
-			unsigned int parity;
-			conv = Reg0 & 0xf2d05351;
-			parity = 
-					g_abyEvenParityTableByte[((uint8_t*)&conv)[0]] ^ 
-					g_abyEvenParityTableByte[((uint8_t*)&conv)[1]] ^
-					g_abyEvenParityTableByte[((uint8_t*)&conv)[2]] ^
-					g_abyEvenParityTableByte[((uint8_t*)&conv)[3]];
-			convolved[nIdxOutBit] = parity ? 2 : 0;
-			nIdxOutBit++;
-
-			//do Reg1 parity computation; this is the same thing, just with a
-			//different polynomial.
-			conv = Reg1 & 0xe4613c47;
-			parity = 
-					g_abyEvenParityTableByte[((uint8_t*)&conv)[0]] ^ 
-					g_abyEvenParityTableByte[((uint8_t*)&conv)[1]] ^
-					g_abyEvenParityTableByte[((uint8_t*)&conv)[2]] ^
-					g_abyEvenParityTableByte[((uint8_t*)&conv)[3]];
-			convolved[nIdxOutBit] = parity ? 2 : 0;
-			nIdxOutBit++;
-
-			if ( nIdxOutBit >= 162 )	//we are done (will be sooner than all bits in packed)
-			{
-				break;
-			}
+			Reg0 |= 1;
+			Reg1 |= 1;
 		}
+
+		//Layland-Lushbaugh
+		//do Reg0 parity computation; this is essentially the xor of
+		//specific bits (as per generator polynomial), and this parity bit
+		//gets emitted to the output data.
+		//We have a pre-computed parity table that makes this a little
+		//easier.
+		//Also, we are going to set the value to 2 or 0 (rather than 1 or
+		//0) because we would otherwise be shifting it up later, anyway.
+		uint32_t conv;
+		unsigned int parity;
+		conv = Reg0 & 0xf2d05351;
+		parity = 
+				g_abyEvenParityTableByte[((uint8_t*)&conv)[0]] ^ 
+				g_abyEvenParityTableByte[((uint8_t*)&conv)[1]] ^
+				g_abyEvenParityTableByte[((uint8_t*)&conv)[2]] ^
+				g_abyEvenParityTableByte[((uint8_t*)&conv)[3]];
+		convolved[nIdxOutBit] = parity ? 2 : 0;
+		nIdxOutBit++;
+
+		//do Reg1 parity computation; this is the same thing, just with a
+		//different polynomial.
+		conv = Reg1 & 0xe4613c47;
+		parity = 
+				g_abyEvenParityTableByte[((uint8_t*)&conv)[0]] ^ 
+				g_abyEvenParityTableByte[((uint8_t*)&conv)[1]] ^
+				g_abyEvenParityTableByte[((uint8_t*)&conv)[2]] ^
+				g_abyEvenParityTableByte[((uint8_t*)&conv)[3]];
+		convolved[nIdxOutBit] = parity ? 2 : 0;
+		nIdxOutBit++;
 	}
+
+	*pReg0 = Reg0;
+	*pReg1 = Reg1;
+}
+
+
+void wspr_convencode ( uint8_t* convolved, const uint8_t* packed )
+{
+	uint32_t Reg0, Reg1;
+	Reg0 = Reg1 = 0;	//must be initially cleared
+	//(we won't use all the bits in packed; 81 bits make 162 outputs)
+	_wspr_convencode_range ( convolved, packed, 0, 81, &Reg0, &Reg1 );
 }
 
 
@@ -368,6 +381,69 @@ int wspr_encode ( uint8_t* pbyBuffer, const char* pszCall,
 
 
 
+//Incremental encoding
+//The first 28 bits of the packed message are the callsign (N), and the rest
+//are the locator and power (M).  Because the convolutional encoder's output
+//for those first bits depends only on those bits, we can cache the encoder's
+//state (and output) at that point, and when only the locator or power has
+//changed (e.g. a moving platform) we need only encode the remaining 53 bits.
+//The interleave and sync merge are permutation/xor operations over the whole
+//162 symbols, which are cheap, so they are simply redone.
+
+#define WSPR_N_BITS	28
+
+
+int wspr_encode_cached ( uint8_t* pbyBuffer, WSPREncodeCache* pcache,
+		const char* pszCall, const char* pszMaiden, const uint8_t nPwr )
+{
+	//condition the input parameters
+	char call_cond[7];
+	char loc_cond[5];
+	uint8_t pwr_cond = nPwr;
+	strncpy ( call_cond, pszCall, 6 );
+	call_cond[6] = '\0';
+	strncpy ( loc_cond, pszMaiden, 4 );
+	loc_cond[4] = '\0';
+	if ( ! wspr_condition ( call_cond, loc_cond, &pwr_cond ) )
+		return 0;	//horror
+
+	//do the bit-packing step; it's cheap enough to just do it all
+	uint8_t* packed = malloc ( 11 );	//avoid excessive stack
+	wspr_pack ( packed, call_cond, loc_cond, pwr_cond );
+
+	//do the convolutional encoding step; the cache holds the first part
+	uint8_t* convolved = malloc ( 162 );	//avoid excessive stack
+	if ( ! pcache->_bValid || 0 != memcmp ( pcache->_achCall, call_cond, 6 ) )
+	{
+		//(re)build the cache for this callsign
+		pcache->_nReg0 = pcache->_nReg1 = 0;
+		_wspr_convencode_range ( convolved, packed, 0, WSPR_N_BITS,
+				&pcache->_nReg0, &pcache->_nReg1 );
+		memcpy ( pcache->_abyConvHead, convolved, sizeof(pcache->_abyConvHead) );
+		memcpy ( pcache->_achCall, call_cond, 6 );
+		pcache->_bValid = 1;
+	}
+	else
+	{
+		memcpy ( convolved, pcache->_abyConvHead, sizeof(pcache->_abyConvHead) );
+	}
+	uint32_t Reg0 = pcache->_nReg0;
+	uint32_t Reg1 = pcache->_nReg1;
+	_wspr_convencode_range ( convolved, packed, WSPR_N_BITS, 81, &Reg0, &Reg1 );
+	free ( packed );
+
+	//scramble the data via bit-reversed addressing
+	wspr_interleave ( pbyBuffer, convolved );
+	free ( convolved );
+
+	//merge in the sync data
+	wspr_merge_sync ( pbyBuffer );
+
+	return 1;
+}
+
+
+
 //test vector created from 'official' wspr.exe program thusly:
 //wspr.exe Tx 10.1386 10.140100 0 K1JT FN20 30 11
 const uint8_t wspr_test_K1JT_FN20_30[162] =
@@ -20,6 +20,23 @@ int wspr_encode ( uint8_t* pbyBuffer, const char* pszCall,
 		const char* pszMaiden, const uint8_t nPwr );
 
 
+//cached state for incremental encoding; zero-initialize it before first use
+typedef struct WSPREncodeCache WSPREncodeCache;
+struct WSPREncodeCache
+{
+	int			_bValid;			//has been computed
+	char		_achCall[6];		//the (conditioned) callsign it is for
+	uint32_t	_nReg0;				//encoder state after the callsign bits
+	uint32_t	_nReg1;
+	uint8_t		_abyConvHead[56];	//encoder output for the callsign bits
+};
+
+//same as wspr_encode, but if the callsign is the same as the last time, only
+//the locator and power dependent part of the message is re-encoded.
+int wspr_encode_cached ( uint8_t* pbyBuffer, WSPREncodeCache* pcache,
+		const char* pszCall, const char* pszMaiden, const uint8_t nPwr );
+
+
 #ifdef DEBUG
 //unit test function against well known values
 int wspr_test ( void );
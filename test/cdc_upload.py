@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+#==============================================================
+#This is a bulk upload test of the USB CDC receive path, run from the host.
+#This is part of the CarelessWSPR project.
+#
+#It sends a pseudo-random stream to the board's 'upload' command, which reads
+#it and replies with the count, the time it took, and the Adler-32; we check
+#that against what we sent.  The board also says how the USB received the
+#packets:  straight into the queue, via the bounce buffer (where the room
+#wraps), or held off (NAKed) for want of room.  The default set of runs is
+#chosen to get all three:
+#*  whole packets, which stay aligned in the queue, so are mostly in place
+#*  odd-sized writes, which leave short packets that misalign the rest, so
+#   the room at the end is often less than a packet, and they bounce
+#*  a slow reader (a delay between the board's reads), so the queue fills
+#   up and the host is held off
+#Nothing may be lost in any of them.
+#
+#This needs pyserial, and the board's monitor on the USB port.
+#
+#usage:  cdc_upload.py port [-n bytes] [-c chunk] [-d delay_ms] [-s seed]
+#	with no -c or -d, does the default set of runs
+
+import argparse
+import random
+import re
+import sys
+import time
+import zlib
+
+import serial
+
+
+READY = re.compile(rb'^ready')
+RESULT = re.compile(rb'upload: (\d+) of (\d+) bytes in (\d+) ms; adler32 ([0-9a-f]{8})')
+PATHS = re.compile(rb'RX packets in place: (\d+), bounced: (\d+), held off: (\d+)')
+
+
+def read_until(port, pattern, timeout):
+	"""read lines until one matches; the match, or None on timeout"""
+	end = time.monotonic() + timeout
+	while time.monotonic() < end:
+		m = pattern.search(port.readline())
+		if m:
+			return m
+	return None
+
+
+def upload(port, nbytes, chunk, delay, seed):
+	"""one run; true if it all got there"""
+	data = random.Random(seed).randbytes(nbytes)
+
+	#get a clean prompt, then start it, and wait until it's ready for us
+	port.write(b'\r')
+	time.sleep(0.2)
+	port.reset_input_buffer()
+	port.write(b'upload %d %d\r' % (nbytes, delay))
+	if read_until(port, READY, 2.0) is None:
+		print('  the board didn\'t start the upload (is the monitor on this port?)')
+		return False
+
+	start = time.monotonic()
+	for idx in range(0, nbytes, chunk):
+		port.write(data[idx:idx + chunk])
+	port.flush()
+	sent = time.monotonic() - start
+
+	#(a slow reader takes 'delay' per 32 bytes)
+	m = read_until(port, RESULT, 10.0 + nbytes / 32 * delay / 1000.0)
+	if m is None:
+		print('  no result from the board')
+		return False
+	got, count, ms, adler = int(m[1]), int(m[2]), int(m[3]), int(m[4], 16)
+	p = read_until(port, PATHS, 2.0)
+	if p:
+		paths = 'in place %d, bounced %d, held off %d' % (int(p[1]), int(p[2]), int(p[3]))
+	else:
+		paths = '(no RX path counts)'
+
+	expected = zlib.adler32(data)
+	ok = got == nbytes and count == nbytes and adler == expected
+	print('  %d bytes, %d at a time, reader delay %d ms:  %s' %
+			(nbytes, chunk, delay, 'ok' if ok else 'FAILED'))
+	print('    board got %d in %d ms (%.0f kB/s); host sent it in %.3f s' %
+			(got, ms, got / max(ms, 1), sent))
+	print('    adler32 %08x, expected %08x; packets %s' % (adler, expected, paths))
+	return ok
+
+
+def main():
+	ap = argparse.ArgumentParser(description='USB CDC bulk upload test')
+	ap.add_argument('port', help='the board\'s USB serial port (e.g. /dev/ttyACM0, COM5)')
+	ap.add_argument('-n', '--bytes', type=int, default=1024 * 1024)
+	ap.add_argument('-c', '--chunk', type=int, help='bytes per host write')
+	ap.add_argument('-d', '--delay', type=int, help='ms the board waits between reads')
+	ap.add_argument('-s', '--seed', type=int, default=1)
+	args = ap.parse_args()
+
+	if args.chunk is None and args.delay is None:
+		#the default set; a slow reader moves only 32 bytes per delay, so
+		#send it less
+		runs = [(args.bytes, 4096, 0), (args.bytes, 64, 0), (args.bytes, 63, 0),
+				(args.bytes, 65, 0), (args.bytes, 1000, 0),
+				(min(args.bytes, 32 * 1024), 4096, 1)]
+	else:
+		runs = [(args.bytes, args.chunk or 4096, args.delay or 0)]
+
+	#(the baud rate means nothing to a CDC port)
+	failed = 0
+	with serial.Serial(args.port, 115200, timeout=0.5) as port:
+		for idx, (nbytes, chunk, delay) in enumerate(runs):
+			if not upload(port, nbytes, chunk, delay, args.seed + idx):
+				failed += 1
+	if failed:
+		print('cdc_upload: %d FAILURES' % failed)
+		return 1
+	print('cdc_upload: ok')
+	return 0
+
+
+if __name__ == '__main__':
+	sys.exit(main())
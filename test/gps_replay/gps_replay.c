@@ -0,0 +1,520 @@
+//==============================================================
+//This replays recorded GPS receiver output through the GPS task's parsing.
+//This module is part of the CarelessWSPR project.
+//
+//The bytes are fed through a fake IOStreamIF in DMA-sized pieces to
+//GPS_drain(), just as the GPS task does when the receive DMA tells it
+//something has arrived.  After each piece, a stand-in for the WSPR task takes
+//its notifications and does what the real one does with them:  on
+//TNB_WSPR_GPSLOCK it reads the fix and, on lock, 'sets the RTC' and the grid
+//locator from it.  Along the way we check that:
+//	*  lock notifications alternate (gained, lost, gained...) and agree with
+//	   the published fix
+//	*  the fix time never goes backwards, and is a real date and time when
+//	   we lock
+//and at the end, that the sentence counts, lock statistics, position, time,
+//and locator are what the file's '# expect' header says they should be.
+//Each file is replayed in a fresh process, as from power-up.
+//
+//With -b, it instead times the parsing of all the files (as one stream),
+//and of each sentence type on its own.
+//
+//usage:  gps_replay [-b] [-v] file.nmea ...
+//	-b	benchmark
+//	-v	report as we go
+
+#include "task_gps.h"
+#include "task_wspr.h"
+#include "CarelessWSPR_settings.h"
+#include "maidenhead.h"
+#include "util_altlib.h"
+
+#include "host_board.h"
+#include "test_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+
+//the receive DMA buffer is 256 bytes; we are told at each half, and when
+//the line goes idle
+#define CHUNK_MAX	128
+
+
+static int _bVerbose = 0;
+
+//====================================================
+//the recording
+
+
+typedef struct Recording
+{
+	const char* _pszName;
+	uint8_t* _pbyFile;		//the whole file
+	const uint8_t* _pby;	//the receiver's output (after the header)
+	size_t _nLen;
+	char _achExpect[1024];	//the '# expect' lines, run together
+} Recording;
+
+
+static int _load ( Recording* prec, const char* pszName )
+{
+	memset ( prec, 0, sizeof(*prec) );
+	prec->_pszName = pszName;
+	FILE* pf = fopen ( pszName, "rb" );
+	if ( NULL == pf )
+	{
+		printf ( "%s: can't open\n", pszName );
+		return 0;
+	}
+	fseek ( pf, 0, SEEK_END );
+	long nFile = ftell ( pf );
+	fseek ( pf, 0, SEEK_SET );
+	prec->_pbyFile = (uint8_t*) malloc ( nFile + 1 );
+	if ( 1 != fread ( prec->_pbyFile, nFile, 1, pf ) && 0 != nFile )
+	{
+		fclose ( pf );
+		printf ( "%s: can't read\n", pszName );
+		return 0;
+	}
+	fclose ( pf );
+
+	//the header is the '#' lines at the top
+	const uint8_t* pby = prec->_pbyFile;
+	const uint8_t* pbyEnd = prec->_pbyFile + nFile;
+	while ( pby < pbyEnd && '#' == *pby )
+	{
+		const uint8_t* pbyEOL = memchr ( pby, '\n', pbyEnd - pby );
+		if ( NULL == pbyEOL )
+			pbyEOL = pbyEnd;
+		if ( 0 == strncmp ( (const char*) pby, "# expect ", 9 ) &&
+				strlen ( prec->_achExpect ) + ( pbyEOL - pby ) < sizeof(prec->_achExpect) )
+		{
+			strncat ( prec->_achExpect, (const char*) pby + 9, pbyEOL - pby - 9 );
+			strcat ( prec->_achExpect, " " );
+		}
+		pby = ( pbyEOL < pbyEnd ) ? pbyEOL + 1 : pbyEnd;
+	}
+	prec->_pby = pby;
+	prec->_nLen = pbyEnd - pby;
+	return 1;
+}
+
+
+//the value of 'key=' in the expectations; NULL if it doesn't say
+static const char* _expect ( const Recording* prec, const char* pszKey, char* achVal, size_t nVal )
+{
+	char achKey[32];
+	snprintf ( achKey, sizeof(achKey), "%s=", pszKey );
+	const char* psz = prec->_achExpect;
+	size_t nKey = strlen ( achKey );
+	while ( NULL != ( psz = strstr ( psz, achKey ) ) )
+	{
+		if ( psz == prec->_achExpect || ' ' == psz[-1] )
+		{
+			psz += nKey;
+			size_t nLen = strcspn ( psz, " " );
+			if ( nLen >= nVal )
+				nLen = nVal - 1;
+			memcpy ( achVal, psz, nLen );
+			achVal[nLen] = '\0';
+			return achVal;
+		}
+		psz += nKey;
+	}
+	return NULL;
+}
+
+
+static void _expectInt ( const Recording* prec, const char* pszKey, long nActual )
+{
+	char achVal[32];
+	if ( NULL != _expect ( prec, pszKey, achVal, sizeof(achVal) ) )
+	{
+		CHECK ( atol ( achVal ) == nActual, "%s is %ld, expected %s", pszKey, nActual, achVal );
+	}
+}
+
+
+static void _expectStr ( const Recording* prec, const char* pszKey, const char* pszActual )
+{
+	char achVal[32];
+	if ( NULL != _expect ( prec, pszKey, achVal, sizeof(achVal) ) )
+	{
+		CHECK ( 0 == strcmp ( achVal, pszActual ), "%s is %s, expected %s", pszKey,
+				pszActual, achVal );
+	}
+}
+
+
+
+//====================================================
+//the WSPR task stand-in
+
+
+typedef struct WSPRStub
+{
+	int _bLock;				//what we've been told
+	uint32_t _nLockNotes;	//TNB_WSPR_GPSLOCK seen
+	uint32_t _nGridNotes;	//TNB_WSPR_GRIDCHANGE seen
+	uint32_t _nRTCSets;
+	GPSFix _fixRTC;			//what we last set the RTC from
+} WSPRStub;
+
+
+static int _plausibleTime ( const GPSFix* pfix )
+{
+	return pfix->_nYear >= 2000 && pfix->_nMonth >= 1 && pfix->_nMonth <= 12 &&
+			pfix->_nDay >= 1 && pfix->_nDay <= 31 && pfix->_nHour < 24 &&
+			pfix->_nMinute < 60 && pfix->_nSecond < 61;
+}
+
+
+//(what the WSPR task does with the GPS notifications)
+static void _wsprStubRun ( WSPRStub* pws )
+{
+	uint32_t ulNotificationValue = HostRTOS_take ( &g_htWSPR );
+
+	if ( ulNotificationValue & TNB_WSPR_GPSLOCK )
+	{
+		PersistentSettings* psettings = Settings_getStruct();
+		GPSFix fix;
+		GPS_getFix ( &fix );
+		++pws->_nLockNotes;
+		CHECK ( fix._bLock != pws->_bLock, "lock notification, but lock is still %d",
+				fix._bLock );
+		pws->_bLock = fix._bLock;
+		if ( fix._bLock )
+		{
+			//'set the RTC'
+			CHECK ( _plausibleTime ( &fix ), "locked, but the time is %04d-%02d-%02d %02d:%02d:%02d",
+					fix._nYear, fix._nMonth, fix._nDay, fix._nHour, fix._nMinute, fix._nSecond );
+			pws->_fixRTC = fix;
+			++pws->_nRTCSets;
+			if ( psettings->_bUseGPS )
+			{
+				toMaidenheadMicro ( fix._nLatMicro, fix._nLonMicro,
+						psettings->_achMaidenhead, 4 );
+			}
+		}
+		if ( _bVerbose )
+		{
+			printf ( "  %02d:%02d:%02d lock %s\n", fix._nHour, fix._nMinute,
+					fix._nSecond, fix._bLock ? "gained" : "lost" );
+		}
+	}
+
+	if ( ulNotificationValue & TNB_WSPR_GRIDCHANGE )
+	{
+		PersistentSettings* psettings = Settings_getStruct();
+		GPSFix fix;
+		GPS_getFix ( &fix );
+		++pws->_nGridNotes;
+		if ( psettings->_bTrackGrid && fix._bLock )
+		{
+			toMaidenheadMicro ( fix._nLatMicro, fix._nLonMicro,
+					psettings->_achMaidenhead, 4 );
+		}
+	}
+}
+
+
+
+//====================================================
+//replay
+
+
+//days since 1970-01-01 (proleptic Gregorian)
+static long _daysFromCivil ( int y, int m, int d )
+{
+	y -= m <= 2;
+	long era = ( y >= 0 ? y : y - 399 ) / 400;
+	long yoe = y - era * 400;
+	long doy = ( 153 * ( m + ( m > 2 ? -3 : 9 ) ) + 2 ) / 5 + d - 1;
+	long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+
+static long long _fixSeconds ( const GPSFix* pfix )
+{
+	return ( _daysFromCivil ( pfix->_nYear, pfix->_nMonth, pfix->_nDay ) * 86400LL ) +
+			pfix->_nHour * 3600 + pfix->_nMinute * 60 + pfix->_nSecond;
+}
+
+
+//the size of the next piece to deliver:  up to the end of the line (the
+//receiver pauses there, more or less), but no more than half the DMA buffer
+static size_t _nextChunk ( const uint8_t* pby, size_t nLeft )
+{
+	size_t nMax = ( nLeft < CHUNK_MAX ) ? nLeft : CHUNK_MAX;
+	const uint8_t* pbyEOL = memchr ( pby, '\n', nMax );
+	return ( NULL != pbyEOL ) ? (size_t)( pbyEOL - pby ) + 1 : nMax;
+}
+
+
+static void _replay ( const Recording* prec )
+{
+	Settings_restoreDefaults();
+	GPS_resetParser();
+
+	WSPRStub ws;
+	memset ( &ws, 0, sizeof(ws) );
+	HostStream hs;
+	HostStream_init ( &hs, prec->_pby, prec->_nLen );
+
+	long long nLastSeconds = 0;
+	double tStart = _now();
+	double tParse = 0.0;
+	while ( ! HostStream_done ( &hs ) )
+	{
+		HostStream_deliver ( &hs, _nextChunk ( &prec->_pby[hs._nDelivered],
+				prec->_nLen - hs._nDelivered ) );
+		double tDrain = _now();
+		GPS_drain ( &hs._if );
+		tParse += _now() - tDrain;
+		_wsprStubRun ( &ws );
+
+		GPSFix fix;
+		GPS_getFix ( &fix );
+		if ( 0 != fix._nYear )
+		{
+			long long nSeconds = _fixSeconds ( &fix );
+			CHECK ( nSeconds >= nLastSeconds, "time went backwards to %04d-%02d-%02d %02d:%02d:%02d",
+					fix._nYear, fix._nMonth, fix._nDay, fix._nHour, fix._nMinute, fix._nSecond );
+			nLastSeconds = nSeconds;
+		}
+	}
+	double tTotal = _now() - tStart;
+
+	//what we got
+	GPSFix fix;
+	GPS_getFix ( &fix );
+	GPSLockStats ls;
+	GPS_getLockStats ( &ls );
+	char achDate[16];
+	char achTime[16];
+	snprintf ( achDate, sizeof(achDate), "%04d-%02d-%02d", fix._nYear, fix._nMonth, fix._nDay );
+	snprintf ( achTime, sizeof(achTime), "%02d%02d%02d", fix._nHour, fix._nMinute, fix._nSecond );
+
+	uint32_t nGood = 0;
+	uint32_t nBad = 0;
+	printf ( "  sentences:" );
+	size_t nIdx;
+	const char* pszName;
+	NMEASentenceStats nss;
+	for ( nIdx = 0; GPS_getSentenceStats ( nIdx, &pszName, &nss ); ++nIdx )
+	{
+		char achKey[16];
+		printf ( " %s %u/%u", pszName, (unsigned int) nss._nGood, (unsigned int) nss._nBad );
+		snprintf ( achKey, sizeof(achKey), "%c%c%c_good", pszName[0] | 0x20,
+				pszName[1] | 0x20, pszName[2] | 0x20 );
+		_expectInt ( prec, achKey, nss._nGood );
+		nGood += nss._nGood;
+		nBad += nss._nBad;
+	}
+	printf ( " (good/bad)\n" );
+	printf ( "  lock: acquired %u, lost %u, suppressed %u; now %s\n",
+			(unsigned int) ls._nAcquired, (unsigned int) ls._nLost,
+			(unsigned int) ls._nSuppressed, fix._bLock ? "locked" : "not locked" );
+	printf ( "  WSPR task: %u lock notifications, %u RTC sets (last %04d-%02d-%02d %02d:%02d:%02d), grid %s\n",
+			(unsigned int) ws._nLockNotes, (unsigned int) ws._nRTCSets,
+			ws._fixRTC._nYear, ws._fixRTC._nMonth, ws._fixRTC._nDay,
+			ws._fixRTC._nHour, ws._fixRTC._nMinute, ws._fixRTC._nSecond,
+			Settings_getStruct()->_achMaidenhead );
+	printf ( "  %lu bytes, %u sentences of interest in %.2f ms; parse %.0f ns/sentence\n",
+			(unsigned long) prec->_nLen, (unsigned int)( nGood + nBad ), tTotal * 1e3,
+			( 0 != nGood + nBad ) ? tParse / ( nGood + nBad ) * 1e9 : 0.0 );
+
+	_expectInt ( prec, "acquired", ls._nAcquired );
+	_expectInt ( prec, "lost", ls._nLost );
+	_expectInt ( prec, "suppressed", ls._nSuppressed );
+	_expectInt ( prec, "lock", fix._bLock );
+	_expectInt ( prec, "lat", fix._nLatMicro );
+	_expectInt ( prec, "lon", fix._nLonMicro );
+	_expectStr ( prec, "date", achDate );
+	_expectStr ( prec, "time", achTime );
+	_expectStr ( prec, "grid", Settings_getStruct()->_achMaidenhead );
+
+	//the WSPR task must have heard about every change, and set the RTC on
+	//every lock
+	CHECK ( ws._nLockNotes == ls._nAcquired + ls._nLost,
+			"%u lock notifications for %u changes", (unsigned int) ws._nLockNotes,
+			(unsigned int)( ls._nAcquired + ls._nLost ) );
+	CHECK ( ws._nRTCSets == ls._nAcquired, "%u RTC sets for %u locks",
+			(unsigned int) ws._nRTCSets, (unsigned int) ls._nAcquired );
+	CHECK ( ws._bLock == fix._bLock, "WSPR task thinks lock is %d", ws._bLock );
+}
+
+
+
+//====================================================
+//benchmark
+
+
+//time repeated parsing of a stream; returns seconds per pass
+static double _timeStream ( const uint8_t* pby, size_t nLen, int nReps )
+{
+	HostStream hs;
+	double tStart = _now();
+	int nRep;
+	for ( nRep = 0; nRep < nReps; ++nRep )
+	{
+		HostStream_init ( &hs, pby, nLen );
+		while ( ! HostStream_done ( &hs ) )
+		{
+			HostStream_deliver ( &hs, CHUNK_MAX );
+			GPS_drain ( &hs._if );
+		}
+		HostRTOS_take ( &g_htWSPR );
+	}
+	return ( _now() - tStart ) / nReps;
+}
+
+
+static size_t _countSentences ( const uint8_t* pby, size_t nLen )
+{
+	size_t nCount = 0;
+	size_t nIdx;
+	for ( nIdx = 0; nIdx < nLen; ++nIdx )
+	{
+		if ( '$' == pby[nIdx] )
+			++nCount;
+	}
+	return nCount;
+}
+
+
+static void _bench ( Recording* arec, int nRecs )
+{
+	Settings_restoreDefaults();
+	GPS_resetParser();
+
+	//everything, as one stream
+	size_t nAll = 0;
+	int nRec;
+	for ( nRec = 0; nRec < nRecs; ++nRec )
+		nAll += arec[nRec]._nLen;
+	uint8_t* pbyAll = (uint8_t*) malloc ( nAll );
+	size_t nPos = 0;
+	for ( nRec = 0; nRec < nRecs; ++nRec )
+	{
+		memcpy ( &pbyAll[nPos], arec[nRec]._pby, arec[nRec]._nLen );
+		nPos += arec[nRec]._nLen;
+	}
+	size_t nSentences = _countSentences ( pbyAll, nAll );
+	double tPass = _timeStream ( pbyAll, nAll, 200 );
+	printf ( "all: %lu bytes, %lu sentences\n", (unsigned long) nAll, (unsigned long) nSentences );
+	printf ( "  %.0f sentences/s, %.0f ns/sentence, %.1f ns/byte\n",
+			nSentences / tPass, tPass / nSentences * 1e9, tPass / nAll * 1e9 );
+	printf ( "  (a receiver at 9600 bps would keep this host %.4f%% busy)\n",
+			tPass / nAll * 960 * 100 );
+
+	//then each kind of (intact) sentence on its own, including the ones we
+	//skip.  The talker is ignored, so these are keyed by sentence id.
+	static const char* apszIds[] = { "RMC", "GGA", "GSA", "ZDA", "GSV", "VTG", "GLL", "TXT" };
+	size_t nId;
+	printf ( "per sentence:\n" );
+	for ( nId = 0; nId < COUNTOF(apszIds); ++nId )
+	{
+		uint8_t* pbyOne = (uint8_t*) malloc ( nAll );
+		size_t nOne = 0;
+		size_t nCount = 0;
+		const uint8_t* pby = pbyAll;
+		const uint8_t* pbyEnd = pbyAll + nAll;
+		while ( pby < pbyEnd )
+		{
+			const uint8_t* pbyEOL = memchr ( pby, '\n', pbyEnd - pby );
+			if ( NULL == pbyEOL )
+				break;
+			size_t nLine = pbyEOL - pby + 1;
+			//'$ttIII,...*hh\r\n'
+			if ( nLine > 11 && '$' == pby[0] && 0 == memcmp ( &pby[3], apszIds[nId], 3 ) &&
+					',' == pby[6] && '*' == pby[nLine - 5] &&
+					NULL == memchr ( &pby[1], '$', nLine - 1 ) )
+			{
+				memcpy ( &pbyOne[nOne], pby, nLine );
+				nOne += nLine;
+				++nCount;
+			}
+			pby = pbyEOL + 1;
+		}
+		if ( 0 != nCount )
+		{
+			double tOne = _timeStream ( pbyOne, nOne, 200 );
+			printf ( "  %s %6.0f ns  (%lu of them, %.0f bytes each)\n", apszIds[nId],
+					tOne / nCount * 1e9, (unsigned long) nCount, (double) nOne / nCount );
+		}
+		free ( pbyOne );
+	}
+	free ( pbyAll );
+}
+
+
+
+int main ( int argc, char* argv[] )
+{
+	int bBench = 0;
+	int nArg;
+	for ( nArg = 1; nArg < argc && '-' == argv[nArg][0]; ++nArg )
+	{
+		if ( 0 == strcmp ( "-b", argv[nArg] ) )
+			bBench = 1;
+		else if ( 0 == strcmp ( "-v", argv[nArg] ) )
+			_bVerbose = 1;
+		else
+		{
+			printf ( "usage:  gps_replay [-b] [-v] file.nmea ...\n" );
+			return 2;
+		}
+	}
+	int nRecs = argc - nArg;
+	if ( 0 == nRecs )
+	{
+		printf ( "usage:  gps_replay [-b] [-v] file.nmea ...\n" );
+		return 2;
+	}
+
+	Recording* arec = (Recording*) calloc ( nRecs, sizeof(Recording) );
+	int nRec;
+	for ( nRec = 0; nRec < nRecs; ++nRec )
+	{
+		if ( ! _load ( &arec[nRec], argv[nArg + nRec] ) )
+			return 2;
+	}
+
+	if ( bBench )
+	{
+		_bench ( arec, nRecs );
+		return 0;
+	}
+
+	//each in its own process, so that each starts from power-up
+	int nFailedFiles = 0;
+	for ( nRec = 0; nRec < nRecs; ++nRec )
+	{
+		fflush ( stdout );
+		pid_t pid = fork();
+		if ( 0 == pid )
+		{
+			printf ( "%s\n", arec[nRec]._pszName );
+			_replay ( &arec[nRec] );
+			return ( 0 == _nFailures ) ? 0 : 1;
+		}
+		int nStatus = 1;
+		waitpid ( pid, &nStatus, 0 );
+		if ( ! WIFEXITED(nStatus) || 0 != WEXITSTATUS(nStatus) )
+			++nFailedFiles;
+	}
+
+	if ( 0 != nFailedFiles )
+	{
+		printf ( "gps_replay: %d of %d FAILED\n", nFailedFiles, nRecs );
+		return 1;
+	}
+	printf ( "gps_replay: ok\n" );
+	return 0;
+}
@@ -0,0 +1,413 @@
+#!/usr/bin/env python3
+#==============================================================
+#Makes the GPS replay corpus.
+#This is part of the CarelessWSPR project.
+#
+#Each file is what a u-blox NEO-6M sends once configured (RMC, GGA, GSA, ZDA
+#at 1 Hz, 9600 bps), with the trouble of one kind or another that we see in
+#the field mixed in.  A header of '#' lines says what the firmware should make
+#of it; those numbers come from a model of the parser and the lock state
+#machine in here, independent of the C.  The output is deterministic, and the
+#.nmea files are committed, so this only needs running when a scenario
+#changes:
+#	python3 make_corpus.py
+#(Logs captured from a real receiver can be replayed too; they just won't
+#have the expectations, so the replay only reports and checks invariants.)
+
+import datetime
+import os
+import random
+
+
+#the firmware's out-of-box lock settings (CarelessWSPR_settings.c)
+LOCK_ACQUIRE = 3
+LOCK_LOSE = 10
+LOCK_MIN_SATS = 4
+LOCK_MAX_HDOP = 0
+
+
+def checksum(body):
+	ck = 0
+	for ch in body.encode('ascii'):
+		ck ^= ch
+	return ck
+
+
+def sentence(body):
+	return '$%s*%02X\r\n' % (body, checksum(body))
+
+
+def fmt_latlon(micro, ndeg):
+	mag = abs(micro)
+	deg = mag // 1000000
+	#micro-degrees to 1e-5 minutes, as the receiver would round it
+	minutes_e5 = ((mag % 1000000) * 60 + 5) // 10
+	if minutes_e5 >= 6000000:
+		deg += 1
+		minutes_e5 -= 6000000
+	return '%0*d%02d.%05d' % (ndeg, deg, minutes_e5 // 100000, minutes_e5 % 100000)
+
+
+#the firmware's parse of such a field (_parseDegMinMicro)
+def parse_latlon(field, ndeg):
+	deg = int(field[:ndeg])
+	whole, _, frac = field[ndeg:].partition('.')
+	frac = (frac + '000000')[:6]
+	micromin = int(whole) * 1000000 + int(frac)
+	return deg * 1000000 + (micromin + 30) // 60
+
+
+def maidenhead4(lat, lon):
+	lonu = min(lon + 180000000, 360000000 - 1)
+	latu = min(lat + 90000000, 180000000 - 1)
+	return (chr(ord('A') + lonu // 20000000) + chr(ord('A') + latu // 10000000) +
+			chr(ord('0') + (lonu % 20000000) // 2000000) +
+			chr(ord('0') + (latu % 10000000) // 1000000))
+
+
+class Receiver:
+	'''makes the sentences for each epoch'''
+	def __init__(self, t, lat, lon, rng):
+		self.t = t
+		self.lat = lat
+		self.lon = lon
+		self.rng = rng
+		self.time_known = True
+		self.status = 'A'	#'A' or 'V'
+		self.quality = 1
+		self.sats = 8
+		self.hdop = 101		#x 100
+
+	def epoch(self):
+		'''the sentences (body text) for this second; then time moves on'''
+		r = self.rng
+		t = self.t
+		hms = t.strftime('%H%M%S') + '.00' if self.time_known else ''
+		dmy = t.strftime('%d%m%y') if self.time_known else ''
+		if 'A' == self.status:
+			#a little wander, as a stationary receiver does
+			lat = self.lat + r.randint(-3, 3)
+			lon = self.lon + r.randint(-3, 3)
+			flat = fmt_latlon(lat, 2)
+			flon = fmt_latlon(lon, 3)
+			rmc = 'GPRMC,%s,A,%s,%s,%s,%s,0.0%02d,,%s,,,A' % (hms, flat,
+					'N' if lat >= 0 else 'S', flon, 'E' if lon >= 0 else 'W',
+					r.randint(0, 40), dmy)
+		else:
+			flat = flon = ''
+			rmc = 'GPRMC,%s,V,,,,,,,%s,,,N' % (hms, dmy)
+		if 0 != self.quality and '' != flat:
+			gga = 'GPGGA,%s,%s,%s,%s,%s,%d,%02d,%d.%02d,%d.%d,M,-32.1,M,,' % (hms,
+					flat, 'N' if lat >= 0 else 'S', flon, 'E' if lon >= 0 else 'W',
+					self.quality, self.sats, self.hdop // 100, self.hdop % 100,
+					r.randint(100, 140), r.randint(0, 9))
+		else:
+			gga = 'GPGGA,%s,,,,,0,%02d,99.99,,,,,,' % (hms, self.sats)
+		prns = ['%02d' % p for p in [2, 5, 7, 9, 13, 16, 20, 21, 27, 30, 31, 32][:self.sats]]
+		prns += [''] * (12 - len(prns))
+		if 'A' == self.status and 0 != self.quality:
+			gsa = 'GPGSA,A,3,%s,%d.%02d,%d.%02d,%d.%02d' % (','.join(prns),
+					(self.hdop * 2) // 100, (self.hdop * 2) % 100,
+					self.hdop // 100, self.hdop % 100,
+					(self.hdop * 3 // 2) // 100, (self.hdop * 3 // 2) % 100)
+		else:
+			gsa = 'GPGSA,A,1,,,,,,,,,,,,,99.99,99.99,99.99'
+		if self.time_known:
+			zda = 'GPZDA,%s,%02d,%02d,%04d,00,00' % (hms, t.day, t.month, t.year)
+		else:
+			zda = 'GPZDA,,,,,00,00'
+		self.t = t + datetime.timedelta(seconds=1)
+		return [('RMC', rmc), ('GGA', gga), ('GSA', gsa), ('ZDA', zda)]
+
+
+class Model:
+	'''what the firmware should make of the intact sentences'''
+	def __init__(self):
+		self.good = {'RMC': 0, 'GGA': 0, 'GSA': 0, 'ZDA': 0}
+		self.quality = -1
+		self.sats = 0
+		self.hdop = 0
+		self.lock = 0
+		self.run = 0
+		self.acquired = 0
+		self.lost = 0
+		self.suppressed = 0
+		self.lat = 0
+		self.lon = 0
+		self.date = None
+		self.time = None
+		self.grid = None
+
+	def commit(self, sid, body):
+		f = body.split(',')
+		self.good[sid] += 1
+		if 'GGA' == sid:
+			self.quality = int(f[6] or 0)
+			self.sats = int(f[7] or 0)
+			whole, _, frac = f[8].partition('.')
+			self.hdop = int(whole or 0) * 100 + int((frac + '00')[:2])
+		elif 'ZDA' == sid:
+			if len(f[1]) >= 6 and f[4] and int(f[4]) and int(f[2] or 0) and int(f[3] or 0):
+				self.time = f[1][:6]
+				self.date = '%04d-%02d-%02d' % (int(f[4]), int(f[3]), int(f[2]))
+		elif 'RMC' == sid:
+			if len(f[1]) < 6:
+				return
+			good = 'A' == f[2]
+			if good and self.quality >= 0:
+				good = (0 != self.quality and self.sats >= LOCK_MIN_SATS and
+						(0 == LOCK_MAX_HDOP or self.hdop <= LOCK_MAX_HDOP))
+			if good:
+				self.lat = parse_latlon(f[3], 2) * (-1 if 'S' == f[4] else 1)
+				self.lon = parse_latlon(f[5], 3) * (-1 if 'W' == f[6] else 1)
+			changed = False
+			if good == self.lock:
+				if 0 != self.run:
+					self.suppressed += 1
+					self.run = 0
+			else:
+				self.run += 1
+				if self.run >= (LOCK_ACQUIRE if good else LOCK_LOSE):
+					self.lock = int(good)
+					self.run = 0
+					if good:
+						self.acquired += 1
+					else:
+						self.lost += 1
+					changed = True
+			if len(f[9]) >= 6:
+				self.time = f[1][:6]
+				self.date = '%04d-%s-%s' % (2000 + int(f[9][4:6]), f[9][2:4], f[9][0:2])
+			if changed and self.lock:
+				self.grid = maidenhead4(self.lat, self.lon)
+
+	def header(self, name, what):
+		h = ['# %s: %s' % (name, what),
+			'# expect rmc_good=%d gga_good=%d gsa_good=%d zda_good=%d' % (
+				self.good['RMC'], self.good['GGA'], self.good['GSA'], self.good['ZDA']),
+			'# expect acquired=%d lost=%d suppressed=%d lock=%d' % (
+				self.acquired, self.lost, self.suppressed, self.lock),
+			'# expect lat=%d lon=%d' % (self.lat, self.lon)]
+		if self.date:
+			h.append('# expect date=%s time=%s' % (self.date, self.time))
+		if self.grid:
+			h.append('# expect grid=%s' % self.grid)
+		return '\n'.join(h) + '\n'
+
+
+class Corpus:
+	def __init__(self, name, what, seed):
+		self.name = name
+		self.what = what
+		self.rng = random.Random(seed)
+		self.model = Model()
+		self.out = []
+
+	def emit(self, sid, body):
+		'''an intact sentence'''
+		self.out.append(sentence(body).encode('ascii'))
+		if sid in self.model.good:
+			self.model.commit(sid, body)
+
+	def epoch(self, rx, mangle=None):
+		'''one second's worth; mangle(sid, text) may damage a sentence, returning
+		the bytes to send instead (or None to leave it alone)'''
+		for sid, body in rx.epoch():
+			damaged = mangle(sid, sentence(body)) if mangle else None
+			if damaged is None:
+				self.emit(sid, body)
+			else:
+				self.out.append(damaged)
+
+	def raw(self, by):
+		self.out.append(by)
+
+	def write(self, dirname):
+		with open(os.path.join(dirname, self.name + '.nmea'), 'wb') as f:
+			f.write(self.model.header(self.name, self.what).encode('ascii'))
+			f.write(b''.join(self.out))
+
+
+#somewhere well inside DM13
+HOME_LAT = 33794020
+HOME_LON = -117862150
+
+
+def cold_start():
+	c = Corpus('cold_start', 'power-up to lock, as a NEO-6M does it', 1)
+	rx = Receiver(datetime.datetime(2026, 10, 19, 6, 0, 0), HOME_LAT, HOME_LON, c.rng)
+	#no time at all, at first; then time but no fix
+	rx.time_known = False
+	rx.status = 'V'
+	rx.quality = 0
+	rx.sats = 0
+	for n in range(5):
+		c.epoch(rx)
+	rx.time_known = True
+	for n in range(20):
+		rx.sats = min(3, n // 6)
+		c.epoch(rx)
+	#a 2D fix on 3 satellites; not good enough
+	rx.status = 'A'
+	rx.quality = 1
+	rx.sats = 3
+	rx.hdop = 480
+	for n in range(4):
+		c.epoch(rx)
+	#then a proper one, settling in
+	for n in range(60):
+		rx.sats = min(9, 4 + n // 10)
+		rx.hdop = max(95, 300 - n * 5)
+		c.epoch(rx)
+	return c
+
+
+def lock_flaps():
+	c = Corpus('lock_flaps', 'a marginal antenna; the fix comes and goes in runs of every length', 2)
+	rx = Receiver(datetime.datetime(2026, 10, 19, 12, 0, 0), HOME_LAT, HOME_LON, c.rng)
+	for n in range(10):
+		c.epoch(rx)
+	#(bad runs, good runs) alternately
+	for bad, good in [(1, 5), (2, 1), (5, 3), (9, 2), (10, 1), (1, 2), (3, 12),
+			(12, 4), (15, 30), (1, 1), (1, 1), (11, 6)]:
+		for n in range(bad):
+			rx.status = 'V' if n % 3 else 'A'	#(some say A but GGA has no fix)
+			rx.quality = 0
+			rx.sats = 3
+			c.epoch(rx)
+		for n in range(good):
+			rx.status = 'A'
+			rx.quality = 1
+			rx.sats = 7
+			c.epoch(rx)
+	return c
+
+
+def dropouts():
+	c = Corpus('dropouts', 'a locked receiver on a noisy line, with lost bytes and seconds', 3)
+	rx = Receiver(datetime.datetime(2026, 10, 19, 18, 30, 0), HOME_LAT, HOME_LON, c.rng)
+	r = c.rng
+	for n in range(15):
+		c.epoch(rx)
+
+	def drop_byte(sid, text):
+		#a byte lost in the middle (an overrun)
+		if r.random() < 0.25:
+			i = r.randint(3, len(text) - 6)
+			return (text[:i] + text[i + 1:]).encode('ascii')
+		return None
+
+	def truncate(sid, text):
+		#the rest of the sentence lost (the DMA buffer lapped the reader)
+		if r.random() < 0.25:
+			return text[:r.randint(1, len(text) - 3)].encode('ascii')
+		return None
+
+	def flip(sid, text):
+		#a bit flipped (line noise); the checksum catches it
+		if r.random() < 0.25:
+			by = bytearray(text.encode('ascii'))
+			i = r.randint(1, len(by) - 6)
+			by[i] ^= 1 << r.randint(0, 6)
+			if by[i] in (ord('$'), ord('\r'), ord('\n'), ord('*')):
+				by[i] = ord('0')
+			return bytes(by)
+		return None
+
+	for mangle in (drop_byte, truncate, flip):
+		for n in range(40):
+			c.epoch(rx, mangle)
+		for n in range(5):
+			c.epoch(rx)
+	#whole seconds lost; nothing arrives at all
+	for gap in (1, 4, 12, 30):
+		for n in range(gap):
+			rx.epoch()
+		for n in range(5):
+			c.epoch(rx)
+	return c
+
+
+def garbage():
+	c = Corpus('garbage', 'line noise, wrong bit rates, binary, and malformed or unwanted sentences', 4)
+	rx = Receiver(datetime.datetime(2026, 10, 19, 21, 0, 0), HOME_LAT, HOME_LON, c.rng)
+	r = c.rng
+	noise = [b for b in range(256) if b not in b'$#']
+
+	def junk(n):
+		return bytes(r.choice(noise) for i in range(n))
+
+	#the receiver at a different bit rate looks like this
+	c.raw(junk(300))
+	for n in range(10):
+		c.epoch(rx)
+	bad = [
+		#UBX binary (an ACK-ACK and a NAV-SOL fragment)
+		b'\xb5\x62\x05\x01\x02\x00\x06\x01\x0f\x38',
+		b'\xb5\x62\x01\x06\x34\x00' + junk(52),
+		#sentences we don't want (the parser skips them on the id)
+		sentence('GPGSV,3,1,11,02,59,263,41,05,33,185,37,07,14,058,30,09,31,319,36').encode(),
+		sentence('GPVTG,,T,,M,0.012,N,0.022,K,A').encode(),
+		sentence('GPGLL,3347.64120,N,11751.72900,W,183000.00,A,A').encode(),
+		sentence('GPTXT,01,01,02,u-blox ag - www.u-blox.com').encode(),
+		sentence('PUBX,00,183000.00,3347.64120,N,11751.72900,W,123.4,G3,2.1,2.0,0.0,0,0.0,0,1.0,1.0,1.2,9,0,0').encode(),
+		#wanted ones, but broken:  no checksum, bad checksum, bad hex
+		b'$GPRMC,210000.00,A,3347.64120,N,11751.72900,W,0.0,,191026,,,A\r\n',
+		b'$GPRMC,210000.00,A,3347.64120,N,11751.72900,W,0.0,,191026,,,A*00\r\n',
+		b'$GPGGA,210000.00,3347.64120,N,11751.72900,W,1,08,1.01,123.4,M,-32.1,M,,*G7\r\n',
+		#a field too long to be real, and a runaway sentence
+		b'$GPGGA,210000.00,3347.641200000000000000,N,11751.72900,W,1,08,1.01,123.4,M,,M,,*00\r\n',
+		b'$GPGSA,A,3,' + b'02,' * 40 + b'\r\n',
+		#a talker that isn't letters, and an id that's nearly right
+		sentence('G1RMC,210000.00,A,3347.64120,N,11751.72900,W,0.0,,191026,,,A').encode(),
+		sentence('GPRMB,A,0.66,L,003,004,4917.24,N,12309.57,W,001.3,052.5,000.5,V').encode(),
+		sentence('GPGGAX,210000.00,,,,,0,00,99.99,,,,,,').encode(),
+		#a sentence started over by a '$' in the middle
+		b'$GPRMC,210000.00,A,3347.6$GPTXT,01,01,02,ANTSTATUS=OK*3B\r\n',
+		#a lone CR LF and a bare '$'
+		b'\r\n', b'$\r\n',
+	]
+	for n in range(60):
+		if 0 == n % 3:
+			c.raw(junk(r.randint(1, 40)))
+		c.raw(r.choice(bad))
+		c.epoch(rx)
+	#lower case checksum hex is fine
+	body = 'GPZDA,%s.00,%02d,%02d,%04d,00,00' % (rx.t.strftime('%H%M%S'), rx.t.day, rx.t.month, rx.t.year)
+	c.raw(('$%s*%02x\r\n' % (body, checksum(body))).encode('ascii'))
+	c.model.commit('ZDA', body)
+	for n in range(5):
+		c.epoch(rx)
+	return c
+
+
+def rollover():
+	c = Corpus('rollover', 'acquiring lock seconds before the new year, and running through it', 5)
+	rx = Receiver(datetime.datetime(2026, 12, 31, 23, 59, 40), HOME_LAT, HOME_LON, c.rng)
+	rx.status = 'V'
+	rx.quality = 0
+	rx.sats = 3
+	for n in range(14):
+		c.epoch(rx)
+	rx.status = 'A'
+	rx.quality = 1
+	rx.sats = 6
+	for n in range(40):
+		c.epoch(rx)
+	return c
+
+
+def main():
+	here = os.path.dirname(os.path.abspath(__file__))
+	dirname = os.path.join(here, 'corpus')
+	os.makedirs(dirname, exist_ok=True)
+	for make in (cold_start, lock_flaps, dropouts, garbage, rollover):
+		c = make()
+		c.write(dirname)
+		m = c.model
+		print('%-12s %6d bytes; %d RMC, acquired %d, lost %d' % (c.name,
+				sum(len(b) for b in c.out), m.good['RMC'], m.acquired, m.lost))
+
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,86 @@
+//==============================================================
+//Host stand-in for the CMSIS-RTOS (FreeRTOS) API, for building the target-
+//independent modules into host tests.
+//This module is part of the CarelessWSPR project.
+//
+//Only what those modules use is here.  'Tasks' are just notification
+//mailboxes; nothing runs concurrently.  Notifications accumulate in the
+//receiving task's value, and the test takes them (HostRTOS_take()) whenever
+//it likes, which is what the real task would see on its next wakeup.  Time is
+//a tick count that only moves when the test moves it (or something delays).
+
+#ifndef __CMSIS_OS_H
+#define __CMSIS_OS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+typedef long BaseType_t;
+typedef unsigned long UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE	0
+#define pdTRUE	1
+#define pdPASS	1
+#define pdFAIL	0
+#define portMAX_DELAY	0xffffffffUL
+#define pdMS_TO_TICKS(ms)	((TickType_t)(ms))	//1 kHz tick, as on the target
+
+typedef enum
+{
+	eNoAction = 0,
+	eSetBits,
+	eIncrement,
+	eSetValueWithOverwrite,
+	eSetValueWithoutOverwrite,
+} eNotifyAction;
+
+
+//a 'task'
+typedef struct HostTask HostTask;
+struct HostTask
+{
+	const char* _pszName;
+	uint32_t _nNotified;	//pending notification bits
+	uint32_t _nNotifies;	//how many times it has been notified
+};
+
+typedef HostTask* osThreadId;
+typedef struct { int _dummy; } osStaticThreadDef_t;
+
+
+BaseType_t xTaskNotify ( osThreadId h, uint32_t ulValue, eNotifyAction eAction );
+BaseType_t xTaskNotifyFromISR ( osThreadId h, uint32_t ulValue, eNotifyAction eAction,
+		BaseType_t* pxHigherPriorityTaskWoken );
+//this waits on the 'current' task (see HostRTOS_setCurrent()); if nothing is
+//pending, the time passes and it returns pdFAIL
+BaseType_t xTaskNotifyWait ( uint32_t ulBitsToClearOnEntry, uint32_t ulBitsToClearOnExit,
+		uint32_t* pulNotificationValue, TickType_t xTicksToWait );
+osThreadId xTaskGetCurrentTaskHandle ( void );
+
+#define portYIELD_FROM_ISR(x)	((void)(x))
+#define taskENTER_CRITICAL()	do {} while (0)
+#define taskEXIT_CRITICAL()		do {} while (0)
+
+typedef int osStatus;
+osStatus osDelay ( uint32_t millisec );
+
+
+//test controls
+void HostRTOS_setCurrent ( osThreadId h );
+//take (and clear) a task's pending notification bits
+uint32_t HostRTOS_take ( osThreadId h );
+void HostRTOS_setTick ( uint32_t nTick );
+void HostRTOS_advance ( uint32_t nTicks );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,182 @@
+//==============================================================
+//Host stand-ins for the board services; see host_board.h.
+//This module is part of the CarelessWSPR project.
+
+#include "stm32f1xx_hal.h"
+#include "cmsis_os.h"
+#include "host_board.h"
+
+#include "CarelessWSPR_settings.h"
+#include "serial_devices.h"
+
+#include <string.h>
+
+
+
+//====================================================
+//settings; the out-of-box defaults, as g_defaultSettings in
+//CarelessWSPR_settings.c (which needs the flash, so can't come along)
+
+
+static const PersistentSettings _defaultSettings =
+{
+	._version = PERSET_VERSION,
+	._dialFreqHz = 14095600,
+	._nSubBand = -1,
+	._nDutyPct = 20,
+	._nTxPowerDbm = 10,
+	._bUseGPS = 1,
+	._nGPSbitRate = 9600,
+	._nWSPRSchedMode = 1,
+	._bGPSConfigUBX = 1,
+	._nLockAcquire = 3,
+	._nLockLose = 10,
+	._nLockMinSats = 4,
+	._nMonitorPorts = 1,
+};
+
+static PersistentSettings _settings;
+
+
+void Settings_restoreDefaults ( void )
+{
+	_settings = _defaultSettings;
+}
+
+
+PersistentSettings* Settings_getStruct ( void )
+{
+	return &_settings;
+}
+
+
+
+//====================================================
+//the WSPR task; the tests look at what was posted to it
+
+
+HostTask g_htWSPR = { "WSPR", 0, 0 };
+osThreadId g_thWSPR = &g_htWSPR;
+
+
+
+//====================================================
+//serial
+
+
+UART_HandleTypeDef g_huartHost = { NULL, { 9600 } };
+
+
+int UART1_setBitRate ( uint32_t nBitRate )
+{
+	g_huartHost.Init.BaudRate = nBitRate;
+	return 1;
+}
+
+
+int UART1_transmitIdle ( void )
+{
+	return 1;
+}
+
+
+uint32_t UART1_rxInterrupts ( void )
+{
+	return 0;
+}
+
+
+
+static size_t _hsReceiveAvailable ( const IOStreamIF* pthis )
+{
+	const HostStream* phs = (const HostStream*) pthis;
+	return phs->_nDelivered - phs->_nPos;
+}
+
+
+static size_t _hsReceive ( const IOStreamIF* pthis, void* pv, const size_t nLen )
+{
+	HostStream* phs = (HostStream*) pthis;
+	size_t nAvail = phs->_nDelivered - phs->_nPos;
+	size_t nPulled = ( nLen < nAvail ) ? nLen : nAvail;
+	memcpy ( pv, &phs->_pby[phs->_nPos], nPulled );
+	phs->_nPos += nPulled;
+	return nPulled;
+}
+
+
+static void _hsFlushReceive ( const IOStreamIF* pthis )
+{
+	HostStream* phs = (HostStream*) pthis;
+	phs->_nPos = phs->_nDelivered;
+}
+
+
+static size_t _hsTransmitFree ( const IOStreamIF* pthis )
+{
+	(void) pthis;
+	return 0xffff;
+}
+
+
+static size_t _hsTransmit ( const IOStreamIF* pthis, const void* pv, size_t nLen )
+{
+	HostStream* phs = (HostStream*) pthis;
+	(void) pv;
+	phs->_nTransmitted += nLen;
+	return nLen;
+}
+
+
+static void _hsFlushTransmit ( const IOStreamIF* pthis )
+{
+	(void) pthis;
+}
+
+
+static int _hsTransmitCompletely ( const IOStreamIF* pthis, const void* pv, size_t nLen, uint32_t to )
+{
+	(void) to;
+	_hsTransmit ( pthis, pv, nLen );
+	return 0;
+}
+
+
+static int _hsReceiveCompletely ( const IOStreamIF* pthis, void* pv, const size_t nLen, uint32_t to )
+{
+	(void) to;
+	return (int)( nLen - _hsReceive ( pthis, pv, nLen ) );
+}
+
+
+void HostStream_init ( HostStream* phs, const void* pv, size_t nLen )
+{
+	memset ( phs, 0, sizeof(*phs) );
+	phs->_if._flushTransmit = _hsFlushTransmit;
+	phs->_if._transmitFree = _hsTransmitFree;
+	phs->_if._transmit = _hsTransmit;
+	phs->_if._flushReceive = _hsFlushReceive;
+	phs->_if._receiveAvailable = _hsReceiveAvailable;
+	phs->_if._receive = _hsReceive;
+	phs->_if._transmitCompletely = _hsTransmitCompletely;
+	phs->_if._receiveCompletely = _hsReceiveCompletely;
+	phs->_if.huart = &g_huartHost;
+	phs->_pby = (const uint8_t*) pv;
+	phs->_nLen = nLen;
+}
+
+
+size_t HostStream_deliver ( HostStream* phs, size_t nLen )
+{
+	size_t nLeft = phs->_nLen - phs->_nDelivered;
+	if ( nLen > nLeft )
+		nLen = nLeft;
+	phs->_nDelivered += nLen;
+	return nLen;
+}
+
+
+int HostStream_done ( const HostStream* phs )
+{
+	return phs->_nPos == phs->_nLen;
+}
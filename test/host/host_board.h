@@ -0,0 +1,56 @@
+//==============================================================
+//Host stand-ins for the board services (settings, serial ports) that the
+//target-independent modules call, for building them into host tests.
+//This module is part of the CarelessWSPR project.
+
+#ifndef __HOST_BOARD_H
+#define __HOST_BOARD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cmsis_os.h"
+#include "stm32f1xx_hal.h"
+#include "system_interfaces.h"
+
+
+//An IOStreamIF that reads from memory.  Only what has been 'delivered' can
+//be received, so the test decides how the bytes arrive (e.g. a sentence at
+//a time, or in DMA-sized bursts).  What is transmitted is counted and
+//discarded.
+typedef struct HostStream HostStream;
+struct HostStream
+{
+	IOStreamIF _if;			//must be first
+	const uint8_t* _pby;	//the whole recording
+	size_t _nLen;
+	size_t _nDelivered;		//how much of it has 'arrived'
+	size_t _nPos;			//how much of that has been received
+	size_t _nTransmitted;
+};
+
+void HostStream_init ( HostStream* phs, const void* pv, size_t nLen );
+//make up to nLen more bytes available; returns how many
+size_t HostStream_deliver ( HostStream* phs, size_t nLen );
+//everything has been delivered and received
+int HostStream_done ( const HostStream* phs );
+
+//(The settings start out all zero; call Settings_restoreDefaults() to get
+//the firmware's out-of-box ones.)
+
+//the stand-in for the UART1 handle (so the bit rate can be changed/read)
+extern UART_HandleTypeDef g_huartHost;
+
+//the WSPR task's 'handle'; notifications to it collect here
+extern HostTask g_htWSPR;
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,109 @@
+//==============================================================
+//Host stand-in for the RTOS and HAL services; see cmsis_os.h.
+//This module is part of the CarelessWSPR project.
+
+#include "cmsis_os.h"
+#include "stm32f1xx_hal.h"
+
+
+static uint32_t _nTick;
+static osThreadId _thCurrent;
+
+
+BaseType_t xTaskNotify ( osThreadId h, uint32_t ulValue, eNotifyAction eAction )
+{
+	if ( NULL == h )
+		return pdFAIL;
+	switch ( eAction )
+	{
+	case eSetBits:
+		h->_nNotified |= ulValue;
+	break;
+	case eIncrement:
+		++h->_nNotified;
+	break;
+	case eSetValueWithOverwrite:
+	case eSetValueWithoutOverwrite:
+		h->_nNotified = ulValue;
+	break;
+	default:
+	break;
+	}
+	++h->_nNotifies;
+	return pdPASS;
+}
+
+
+BaseType_t xTaskNotifyFromISR ( osThreadId h, uint32_t ulValue, eNotifyAction eAction,
+		BaseType_t* pxHigherPriorityTaskWoken )
+{
+	if ( NULL != pxHigherPriorityTaskWoken )
+		*pxHigherPriorityTaskWoken = pdFALSE;
+	return xTaskNotify ( h, ulValue, eAction );
+}
+
+
+BaseType_t xTaskNotifyWait ( uint32_t ulBitsToClearOnEntry, uint32_t ulBitsToClearOnExit,
+		uint32_t* pulNotificationValue, TickType_t xTicksToWait )
+{
+	if ( NULL == _thCurrent )
+		return pdFAIL;
+	if ( 0 == _thCurrent->_nNotified )
+	{
+		//nothing will come while we 'wait'; just let the time go by
+		if ( portMAX_DELAY != xTicksToWait )
+			_nTick += xTicksToWait;
+		return pdFAIL;
+	}
+	_thCurrent->_nNotified &= ~ulBitsToClearOnEntry;
+	if ( NULL != pulNotificationValue )
+		*pulNotificationValue = _thCurrent->_nNotified;
+	_thCurrent->_nNotified &= ~ulBitsToClearOnExit;
+	return pdPASS;
+}
+
+
+osThreadId xTaskGetCurrentTaskHandle ( void )
+{
+	return _thCurrent;
+}
+
+
+osStatus osDelay ( uint32_t millisec )
+{
+	_nTick += millisec;
+	return 0;
+}
+
+
+uint32_t HAL_GetTick ( void )
+{
+	return _nTick;
+}
+
+
+
+void HostRTOS_setCurrent ( osThreadId h )
+{
+	_thCurrent = h;
+}
+
+
+uint32_t HostRTOS_take ( osThreadId h )
+{
+	uint32_t nBits = h->_nNotified;
+	h->_nNotified = 0;
+	return nBits;
+}
+
+
+void HostRTOS_setTick ( uint32_t nTick )
+{
+	_nTick = nTick;
+}
+
+
+void HostRTOS_advance ( uint32_t nTicks )
+{
+	_nTick += nTicks;
+}
@@ -0,0 +1,38 @@
+//==============================================================
+//Host stand-in for the bits of the STM32 HAL that the target-independent
+//modules use, for building them into host tests.
+//This module is part of the CarelessWSPR project.
+
+#ifndef __STM32F1xx_HAL_H
+#define __STM32F1xx_HAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+
+#define __weak	__attribute__((weak))
+#define __DMB()	__sync_synchronize()
+
+typedef struct
+{
+	uint32_t BaudRate;
+} UART_InitTypeDef;
+
+typedef struct
+{
+	void* Instance;
+	UART_InitTypeDef Init;
+} UART_HandleTypeDef;
+
+//the tick (ms); see HostRTOS_setTick()
+uint32_t HAL_GetTick ( void );
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,49 @@
+//==============================================================
+//What the host tests share:  failure counting, and timing.
+//This module is part of the CarelessWSPR project.
+//
+//Each test includes this once; the failure count is the test's own.  CHECK
+//counts a failure and says where it was (only the first 20 are printed, so a
+//broken loop doesn't bury the rest).  The count is volatile, as some tests
+//check it from more than one thread.
+
+#ifndef __TEST_UTIL_H
+#define __TEST_UTIL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+
+static volatile unsigned long _nFailures = 0;
+
+#define CHECK(cond, ...) \
+	do { if ( ! (cond) ) { if ( ++_nFailures <= 20 ) { \
+		printf ( "FAIL %s:%d: ", __FILE__, __LINE__ ); \
+		printf ( __VA_ARGS__ ); printf ( "\n" ); } } } while (0)
+
+
+//seconds, from some fixed point
+static inline double _now ( void )
+{
+	struct timespec ts;
+	clock_gettime ( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+
+//a cycle-ish count; the TSC on x86, else nothing
+static inline uint64_t _cycles ( void )
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	return 0;
+#endif
+}
+
+
+#endif
@@ -0,0 +1,106 @@
+//==============================================================
+//A byte queue's put and get, for one flavour of queue, for test_queues.
+//This module is part of the CarelessWSPR project.
+//
+//This is built once for each flavour (QUEUE_FLAVOUR below), each to its own
+//object, so that the size of each object is the code one instance of that
+//flavour costs, and so that all of them are called the same way (not inlined
+//into the caller) when they are timed.  For the generic flavours the shared
+//library code (util_circbuff2.o, util_spscbuff.o) is on top of this, once.
+
+#include "util_circbuff2.h"
+#include "util_spscbuff.h"
+
+#include "queue_ops.h"
+
+
+
+#if QUEUE_FLAVOUR == QUEUE_CIRCBUFF
+
+CIRCBUF(_qCircbuff,uint8_t,QUEUE_OPS_SIZE)
+
+void circbuff_ops_init ( void )
+{
+	circbuff_init ( &_qCircbuff );
+}
+
+int circbuff_ops_put ( uint8_t by )
+{
+	return circbuff_enqueue ( &_qCircbuff, &by );
+}
+
+int circbuff_ops_get ( uint8_t* pby )
+{
+	if ( circbuff_empty ( &_qCircbuff ) )
+		return 0;
+	circbuff_dequeue ( &_qCircbuff, pby );
+	return 1;
+}
+
+
+#elif QUEUE_FLAVOUR == QUEUE_CIRCBUF_SIMPLE
+
+CIRCBUF_SIMPLE(_q,uint8_t,QUEUE_OPS_SIZE)
+
+void circbuf_simple_ops_init ( void )
+{
+	_q_init();
+}
+
+int circbuf_simple_ops_put ( uint8_t by )
+{
+	return _q_enqueue ( by );
+}
+
+int circbuf_simple_ops_get ( uint8_t* pby )
+{
+	if ( _q_empty() )
+		return 0;
+	*pby = _q_dequeue();
+	return 1;
+}
+
+
+#elif QUEUE_FLAVOUR == QUEUE_SPSCBUFF
+
+SPSCBUF(_qSpscbuff,QUEUE_OPS_SIZE)
+
+void spscbuff_ops_init ( void )
+{
+	spscbuff_init ( &_qSpscbuff );
+}
+
+int spscbuff_ops_put ( uint8_t by )
+{
+	return (int) spscbuff_write ( &_qSpscbuff, &by, 1 );
+}
+
+int spscbuff_ops_get ( uint8_t* pby )
+{
+	return (int) spscbuff_read ( &_qSpscbuff, pby, 1 );
+}
+
+
+#elif QUEUE_FLAVOUR == QUEUE_SPSCBUF_SIMPLE
+
+SPSCBUF_SIMPLE(_q,uint8_t,QUEUE_OPS_SIZE)
+
+void spscbuf_simple_ops_init ( void )
+{
+	_q_init();
+}
+
+int spscbuf_simple_ops_put ( uint8_t by )
+{
+	return _q_enqueue ( by );
+}
+
+int spscbuf_simple_ops_get ( uint8_t* pby )
+{
+	return _q_dequeue ( pby );
+}
+
+
+#else
+#error unknown QUEUE_FLAVOUR
+#endif
@@ -0,0 +1,49 @@
+//==============================================================
+//A byte queue's put and get, for each flavour of queue, for test_queues.
+//This module is part of the CarelessWSPR project.
+
+#ifndef __QUEUE_OPS_H
+#define __QUEUE_OPS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+
+//the flavours (queue_ops.c is built once for each)
+#define QUEUE_CIRCBUFF			0	//circbuff_*
+#define QUEUE_CIRCBUF_SIMPLE	1	//CIRCBUF_SIMPLE
+#define QUEUE_SPSCBUFF			2	//spscbuff_*
+#define QUEUE_SPSCBUF_SIMPLE	3	//SPSCBUF_SIMPLE
+
+//the queues are the size of the CDC ones
+#define QUEUE_OPS_SIZE	128
+
+
+//put is true on success (false if full); get is true on success (false if
+//empty)
+void circbuff_ops_init ( void );
+int circbuff_ops_put ( uint8_t by );
+int circbuff_ops_get ( uint8_t* pby );
+
+void circbuf_simple_ops_init ( void );
+int circbuf_simple_ops_put ( uint8_t by );
+int circbuf_simple_ops_get ( uint8_t* pby );
+
+void spscbuff_ops_init ( void );
+int spscbuff_ops_put ( uint8_t by );
+int spscbuff_ops_get ( uint8_t* pby );
+
+void spscbuf_simple_ops_init ( void );
+int spscbuf_simple_ops_put ( uint8_t by );
+int spscbuf_simple_ops_get ( uint8_t* pby );
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,249 @@
+//==============================================================
+//This is a host stress test of the lock-free SPSC byte queues.
+//This module is part of the CarelessWSPR project.
+//
+//One thread plays the ISR and the other the task.  The producer pushes a
+//sequence (2M bytes by default) through a 64 byte queue and the consumer
+//checks that every byte comes out in order, with nothing lost, duplicated,
+//or torn.  Neither side locks.  Both use random-sized chunks, and mix the
+//bulk calls, the spans, and single items.  Each run is done twice, with
+//either thread started first.  Both the generic spscbuff and the
+//type-specialized SPSCBUF_SIMPLE are tested.
+//
+//On a host with one CPU the threads only meet at preemption, so the spin
+//loops yield; with more they really run at once, which is the harder test.
+//
+//usage:  spsc_stress [bytes]
+
+#include "util_spscbuff.h"
+
+#include "host/test_util.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+#define QUEUE_SIZE	64
+#define MAXCHUNK	(QUEUE_SIZE + QUEUE_SIZE/2)	//(sometimes more than fits)
+
+SPSCBUF(_sbGeneric,QUEUE_SIZE)
+SPSCBUF_SIMPLE(_sbSimple,uint8_t,QUEUE_SIZE)
+
+
+static unsigned long _nTotal = 2UL * 1024 * 1024;
+
+
+//the byte at position n of the stream; not periodic in the queue size, so a
+//lost, repeated, or stale byte shows
+static uint8_t _seq ( unsigned long n )
+{
+	return (uint8_t)( n * 31 + ( n >> 7 ) );
+}
+
+
+
+//====================================================
+//one side or the other
+
+
+typedef struct Side Side;
+struct Side
+{
+	int _bSimple;			//SPSCBUF_SIMPLE, else spscbuff
+	unsigned int _nSeed;
+	unsigned long _nSpins;	//times we found the queue full (or empty)
+};
+
+
+static void* _producer ( void* pv )
+{
+	Side* ps = (Side*) pv;
+	uint8_t abyChunk[MAXCHUNK];
+	unsigned long nNext = 0;
+	unsigned int nIdx;
+	//(if the consumer gives up, it stops reading, so we stop, too)
+	while ( nNext < _nTotal && 0 == _nFailures )
+	{
+		unsigned int nWant = 1 + (unsigned int) rand_r ( &ps->_nSeed ) % MAXCHUNK;
+		if ( nWant > _nTotal - nNext )
+			nWant = (unsigned int)( _nTotal - nNext );
+		for ( nIdx = 0; nIdx < nWant; ++nIdx )
+			abyChunk[nIdx] = _seq ( nNext + nIdx );
+
+		unsigned int nDone = 0;
+		int nHow = rand_r ( &ps->_nSeed ) % 3;
+		if ( ps->_bSimple )
+		{
+			if ( 0 == nHow )
+			{
+				while ( nDone < nWant && _sbSimple_enqueue ( abyChunk[nDone] ) )
+					++nDone;
+			}
+			else
+			{
+				nDone = _sbSimple_write ( abyChunk, nWant );
+			}
+		}
+		else if ( 0 == nHow )
+		{
+			circbuff_span_t asSpans[2];
+			spscbuff_writeSpans ( &_sbGeneric, asSpans );
+			for ( nIdx = 0; nIdx < 2; ++nIdx )
+			{
+				unsigned int n = asSpans[nIdx]._nCount;
+				if ( n > nWant - nDone )
+					n = nWant - nDone;
+				memcpy ( asSpans[nIdx]._pv, &abyChunk[nDone], n );
+				nDone += n;
+			}
+			spscbuff_commit ( &_sbGeneric, nDone );
+		}
+		else
+		{
+			nDone = spscbuff_write ( &_sbGeneric, abyChunk, nWant );
+		}
+
+		if ( 0 == nDone )
+		{
+			++ps->_nSpins;
+			sched_yield();
+		}
+		nNext += nDone;
+	}
+	return NULL;
+}
+
+
+static void* _consumer ( void* pv )
+{
+	Side* ps = (Side*) pv;
+	uint8_t abyChunk[MAXCHUNK];
+	unsigned long nNext = 0;
+	unsigned int nIdx;
+	while ( nNext < _nTotal && 0 == _nFailures )
+	{
+		unsigned int nWant = 1 + (unsigned int) rand_r ( &ps->_nSeed ) % MAXCHUNK;
+		unsigned int nDone = 0;
+		int nHow = rand_r ( &ps->_nSeed ) % 3;
+		unsigned int nCount = ps->_bSimple ? _sbSimple_count() : spscbuff_count ( &_sbGeneric );
+		CHECK ( nCount <= QUEUE_SIZE, "count %u", nCount );
+
+		if ( ps->_bSimple )
+		{
+			if ( 0 == nHow )
+			{
+				while ( nDone < nWant && _sbSimple_dequeue ( &abyChunk[nDone] ) )
+					++nDone;
+			}
+			else if ( 1 == nHow )
+			{
+				uint8_t* pby;
+				nDone = _sbSimple_readSpan ( &pby );
+				if ( nDone > nWant )
+					nDone = nWant;
+				memcpy ( abyChunk, pby, nDone );
+				_sbSimple_consume ( nDone );
+			}
+			else
+			{
+				nDone = _sbSimple_read ( abyChunk, nWant );
+			}
+		}
+		else if ( 0 == nHow )
+		{
+			circbuff_span_t asSpans[2];
+			spscbuff_readSpans ( &_sbGeneric, asSpans );
+			for ( nIdx = 0; nIdx < 2; ++nIdx )
+			{
+				unsigned int n = asSpans[nIdx]._nCount;
+				if ( n > nWant - nDone )
+					n = nWant - nDone;
+				memcpy ( &abyChunk[nDone], asSpans[nIdx]._pv, n );
+				nDone += n;
+			}
+			spscbuff_consume ( &_sbGeneric, nDone );
+		}
+		else
+		{
+			nDone = spscbuff_read ( &_sbGeneric, abyChunk, nWant );
+		}
+
+		for ( nIdx = 0; nIdx < nDone; ++nIdx )
+		{
+			CHECK ( abyChunk[nIdx] == _seq ( nNext + nIdx ), "byte %lu: %02x, expected %02x",
+					nNext + nIdx, abyChunk[nIdx], _seq ( nNext + nIdx ) );
+		}
+		if ( 0 == nDone )
+		{
+			++ps->_nSpins;
+			sched_yield();
+		}
+		nNext += nDone;
+	}
+	return NULL;
+}
+
+
+
+//====================================================
+//a run
+
+
+static void _run ( int bSimple, int bProducerFirst, const char* pszName )
+{
+	Side sProd = { bSimple, 11, 0 };
+	Side sCons = { bSimple, 23, 0 };
+	pthread_t thProd, thCons;
+
+	if ( bSimple )
+		_sbSimple_init();
+	else
+		spscbuff_init ( &_sbGeneric );
+
+	double tStart = _now();
+	if ( bProducerFirst )
+	{
+		pthread_create ( &thProd, NULL, _producer, &sProd );
+		pthread_create ( &thCons, NULL, _consumer, &sCons );
+	}
+	else
+	{
+		pthread_create ( &thCons, NULL, _consumer, &sCons );
+		pthread_create ( &thProd, NULL, _producer, &sProd );
+	}
+	pthread_join ( thProd, NULL );
+	pthread_join ( thCons, NULL );
+	double tRun = _now() - tStart;
+
+	unsigned int nLeft = bSimple ? _sbSimple_count() : spscbuff_count ( &_sbGeneric );
+	unsigned int nMax = bSimple ? _sbSimple_max() : spscbuff_max ( &_sbGeneric );
+	CHECK ( 0 == nLeft, "%s: %u left over", pszName, nLeft );
+	CHECK ( nMax <= QUEUE_SIZE, "%s: high-water %u", pszName, nMax );
+	printf ( "%s: %lu bytes in %.2f s; full %lu, empty %lu times; high-water %u\n",
+			pszName, _nTotal, tRun, sProd._nSpins, sCons._nSpins, nMax );
+}
+
+
+
+int main ( int argc, char* argv[] )
+{
+	if ( argc > 1 )
+		_nTotal = strtoul ( argv[1], NULL, 0 );
+
+	_run ( 0, 1, "spscbuff" );
+	_run ( 0, 0, "spscbuff (consumer first)" );
+	_run ( 1, 1, "SPSCBUF_SIMPLE" );
+	_run ( 1, 0, "SPSCBUF_SIMPLE (consumer first)" );
+
+	if ( 0 != _nFailures )
+	{
+		printf ( "spsc_stress: %lu FAILURES\n", _nFailures );
+		return 1;
+	}
+	printf ( "spsc_stress: ok\n" );
+	return 0;
+}
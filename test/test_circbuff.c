@@ -0,0 +1,261 @@
+//==============================================================
+//This is a host test and benchmark of the circbuff bulk (span) access.
+//This module is part of the CarelessWSPR project.
+//
+//circbuff_write()/circbuff_read() replaced byte-at-a-time enqueue/dequeue
+//loops in the serial I/O.  This checks the spans, commit/consume, and the
+//bulk copies against a plain FIFO model through every wrap position, for
+//byte and multi-byte items.  Then it measures throughput in bytes per
+//microsecond, byte-at-a-time versus bulk, through a queue the size of the
+//CDC ones.
+//
+//(The host numbers are for comparing the two ways of doing it; on the target
+//each call also has the critical section around it, which the bulk way
+//enters once per span rather than once per byte.)
+//
+//usage:  test_circbuff [-b]
+//	-b	only run the benchmark
+
+#include "util_circbuff2.h"
+
+#include "host/test_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+//the queues under test; the byte one is the size of the CDC queues
+#define QUEUE_SIZE	128
+
+CIRCBUF(_cbBytes,uint8_t,QUEUE_SIZE)
+CIRCBUF(_cbWords,uint32_t,16)
+
+
+
+//====================================================
+//against a model
+
+
+//the spans must cover exactly the free (or used) count, the first must start
+//where the next item goes (or comes from), and the second (if any) must start
+//at the beginning of the buffer
+static void _checkSpans ( void* pvCirc, const volatile uint8_t* pbyBuffer,
+		unsigned int nTypeSize, unsigned int nCount )
+{
+	circbuff_span_t asSpans[2];
+	unsigned int nCap = circbuff_capacity ( pvCirc );
+
+	unsigned int nFree = circbuff_writeSpans ( pvCirc, asSpans );
+	CHECK ( nFree == nCap - nCount, "free %u, expected %u", nFree, nCap - nCount );
+	CHECK ( asSpans[0]._nCount + asSpans[1]._nCount == nFree, "write spans %u+%u != %u",
+			asSpans[0]._nCount, asSpans[1]._nCount, nFree );
+	CHECK ( 0 == asSpans[1]._nCount || (const volatile uint8_t*) asSpans[1]._pv == pbyBuffer,
+			"second write span not at start" );
+	CHECK ( (const volatile uint8_t*) asSpans[0]._pv + asSpans[0]._nCount * nTypeSize <=
+			pbyBuffer + nCap * nTypeSize, "first write span runs off the end" );
+
+	unsigned int nUsed = circbuff_readSpans ( pvCirc, asSpans );
+	CHECK ( nUsed == nCount, "count %u, expected %u", nUsed, nCount );
+	CHECK ( asSpans[0]._nCount + asSpans[1]._nCount == nUsed, "read spans %u+%u != %u",
+			asSpans[0]._nCount, asSpans[1]._nCount, nUsed );
+	CHECK ( 0 == asSpans[1]._nCount || (const volatile uint8_t*) asSpans[1]._pv == pbyBuffer,
+			"second read span not at start" );
+	CHECK ( (const volatile uint8_t*) asSpans[0]._pv + asSpans[0]._nCount * nTypeSize <=
+			pbyBuffer + nCap * nTypeSize, "first read span runs off the end" );
+}
+
+
+//random-sized writes and reads, mixing the bulk calls, the spans, and single
+//items, checking everything that comes out is what went in, in order
+static void _testModel ( void* pvCirc, const volatile uint8_t* pbyBuffer,
+		unsigned int nTypeSize, const char* pszName )
+{
+	enum { NOPS = 200000, MAXCHUNK = 40 };
+	unsigned int nCap = circbuff_capacity ( pvCirc );
+	uint32_t nNextIn = 0;		//the sequence number of the next item we put
+	uint32_t nNextOut = 0;		//the sequence number of the next item we expect
+	uint8_t abyChunk[MAXCHUNK * sizeof(uint32_t)];
+	unsigned int nOp, nIdx, nByte;
+
+	circbuff_init ( pvCirc );
+	srand ( 2 );
+	for ( nOp = 0; nOp < NOPS; ++nOp )
+	{
+		unsigned int nCount = nNextIn - nNextOut;
+		_checkSpans ( pvCirc, pbyBuffer, nTypeSize, nCount );
+
+		unsigned int nWant = (unsigned int) rand() % ( MAXCHUNK + 1 );
+		int nHow = rand() % 3;
+		if ( rand() & 1 )
+		{
+			//put
+			unsigned int nFit = nCap - nCount;
+			unsigned int nExpect = nWant < nFit ? nWant : nFit;
+			for ( nIdx = 0; nIdx < nWant; ++nIdx )
+				for ( nByte = 0; nByte < nTypeSize; ++nByte )
+					abyChunk[nIdx * nTypeSize + nByte] = (uint8_t)( ( nNextIn + nIdx ) * 7 + nByte );
+			unsigned int nDone = 0;
+			if ( 0 == nHow )
+			{
+				nDone = circbuff_write ( pvCirc, abyChunk, nWant );
+			}
+			else if ( 1 == nHow )
+			{
+				circbuff_span_t asSpans[2];
+				circbuff_writeSpans ( pvCirc, asSpans );
+				for ( nIdx = 0; nIdx < 2 && nDone < nExpect; ++nIdx )
+				{
+					unsigned int n = asSpans[nIdx]._nCount;
+					if ( n > nExpect - nDone )
+						n = nExpect - nDone;
+					memcpy ( asSpans[nIdx]._pv, &abyChunk[nDone * nTypeSize], n * nTypeSize );
+					nDone += n;
+				}
+				circbuff_commit ( pvCirc, nDone );
+			}
+			else
+			{
+				while ( nDone < nWant && circbuff_enqueue ( pvCirc, &abyChunk[nDone * nTypeSize] ) )
+					++nDone;
+			}
+			CHECK ( nDone == nExpect, "%s: put %u of %u, expected %u", pszName, nDone, nWant, nExpect );
+			nNextIn += nDone;
+		}
+		else
+		{
+			//get
+			unsigned int nExpect = nWant < nCount ? nWant : nCount;
+			unsigned int nDone = 0;
+			if ( 0 == nHow )
+			{
+				nDone = circbuff_read ( pvCirc, abyChunk, nWant );
+			}
+			else if ( 1 == nHow )
+			{
+				circbuff_span_t asSpans[2];
+				circbuff_readSpans ( pvCirc, asSpans );
+				for ( nIdx = 0; nIdx < 2 && nDone < nExpect; ++nIdx )
+				{
+					unsigned int n = asSpans[nIdx]._nCount;
+					if ( n > nExpect - nDone )
+						n = nExpect - nDone;
+					memcpy ( &abyChunk[nDone * nTypeSize], asSpans[nIdx]._pv, n * nTypeSize );
+					nDone += n;
+				}
+				circbuff_consume ( pvCirc, nDone );
+			}
+			else
+			{
+				while ( nDone < nWant && ! circbuff_empty ( pvCirc ) )
+				{
+					circbuff_dequeue ( pvCirc, &abyChunk[nDone * nTypeSize] );
+					++nDone;
+				}
+			}
+			CHECK ( nDone == nExpect, "%s: got %u of %u, expected %u", pszName, nDone, nWant, nExpect );
+			for ( nIdx = 0; nIdx < nDone; ++nIdx )
+				for ( nByte = 0; nByte < nTypeSize; ++nByte )
+					CHECK ( abyChunk[nIdx * nTypeSize + nByte] ==
+							(uint8_t)( ( nNextOut + nIdx ) * 7 + nByte ),
+							"%s: item %u byte %u wrong", pszName, nNextOut + nIdx, nByte );
+			nNextOut += nDone;
+		}
+	}
+	printf ( "%s: %u ops, %lu items through\n", pszName, (unsigned int) NOPS,
+			(unsigned long) nNextOut );
+}
+
+
+
+//====================================================
+//benchmark
+
+
+//byte-at-a-time, as the serial I/O used to do it
+static double _benchBytewise ( unsigned int nChunk, unsigned long nTotal )
+{
+	uint8_t abyIn[QUEUE_SIZE];
+	uint8_t abyOut[QUEUE_SIZE];
+	volatile unsigned int nSink = 0;
+	unsigned long nMoved = 0;
+	unsigned int nIdx;
+	memset ( abyIn, 0x55, sizeof(abyIn) );
+	circbuff_init ( &_cbBytes );
+	double tStart = _now();
+	while ( nMoved < nTotal )
+	{
+		for ( nIdx = 0; nIdx < nChunk && circbuff_enqueue ( &_cbBytes, &abyIn[nIdx] ); ++nIdx )
+			;
+		for ( nIdx = 0; nIdx < nChunk && ! circbuff_empty ( &_cbBytes ); ++nIdx )
+			circbuff_dequeue ( &_cbBytes, &abyOut[nIdx] );
+		nSink += abyOut[0];
+		nMoved += nIdx;
+	}
+	(void) nSink;
+	return nMoved / ( ( _now() - tStart ) * 1e6 );
+}
+
+
+//in bulk, with circbuff_write()/circbuff_read()
+static double _benchBulk ( unsigned int nChunk, unsigned long nTotal )
+{
+	uint8_t abyIn[QUEUE_SIZE];
+	uint8_t abyOut[QUEUE_SIZE];
+	volatile unsigned int nSink = 0;
+	unsigned long nMoved = 0;
+	memset ( abyIn, 0x55, sizeof(abyIn) );
+	circbuff_init ( &_cbBytes );
+	//start part-full, so the chunks are always wrapping somewhere
+	circbuff_write ( &_cbBytes, abyIn, QUEUE_SIZE / 2 + 3 );
+	double tStart = _now();
+	while ( nMoved < nTotal )
+	{
+		circbuff_write ( &_cbBytes, abyIn, nChunk );
+		nMoved += circbuff_read ( &_cbBytes, abyOut, nChunk );
+		nSink += abyOut[0];
+	}
+	(void) nSink;
+	return nMoved / ( ( _now() - tStart ) * 1e6 );
+}
+
+
+static void _bench ( void )
+{
+	//1 is the worst case for bulk; 16 is about a DMA half-buffer's idle burst
+	//at GPS rates; 64 is a USB packet
+	static const unsigned int anChunks[] = { 1, 4, 16, 64 };
+	const unsigned long nTotal = 64UL * 1024 * 1024;
+	unsigned int nIdx;
+	printf ( "bench (bytes/us through a %u byte queue):\n", (unsigned int) QUEUE_SIZE );
+	printf ( "  chunk  enqueue/dequeue  write/read\n" );
+	for ( nIdx = 0; nIdx < sizeof(anChunks)/sizeof(anChunks[0]); ++nIdx )
+	{
+		double dByte = _benchBytewise ( anChunks[nIdx], nTotal / 4 );
+		double dBulk = _benchBulk ( anChunks[nIdx], nTotal );
+		printf ( "  %5u  %15.1f  %10.1f\n", anChunks[nIdx], dByte, dBulk );
+	}
+}
+
+
+
+int main ( int argc, char* argv[] )
+{
+	if ( argc > 1 && 0 == strcmp ( "-b", argv[1] ) )
+	{
+		_bench();
+		return 0;
+	}
+
+	_testModel ( &_cbBytes, _cbBytes._abyBuffer, sizeof(uint8_t), "bytes" );
+	_testModel ( &_cbWords, _cbWords._abyBuffer, sizeof(uint32_t), "words" );
+
+	if ( 0 != _nFailures )
+	{
+		printf ( "test_circbuff: %lu FAILURES\n", _nFailures );
+		return 1;
+	}
+	printf ( "test_circbuff: ok\n" );
+	return 0;
+}
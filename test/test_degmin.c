@@ -0,0 +1,314 @@
+//==============================================================
+//This is a host test of the GPS task's integer lat/lon parsing.
+//This module is part of the CarelessWSPR project.
+//
+//_parseDegMinMicro() replaced a float parse (via my_strtof()).  This checks
+//it against an exact (double) reference, and against the old float results
+//within float's resolution, for fields as 4- and 5-decimal receivers send
+//them, and the awkward cases (minute carry, the equator, the poles, the
+//antimeridian).  Then it feeds whole RMC sentences through the parser to
+//check the hemisphere signs, and times the old and new parses.
+//
+//The GPS task module is included whole, so that we can get at its statics.
+//
+//usage:  test_degmin [-b]
+//	-b	only run the benchmark
+
+#include "task_gps.c"
+
+#include "host_board.h"
+#include "test_util.h"
+
+#include <math.h>
+
+
+
+//the parse as it was before, verbatim; my_strtof() does the minutes
+static float _parseDegMinFloat ( const char* pszField, int nLen, int nDegDigits )
+{
+	if ( nLen <= nDegDigits )
+		return 0.0F;
+	float fVal = 0.0F;
+	int nIdx;
+	for ( nIdx = 0; nIdx < nDegDigits; ++nIdx )
+	{
+		fVal = fVal * 10 + ( pszField[nIdx] - '0' );
+	}
+	//remainder is minutes
+	float fmin = my_strtof ( &pszField[nDegDigits], NULL );
+	return fVal + fmin / 60;
+}
+
+
+//exact reference; double has digits to spare for these, and minutes beyond
+//the 6th place are dropped, as the integer parse does
+static int32_t _parseDegMinExact ( const char* pszField, int nDegDigits )
+{
+	char achDeg[4];
+	memcpy ( achDeg, pszField, nDegDigits );
+	achDeg[nDegDigits] = '\0';
+	double dMin = strtod ( &pszField[nDegDigits], NULL );
+	double dMicroMin = floor ( dMin * 1e6 + 1e-3 );
+	return (int32_t)( atoi ( achDeg ) * 1000000LL + llround ( dMicroMin / 60.0 ) );
+}
+
+
+
+//the fields, as receivers send them (the first few are from the u-blox and
+//MediaTek protocol manuals' examples)
+typedef struct DegMinCase
+{
+	const char* _pszField;
+	int _nDegDigits;
+} DegMinCase;
+
+static const DegMinCase _aCases[] =
+{
+	//u-blox (5 places)
+	{ "4717.11437", 2 }, { "00833.91522", 3 },
+	{ "3352.12345", 2 }, { "15112.67890", 3 },
+	//MediaTek, SiRF (4 places)
+	{ "2307.1256", 2 }, { "12016.4438", 3 },
+	{ "4916.4500", 2 }, { "12311.1200", 3 },
+	//older ones (2 or 3 places), and none
+	{ "4916.45", 2 }, { "12311.12", 3 }, { "4807.038", 2 }, { "01131.000", 3 },
+	{ "4916", 2 }, { "12311", 3 },
+	//minute carry; these round up into the next degree
+	{ "4959.99999", 2 }, { "4959.999999", 2 }, { "17959.99999", 3 },
+	{ "0059.99998", 2 }, { "0959.9999", 2 },
+	//and these don't quite
+	{ "4959.99996", 2 }, { "17959.99996", 3 },
+	//exact halves of a micro-degree (30 micro-minutes), which round up
+	{ "4500.00003", 2 }, { "00000.00003", 3 },
+	//the equator and prime meridian, the poles and the antimeridian
+	{ "0000.00000", 2 }, { "00000.00000", 3 }, { "9000.00000", 2 },
+	{ "8959.99999", 2 }, { "18000.0000", 3 }, { "17959.9999", 3 },
+	//more places than we keep (the rest are ignored)
+	{ "4717.1143789", 2 }, { "00833.9152299", 3 },
+};
+
+//(the degree digits are taken from the length before the point)
+static const char* const _apszBadCases[] =
+{
+	"49", "", "4", "4x16.45", "4916.4x", "49-6.45", "4916.-45",
+	"4916..45", "4916.4.5", "49 16.45", "4960.00000", "12360.0000",
+	//more than two digits of minutes; these would overflow, unchecked
+	"49999999999999.0", "123999999999999.9", "491234.5",
+};
+
+
+static void _testFields ( void )
+{
+	double dMaxErrLat = 0.0;
+	double dMaxErrLon = 0.0;
+	unsigned int nIdx;
+	for ( nIdx = 0; nIdx < COUNTOF(_aCases); ++nIdx )
+	{
+		const char* pszField = _aCases[nIdx]._pszField;
+		int nDegDigits = _aCases[nIdx]._nDegDigits;
+		int nLen = (int) strlen ( pszField );
+		int32_t nMicro = _parseDegMinMicro ( pszField, nLen, nDegDigits );
+		int32_t nExact = _parseDegMinExact ( pszField, nDegDigits );
+		float fOld = _parseDegMinFloat ( pszField, nLen, nDegDigits );
+
+		CHECK ( nMicro == nExact, "%s: %d, expected %d", pszField, nMicro, nExact );
+
+		//the old one can only be as good as a float near that value (about 4
+		//micro-degrees at 90, 8 at 180), plus its own arithmetic
+		double dErr = fabs ( nMicro - fOld * 1e6 );
+		double dTol = ( 2 == nDegDigits ) ? 8.0 : 16.0;
+		CHECK ( dErr <= dTol, "%s: %d, but float said %.1f", pszField, nMicro, fOld * 1e6 );
+		if ( 2 == nDegDigits && dErr > dMaxErrLat )
+			dMaxErrLat = dErr;
+		if ( 3 == nDegDigits && dErr > dMaxErrLon )
+			dMaxErrLon = dErr;
+	}
+
+	//malformed is nothing
+	unsigned int nBad;
+	for ( nBad = 0; nBad < COUNTOF(_apszBadCases); ++nBad )
+	{
+		const char* pszField = _apszBadCases[nBad];
+		int nDegDigits = ( 5 == strcspn ( pszField, "." ) ) ? 3 : 2;
+		int32_t nMicro = _parseDegMinMicro ( pszField, (int) strlen ( pszField ), nDegDigits );
+		CHECK ( -1 == nMicro, "'%s' gave %d", pszField, nMicro );
+	}
+
+	printf ( "fields: %u; old float was off by at most %.1f (lat), %.1f (lon) micro-degrees\n",
+			(unsigned int) COUNTOF(_aCases), dMaxErrLat, dMaxErrLon );
+}
+
+
+
+//(the DOPs are parsed the same way, to hundredths)
+static void _testHundredths ( void )
+{
+	CHECK ( 100 == _parseHundredths ( "1" ), "1" );
+	CHECK ( 1200 == _parseHundredths ( "12" ), "12" );
+	CHECK ( 120 == _parseHundredths ( "1.2" ), "1.2" );
+	CHECK ( 95 == _parseHundredths ( "0.95" ), "0.95" );
+	CHECK ( 1234 == _parseHundredths ( "12.345" ), "12.345" );
+	CHECK ( 0 == _parseHundredths ( "" ), "empty" );
+}
+
+
+
+//====================================================
+//whole sentences
+
+
+//wrap a sentence body in '$', the checksum, and CR LF
+static size_t _sentence ( char* pch, const char* pszBody )
+{
+	uint8_t byCk = 0;
+	const char* pchCk;
+	for ( pchCk = pszBody; '\0' != *pchCk; ++pchCk )
+	{
+		byCk ^= (uint8_t) *pchCk;
+	}
+	return (size_t) sprintf ( pch, "$%s*%02X\r\n", pszBody, byCk );
+}
+
+
+typedef struct SentenceCase
+{
+	const char* _pszBody;
+	int32_t _nLatMicro;
+	int32_t _nLonMicro;
+} SentenceCase;
+
+static const SentenceCase _aSentences[] =
+{
+	{ "GPRMC,083559.00,A,4717.11437,N,00833.91522,E,0.004,77.52,091202,,,A",
+			47285240, 8565254 },
+	{ "GPRMC,064951.000,A,2307.1256,N,12016.4438,E,0.03,165.48,260406,3.05,W,A",
+			23118760, 120274063 },
+	{ "GPRMC,225446,A,4916.45,N,12311.12,W,000.5,054.7,191194,020.3,E",
+			49274167, -123185333 },
+	{ "GNRMC,001031.00,A,3352.12345,S,15112.67890,E,0.011,,010119,,,A",
+			-33868724, 151211315 },
+	{ "GPRMC,120000.00,A,5130.00000,S,05807.50000,W,0.0,,311299,,,A",
+			-51500000, -58125000 },
+	{ "GPRMC,235959.00,A,0000.00000,N,00000.00000,E,0.0,,010100,,,A",
+			0, 0 },
+	{ "GPRMC,235959.00,A,4959.99999,S,17959.99999,W,0.0,,010100,,,A",
+			-50000000, -180000000 },
+};
+
+
+static void _testSentences ( void )
+{
+	Settings_restoreDefaults();
+	GPS_resetParser();
+
+	unsigned int nIdx;
+	for ( nIdx = 0; nIdx < COUNTOF(_aSentences); ++nIdx )
+	{
+		char ach[128];
+		size_t nLen = _sentence ( ach, _aSentences[nIdx]._pszBody );
+		HostStream hs;
+		HostStream_init ( &hs, ach, nLen );
+		HostStream_deliver ( &hs, nLen );
+		GPS_drain ( &hs._if );
+
+		GPSFix fix;
+		GPS_getFix ( &fix );
+		CHECK ( fix._nLatMicro == _aSentences[nIdx]._nLatMicro &&
+				fix._nLonMicro == _aSentences[nIdx]._nLonMicro,
+				"%s: %d %d, expected %d %d", _aSentences[nIdx]._pszBody,
+				fix._nLatMicro, fix._nLonMicro,
+				_aSentences[nIdx]._nLatMicro, _aSentences[nIdx]._nLonMicro );
+	}
+	CHECK ( (uint32_t) COUNTOF(_aSentences) == g_nssRMC._nGood, "%u good RMC",
+			(unsigned int) g_nssRMC._nGood );
+
+	//a garbled position is no fix, even if the receiver says it's valid; the
+	//last good one stands
+	{
+		char ach[128];
+		size_t nLen = _sentence ( ach,
+				"GPRMC,235959.00,A,47x7.11437,N,00833.91522,E,0.0,,010100,,,A" );
+		HostStream hs;
+		HostStream_init ( &hs, ach, nLen );
+		HostStream_deliver ( &hs, nLen );
+		GPS_drain ( &hs._if );
+
+		GPSFix fix;
+		GPS_getFix ( &fix );
+		const SentenceCase* psc = &_aSentences[COUNTOF(_aSentences) - 1];
+		CHECK ( fix._nLatMicro == psc->_nLatMicro && fix._nLonMicro == psc->_nLonMicro,
+				"garbled position taken: %d %d", fix._nLatMicro, fix._nLonMicro );
+	}
+	printf ( "sentences: %u\n", (unsigned int) COUNTOF(_aSentences) );
+}
+
+
+
+//====================================================
+//benchmark
+
+
+static void _bench ( void )
+{
+	enum { NREPS = 200000 };
+	int anLen[COUNTOF(_aCases)];
+	unsigned int nIdx, nRep;
+	for ( nIdx = 0; nIdx < COUNTOF(_aCases); ++nIdx )
+	{
+		anLen[nIdx] = (int) strlen ( _aCases[nIdx]._pszField );
+	}
+
+	volatile int32_t nSink = 0;
+	volatile float fSink = 0.0F;
+	double tStart, tFloat, tMicro;
+	uint64_t cycStart, cycFloat, cycMicro;
+
+	tStart = _now();
+	cycStart = _cycles();
+	for ( nRep = 0; nRep < NREPS; ++nRep )
+		for ( nIdx = 0; nIdx < COUNTOF(_aCases); ++nIdx )
+			fSink += _parseDegMinFloat ( _aCases[nIdx]._pszField, anLen[nIdx],
+					_aCases[nIdx]._nDegDigits );
+	cycFloat = _cycles() - cycStart;
+	tFloat = _now() - tStart;
+
+	tStart = _now();
+	cycStart = _cycles();
+	for ( nRep = 0; nRep < NREPS; ++nRep )
+		for ( nIdx = 0; nIdx < COUNTOF(_aCases); ++nIdx )
+			nSink += _parseDegMinMicro ( _aCases[nIdx]._pszField, anLen[nIdx],
+					_aCases[nIdx]._nDegDigits );
+	cycMicro = _cycles() - cycStart;
+	tMicro = _now() - tStart;
+
+	double nCalls = (double) NREPS * COUNTOF(_aCases);
+	printf ( "bench (per field; host has an FPU, the target uses soft-float):\n" );
+	printf ( "                     ns   TSC ticks\n" );
+	printf ( "  float (my_strtof) %5.1f  %6.1f\n", tFloat / nCalls * 1e9, cycFloat / nCalls );
+	printf ( "  _parseDegMinMicro %5.1f  %6.1f\n", tMicro / nCalls * 1e9, cycMicro / nCalls );
+	(void) nSink;
+	(void) fSink;
+}
+
+
+
+int main ( int argc, char* argv[] )
+{
+	if ( argc > 1 && 0 == strcmp ( "-b", argv[1] ) )
+	{
+		_bench();
+		return 0;
+	}
+
+	_testFields();
+	_testHundredths();
+	_testSentences();
+
+	if ( 0 != _nFailures )
+	{
+		printf ( "test_degmin: %lu FAILURES\n", _nFailures );
+		return 1;
+	}
+	printf ( "test_degmin: ok\n" );
+	return 0;
+}
@@ -0,0 +1,300 @@
+//==============================================================
+//This is a host test of the maidenhead module.
+//This module is part of the CarelessWSPR project.
+//
+//The integer toMaidenheadMicro() replaced the float toMaidenhead() on the
+//target; this checks that they agree over a dense lat/lon grid at every
+//length, except where the float one is within its rounding error of a cell
+//boundary (where the integer one is the right one).  It then checks
+//fromMaidenhead() against toMaidenheadMicro() for every locator up to 6
+//characters, and times all three.
+//
+//usage:  test_maidenhead [-b]
+//	-b	only run the benchmark
+
+#include "maidenhead.h"
+
+#include "host/test_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+
+
+//a float has a 24 bit mantissa, so near 180 degrees it can only resolve about
+//11 micro-degrees, and toMaidenhead() does several steps of arithmetic on it.
+//Disagreement within this many (latitude) micro-degrees of a cell boundary is
+//put down to float rounding.
+#define FLOAT_TOL_MICRO	100
+
+
+
+//====================================================
+//grid equivalence
+
+
+typedef struct GridStats
+{
+	unsigned long _nPoints;		//(point, length) pairs tried
+	unsigned long _nSame;		//float and integer agree
+	unsigned long _nNearEdge;	//disagree, but within FLOAT_TOL_MICRO of an edge
+	unsigned long _nLastCell;	//the pole/antimeridian (float goes one past)
+} GridStats;
+
+
+static void _checkPoint ( int32_t latMicro, int32_t lonMicro, GridStats* pgs )
+{
+	unsigned int nLen;
+	for ( nLen = 2; nLen <= 8; nLen += 2 )
+	{
+		char achInt[9];
+		char achFlt[9];
+		++pgs->_nPoints;
+		int bInt = toMaidenheadMicro ( latMicro, lonMicro, achInt, nLen );
+		int bFlt = toMaidenhead ( (float)( latMicro / 1e6 ), (float)( lonMicro / 1e6 ),
+				achFlt, nLen );
+		CHECK ( bInt && bFlt, "%d %d len %u rejected", latMicro, lonMicro, nLen );
+		if ( ! bInt || ! bFlt )
+			continue;
+
+		//the integer locator must always contain the point
+		CHECK ( inMaidenhead ( achInt, latMicro, lonMicro, 0 ),
+				"%d %d -> %s, which does not contain it", latMicro, lonMicro, achInt );
+
+		if ( 0 == strcmp ( achInt, achFlt ) )
+		{
+			++pgs->_nSame;
+		}
+		else if ( 90000000 == latMicro || 180000000 == lonMicro )
+		{
+			//documented difference; the integer one stays in the last cell
+			++pgs->_nLastCell;
+		}
+		else
+		{
+			//if we are well inside the integer cell, float should have agreed
+			CHECK ( ! inMaidenhead ( achInt, latMicro, lonMicro, -FLOAT_TOL_MICRO ),
+					"%d %d len %u: int %s, float %s", latMicro, lonMicro, nLen,
+					achInt, achFlt );
+			++pgs->_nNearEdge;
+		}
+	}
+}
+
+
+static void _sweepGrid ( int32_t nStepLat, int32_t nStepLon, GridStats* pgs )
+{
+	int32_t latMicro, lonMicro;
+	for ( latMicro = -90000000; latMicro <= 90000000; latMicro += nStepLat )
+	{
+		for ( lonMicro = -180000000; lonMicro <= 180000000; lonMicro += nStepLon )
+		{
+			_checkPoint ( latMicro, lonMicro, pgs );
+		}
+	}
+	//always do the extreme edges, whatever the step
+	for ( latMicro = -90000000; latMicro <= 90000000; latMicro += nStepLat )
+	{
+		_checkPoint ( latMicro, 180000000, pgs );
+	}
+	for ( lonMicro = -180000000; lonMicro <= 180000000; lonMicro += nStepLon )
+	{
+		_checkPoint ( 90000000, lonMicro, pgs );
+	}
+}
+
+
+static void _testGrid ( void )
+{
+	GridStats gs;
+	memset ( &gs, 0, sizeof(gs) );
+	//0.05 x 0.1 degree puts every point on some boundary (they are all
+	//multiples of the 1/240 degree extended square), which is the hard case
+	_sweepGrid ( 50000, 100000, &gs );
+	//and this step is not commensurate with any cell, so it is mostly interior
+	_sweepGrid ( 100003, 200003, &gs );
+	printf ( "grid: %lu tried; %lu same, %lu float near-edge, %lu last-cell\n",
+			gs._nPoints, gs._nSame, gs._nNearEdge, gs._nLastCell );
+}
+
+
+
+//====================================================
+//locator round trip
+
+
+static void _checkLocator ( const char* pszLoc )
+{
+	int32_t latMicro, lonMicro;
+	char achLoc[9];
+	unsigned int nLen = (unsigned int) strlen ( pszLoc );
+
+	CHECK ( fromMaidenhead ( pszLoc, &latMicro, &lonMicro ), "%s rejected", pszLoc );
+	CHECK ( toMaidenheadMicro ( latMicro, lonMicro, achLoc, nLen ) &&
+			0 == strcmp ( achLoc, pszLoc ), "%s -> %d %d -> %s", pszLoc,
+			latMicro, lonMicro, achLoc );
+	CHECK ( inMaidenhead ( pszLoc, latMicro, lonMicro, 0 ), "%s center outside", pszLoc );
+}
+
+
+static void _testLocators ( void )
+{
+	unsigned long nLocs = 0;
+	char achLoc[7];
+	int f0, f1, s0, s1, u0, u1;
+	for ( f0 = 0; f0 < 18; ++f0 )
+	for ( f1 = 0; f1 < 18; ++f1 )
+	{
+		achLoc[0] = 'A' + f0;
+		achLoc[1] = 'A' + f1;
+		achLoc[2] = '\0';
+		_checkLocator ( achLoc );
+		++nLocs;
+		for ( s0 = 0; s0 < 10; ++s0 )
+		for ( s1 = 0; s1 < 10; ++s1 )
+		{
+			achLoc[2] = '0' + s0;
+			achLoc[3] = '0' + s1;
+			achLoc[4] = '\0';
+			_checkLocator ( achLoc );
+			++nLocs;
+			for ( u0 = 0; u0 < 24; ++u0 )
+			for ( u1 = 0; u1 < 24; ++u1 )
+			{
+				achLoc[4] = 'a' + u0;
+				achLoc[5] = 'a' + u1;
+				achLoc[6] = '\0';
+				_checkLocator ( achLoc );
+				++nLocs;
+			}
+		}
+	}
+
+	//8 characters; all of the extended squares in a sample of subsquares
+	const char* apszSub[] = { "AA00aa", "FN31pr", "JO62qm", "RR99xx", "IO91wm", "QF56od" };
+	unsigned int nIdx;
+	for ( nIdx = 0; nIdx < sizeof(apszSub)/sizeof(apszSub[0]); ++nIdx )
+	{
+		char achExt[9];
+		strcpy ( achExt, apszSub[nIdx] );
+		for ( s0 = 0; s0 < 10; ++s0 )
+		for ( s1 = 0; s1 < 10; ++s1 )
+		{
+			achExt[6] = '0' + s0;
+			achExt[7] = '0' + s1;
+			achExt[8] = '\0';
+			_checkLocator ( achExt );
+			++nLocs;
+		}
+	}
+
+	//case-insensitive
+	int32_t lat1, lon1, lat2, lon2;
+	CHECK ( fromMaidenhead ( "fn31PR", &lat1, &lon1 ) &&
+			fromMaidenhead ( "FN31pr", &lat2, &lon2 ) &&
+			lat1 == lat2 && lon1 == lon2, "case matters" );
+
+	//malformed ones
+	const char* apszBad[] = { "", "F", "FN3", "FN31p", "SA", "AS", "F031", "FNA1",
+			"FN31yy", "FN31p0", "FN31pr0A", "FN31pr00aa", "F!31" };
+	for ( nIdx = 0; nIdx < sizeof(apszBad)/sizeof(apszBad[0]); ++nIdx )
+	{
+		CHECK ( ! fromMaidenhead ( apszBad[nIdx], &lat1, &lon1 ), "'%s' accepted",
+				apszBad[nIdx] );
+	}
+
+	//out of range and silly lengths
+	CHECK ( ! toMaidenheadMicro ( 90000001, 0, achLoc, 4 ), "lat > 90 accepted" );
+	CHECK ( ! toMaidenheadMicro ( -90000001, 0, achLoc, 4 ), "lat < -90 accepted" );
+	CHECK ( ! toMaidenheadMicro ( 0, 180000001, achLoc, 4 ), "lon > 180 accepted" );
+	CHECK ( ! toMaidenheadMicro ( 0, -180000001, achLoc, 4 ), "lon < -180 accepted" );
+	CHECK ( ! toMaidenheadMicro ( 0, 0, achLoc, 3 ), "odd length accepted" );
+	CHECK ( ! toMaidenheadMicro ( 0, 0, achLoc, 10 ), "length 10 accepted" );
+
+	printf ( "locators: %lu round-tripped\n", nLocs );
+}
+
+
+
+//====================================================
+//benchmark
+
+
+static void _bench ( void )
+{
+	//the same pseudo-random points for each, so they do the same work
+	enum { NPOINTS = 4096, NREPS = 500 };
+	static int32_t anLat[NPOINTS];
+	static int32_t anLon[NPOINTS];
+	static float afLat[NPOINTS];
+	static float afLon[NPOINTS];
+	static char achLocs[NPOINTS][9];
+	unsigned int nIdx, nRep;
+	srand ( 1 );
+	for ( nIdx = 0; nIdx < NPOINTS; ++nIdx )
+	{
+		anLat[nIdx] = (int32_t)( (double) rand() / RAND_MAX * 180000000 ) - 90000000;
+		anLon[nIdx] = (int32_t)( (double) rand() / RAND_MAX * 360000000 ) - 180000000;
+		afLat[nIdx] = (float)( anLat[nIdx] / 1e6 );
+		afLon[nIdx] = (float)( anLon[nIdx] / 1e6 );
+		toMaidenheadMicro ( anLat[nIdx], anLon[nIdx], achLocs[nIdx], 6 );
+	}
+
+	volatile int nSink = 0;
+	char achLoc[9];
+	double tStart, tFloat, tMicro, tFrom;
+
+	tStart = _now();
+	for ( nRep = 0; nRep < NREPS; ++nRep )
+		for ( nIdx = 0; nIdx < NPOINTS; ++nIdx )
+			nSink += toMaidenhead ( afLat[nIdx], afLon[nIdx], achLoc, 6 ) + achLoc[5];
+	tFloat = _now() - tStart;
+
+	tStart = _now();
+	for ( nRep = 0; nRep < NREPS; ++nRep )
+		for ( nIdx = 0; nIdx < NPOINTS; ++nIdx )
+			nSink += toMaidenheadMicro ( anLat[nIdx], anLon[nIdx], achLoc, 6 ) + achLoc[5];
+	tMicro = _now() - tStart;
+
+	tStart = _now();
+	for ( nRep = 0; nRep < NREPS; ++nRep )
+	{
+		for ( nIdx = 0; nIdx < NPOINTS; ++nIdx )
+		{
+			int32_t latMicro, lonMicro;
+			nSink += fromMaidenhead ( achLocs[nIdx], &latMicro, &lonMicro ) + latMicro;
+		}
+	}
+	tFrom = _now() - tStart;
+
+	double nCalls = (double) NPOINTS * NREPS;
+	printf ( "bench (6 chars, ns/call; host has an FPU, the target uses soft-float):\n" );
+	printf ( "  toMaidenhead       %7.1f\n", tFloat / nCalls * 1e9 );
+	printf ( "  toMaidenheadMicro  %7.1f\n", tMicro / nCalls * 1e9 );
+	printf ( "  fromMaidenhead     %7.1f\n", tFrom / nCalls * 1e9 );
+	(void) nSink;
+}
+
+
+
+int main ( int argc, char* argv[] )
+{
+	if ( argc > 1 && 0 == strcmp ( "-b", argv[1] ) )
+	{
+		_bench();
+		return 0;
+	}
+
+	_testGrid();
+	_testLocators();
+
+	if ( 0 != _nFailures )
+	{
+		printf ( "test_maidenhead: %lu FAILURES\n", _nFailures );
+		return 1;
+	}
+	printf ( "test_maidenhead: ok\n" );
+	return 0;
+}
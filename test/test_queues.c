@@ -0,0 +1,172 @@
+//==============================================================
+//This is a host comparison of the generic and type-specialized byte queues.
+//This module is part of the CarelessWSPR project.
+//
+//CIRCBUF_SIMPLE and SPSCBUF_SIMPLE replaced the generic circbuff and
+//spscbuff on the queues that are worked a byte at a time (the UART TX
+//interrupts).  This checks that all four flavours behave the same, an item at
+//a time, through fills, drains, and every wrap position.  With -b it times
+//put and get for each; 'make sizes' gives the code each costs.
+//
+//(The host numbers are for comparing the flavours; the target has no cache
+//and a simpler pipeline, and pays more for the calls and the memcpy, so the
+//gap there is wider.  Building the objects for the target, with 'make sizes
+//CROSS=arm-none-eabi-', gives the sizes that matter.)
+//
+//usage:  test_queues [-b]
+//	-b	only run the benchmark
+
+#include "queue_ops.h"
+
+#include "host/test_util.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+
+typedef struct QueueOps QueueOps;
+struct QueueOps
+{
+	const char* _pszName;
+	void (*_init) ( void );
+	int (*_put) ( uint8_t by );
+	int (*_get) ( uint8_t* pby );
+};
+
+static const QueueOps _aOps[] =
+{
+	{ "circbuff", circbuff_ops_init, circbuff_ops_put, circbuff_ops_get },
+	{ "CIRCBUF_SIMPLE", circbuf_simple_ops_init, circbuf_simple_ops_put, circbuf_simple_ops_get },
+	{ "spscbuff", spscbuff_ops_init, spscbuff_ops_put, spscbuff_ops_get },
+	{ "SPSCBUF_SIMPLE", spscbuf_simple_ops_init, spscbuf_simple_ops_put, spscbuf_simple_ops_get },
+};
+
+#define NOPS	(sizeof(_aOps)/sizeof(_aOps[0]))
+
+
+
+//====================================================
+//they all agree
+
+
+static void _testSame ( void )
+{
+	enum { NSTEPS = 100000 };
+	unsigned int nIdx, nStep;
+	uint8_t byNextIn = 0;
+	uint8_t byNextOut = 0;
+	unsigned int nCount = 0;
+
+	for ( nIdx = 0; nIdx < NOPS; ++nIdx )
+		_aOps[nIdx]._init();
+
+	//random runs of puts or gets, long enough to fill and to drain
+	srand ( 3 );
+	for ( nStep = 0; nStep < NSTEPS; ++nStep )
+	{
+		int bPut = rand() & 1;
+		unsigned int nRun = (unsigned int) rand() % ( QUEUE_OPS_SIZE + 8 );
+		unsigned int nRep;
+		for ( nRep = 0; nRep < nRun; ++nRep )
+		{
+			int bExpect = bPut ? ( nCount < QUEUE_OPS_SIZE ) : ( nCount > 0 );
+			for ( nIdx = 0; nIdx < NOPS; ++nIdx )
+			{
+				if ( bPut )
+				{
+					int bOk = _aOps[nIdx]._put ( byNextIn );
+					CHECK ( bOk == bExpect, "%s: put with %u in: %d", _aOps[nIdx]._pszName,
+							nCount, bOk );
+				}
+				else
+				{
+					uint8_t by = 0;
+					int bOk = _aOps[nIdx]._get ( &by );
+					CHECK ( bOk == bExpect, "%s: get with %u in: %d", _aOps[nIdx]._pszName,
+							nCount, bOk );
+					CHECK ( ! bOk || by == byNextOut, "%s: got %02x, expected %02x",
+							_aOps[nIdx]._pszName, by, byNextOut );
+				}
+			}
+			if ( bExpect )
+			{
+				if ( bPut )
+				{
+					++byNextIn;
+					++nCount;
+				}
+				else
+				{
+					++byNextOut;
+					--nCount;
+				}
+			}
+		}
+	}
+	printf ( "same: %u flavours over %u runs\n", (unsigned int) NOPS, (unsigned int) NSTEPS );
+}
+
+
+
+//====================================================
+//benchmark
+
+
+static void _bench ( void )
+{
+	//put a burst, then get it, as a TX queue sees it; 16 is a typical line
+	//of command response, and the queue is half full on average
+	enum { NBURST = 16, NREPS = 2000000 };
+	unsigned int nIdx, nRep, nByte;
+	volatile unsigned int nSink = 0;
+	printf ( "bench (a byte through, put + get, bursts of %u):\n", (unsigned int) NBURST );
+	printf ( "                    ns   TSC ticks\n" );
+	for ( nIdx = 0; nIdx < NOPS; ++nIdx )
+	{
+		const QueueOps* pops = &_aOps[nIdx];
+		uint8_t by = 0;
+		pops->_init();
+		for ( nByte = 0; nByte < QUEUE_OPS_SIZE / 2; ++nByte )
+			pops->_put ( (uint8_t) nByte );
+
+		double tStart = _now();
+		uint64_t cycStart = _cycles();
+		for ( nRep = 0; nRep < NREPS; ++nRep )
+		{
+			for ( nByte = 0; nByte < NBURST; ++nByte )
+				pops->_put ( (uint8_t) nByte );
+			for ( nByte = 0; nByte < NBURST; ++nByte )
+				pops->_get ( &by );
+			nSink += by;
+		}
+		uint64_t cyc = _cycles() - cycStart;
+		double t = _now() - tStart;
+
+		double nBytes = (double) NREPS * NBURST;
+		printf ( "  %-15s %5.2f  %6.2f\n", pops->_pszName, t / nBytes * 1e9, cyc / nBytes );
+	}
+	(void) nSink;
+}
+
+
+
+int main ( int argc, char* argv[] )
+{
+	if ( argc > 1 && 0 == strcmp ( "-b", argv[1] ) )
+	{
+		_bench();
+		return 0;
+	}
+
+	_testSame();
+
+	if ( 0 != _nFailures )
+	{
+		printf ( "test_queues: %lu FAILURES\n", _nFailures );
+		return 1;
+	}
+	printf ( "test_queues: ok\n" );
+	return 0;
+}